@@ -0,0 +1,121 @@
+// AttributeIndex.h - ordered secondary indexes on file size and mtime
+//
+// every indexed file sits in two balanced trees (std::set), one ordered by
+// content size and one by modifiedTime, with the node pointer breaking
+// ties. finding where a range starts is O(log n), and after that each file
+// in the range, or each of the top k, costs O(1) to step to.
+//
+// the key a file was filed under is remembered, so it can be found and
+// moved after the file has already changed.
+
+#ifndef ATTRIBUTEINDEX_H
+#define ATTRIBUTEINDEX_H
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+
+using namespace std;
+
+enum AttributeOrder { BY_SIZE, BY_MODIFIED };
+
+template <typename Node>
+class AttributeIndex {
+private:
+    struct Keys {
+        uint64_t size;
+        time_t modified;
+    };
+
+    set<pair<uint64_t, Node*>> bySize;
+    set<pair<time_t, Node*>> byModified;
+    unordered_map<Node*, Keys> keysOf;
+
+public:
+    void clear() {
+        bySize.clear();
+        byModified.clear();
+        keysOf.clear();
+    }
+
+    // files the index knows about
+    size_t fileCount() {
+        return keysOf.size();
+    }
+
+    // (re)files node under its current size and mtime
+    void update(Node* node) {
+        remove(node);
+        Keys keys;
+        keys.size = node->content.length();
+        keys.modified = node->modifiedTime;
+        keysOf[node] = keys;
+        bySize.insert(make_pair(keys.size, node));
+        byModified.insert(make_pair(keys.modified, node));
+    }
+
+    // forgets a file, call before it is deleted
+    void remove(Node* node) {
+        auto found = keysOf.find(node);
+        if (found == keysOf.end()) {
+            return;
+        }
+        bySize.erase(make_pair(found->second.size, node));
+        byModified.erase(make_pair(found->second.modified, node));
+        keysOf.erase(found);
+    }
+
+    // calls onNode(node) for files with low <= size <= high, smallest
+    // first, until it returns false
+    template <typename Callback>
+    void sizeRange(uint64_t low, uint64_t high, Callback onNode) {
+        for (auto it = bySize.lower_bound(make_pair(low, (Node*)nullptr)); it != bySize.end() && it->first <= high; ++it) {
+            if (!onNode(it->second)) {
+                return;
+            }
+        }
+    }
+
+    // same for low <= modifiedTime <= high, oldest first
+    template <typename Callback>
+    void modifiedRange(time_t low, time_t high, Callback onNode) {
+        for (auto it = byModified.lower_bound(make_pair(low, (Node*)nullptr)); it != byModified.end() && it->first <= high;
+             ++it) {
+            if (!onNode(it->second)) {
+                return;
+            }
+        }
+    }
+
+    // calls onNode(node) from the largest file down, until it returns false
+    template <typename Callback>
+    void largestFirst(Callback onNode) {
+        for (auto it = bySize.rbegin(); it != bySize.rend(); ++it) {
+            if (!onNode(it->second)) {
+                return;
+            }
+        }
+    }
+
+    // calls onNode(node) from the most recently modified file back
+    template <typename Callback>
+    void newestFirst(Callback onNode) {
+        for (auto it = byModified.rbegin(); it != byModified.rend(); ++it) {
+            if (!onNode(it->second)) {
+                return;
+            }
+        }
+    }
+
+    // approximate heap bytes: a red-black tree node per set entry (three
+    // pointers and a color, then the pair) and a hash node per file
+    size_t memoryUsed() {
+        size_t treeNode = 4 * sizeof(void*) + sizeof(pair<uint64_t, Node*>);
+        size_t hashNode = sizeof(void*) + sizeof(pair<Node* const, Keys>) + sizeof(size_t);
+        return keysOf.size() * (2 * treeNode + hashNode) + keysOf.bucket_count() * sizeof(void*);
+    }
+};
+
+#endif
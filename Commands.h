@@ -0,0 +1,597 @@
+// Commands.h - command table shared by every mode in main.cpp
+// each command has one handler, aliases from the different modes
+// (list/ls, view/cat, ...) all map to the same entry
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include "FileSystem.h"
+
+using namespace std;
+
+enum CommandId {
+    CMD_LIST,
+    CMD_MKDIR,
+    CMD_CD,
+    CMD_TOUCH,
+    CMD_CAT,
+    CMD_NANO,
+    CMD_RM,
+    CMD_FIND,
+    CMD_GLOB,
+    CMD_REGEX,
+    CMD_STAT,
+    CMD_PWD,
+    CMD_INFO,
+    CMD_UNDO,
+    CMD_REDO,
+    CMD_METRICS,
+    CMD_MEMSTATS,
+    CMD_TRACE,
+    CMD_COMPACT,
+    CMD_GREP,
+    CMD_INDEX,
+    CMD_SEARCH,
+    CMD_TOP,
+    CMD_IMPORT,
+    CMD_EXPORT,
+    CMD_HELP,
+    CMD_MODE,
+    CMD_EXIT,
+    CMD_UNKNOWN
+};
+
+// what the caller should do after a command
+enum CommandResult { CONTINUE, SWITCH_MODE, EXIT_PROGRAM };
+
+// how messages are worded: intuitive mode says "Usage: view [name]",
+// the unix modes say "cat: missing operand"
+enum CommandStyle { STYLE_INTUITIVE, STYLE_UNIX };
+
+// everything a handler needs to run one command
+struct CommandContext {
+    FileSystem& fs;
+    string name;        // the name the user typed, used in messages
+    string argument;
+    istream& in;        // where nano/editfile read content from
+    bool interactive;   // print prompts?
+    CommandStyle style;
+    bool hostAccess;    // may commands read and write files on the real disk?
+
+    CommandContext(FileSystem& f, istream& input, bool isInteractive, CommandStyle s)
+        : fs(f), in(input) {
+        interactive = isInteractive;
+        style = s;
+        hostAccess = true;
+    }
+};
+
+struct CommandAlias {
+    string_view name;
+    CommandId id;
+};
+
+// every accepted command name, kept sorted so lookup is a binary search
+constexpr CommandAlias commandAliases[] = {
+    {"cat", CMD_CAT},
+    {"cd", CMD_CD},
+    {"compact", CMD_COMPACT},
+    {"createfile", CMD_TOUCH},
+    {"createfolder", CMD_MKDIR},
+    {"delete", CMD_RM},
+    {"details", CMD_STAT},
+    {"du", CMD_MEMSTATS},
+    {"editfile", CMD_NANO},
+    {"exit", CMD_EXIT},
+    {"export", CMD_EXPORT},
+    {"find", CMD_FIND},
+    {"findfile", CMD_FIND},
+    {"glob", CMD_GLOB},
+    {"grep", CMD_GREP},
+    {"help", CMD_HELP},
+    {"import", CMD_IMPORT},
+    {"index", CMD_INDEX},
+    {"info", CMD_INFO},
+    {"list", CMD_LIST},
+    {"ls", CMD_LIST},
+    {"memstats", CMD_MEMSTATS},
+    {"metrics", CMD_METRICS},
+    {"mkdir", CMD_MKDIR},
+    {"mode", CMD_MODE},
+    {"nano", CMD_NANO},
+    {"openfolder", CMD_CD},
+    {"pwd", CMD_PWD},
+    {"quit", CMD_EXIT},
+    {"redo", CMD_REDO},
+    {"regex", CMD_REGEX},
+    {"report", CMD_INFO},
+    {"rm", CMD_RM},
+    {"search", CMD_SEARCH},
+    {"searchtext", CMD_GREP},
+    {"stat", CMD_STAT},
+    {"top", CMD_TOP},
+    {"touch", CMD_TOUCH},
+    {"trace", CMD_TRACE},
+    {"undo", CMD_UNDO},
+    {"view", CMD_CAT},
+    {"where", CMD_PWD},
+};
+
+constexpr int commandAliasCount = sizeof(commandAliases) / sizeof(commandAliases[0]);
+
+constexpr bool aliasesSorted() {
+    for (int i = 1; i < commandAliasCount; i++) {
+        if (!(commandAliases[i - 1].name < commandAliases[i].name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(aliasesSorted(), "commandAliases must be sorted by name");
+
+// finds the command for a typed name - O(log n) over a small constant table
+inline CommandId lookupCommand(string_view name) {
+    int low = 0;
+    int high = commandAliasCount - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = name.compare(commandAliases[mid].name);
+        if (cmp == 0) {
+            return commandAliases[mid].id;
+        }
+        if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return CMD_UNKNOWN;
+}
+
+// reads nano-style content lines until END
+inline string readContent(istream& in) {
+    string content = "";
+    string line;
+    while (getline(in, line)) {
+        if (line == "END") {
+            break;
+        }
+        content += line;
+        content += '\n';
+    }
+    return content;
+}
+
+// refuses a command that would touch the real disk when the context may
+// not, true if it did
+inline bool refuseHostAccess(CommandContext& ctx) {
+    if (ctx.hostAccess) {
+        return false;
+    }
+    ctx.fs.output() << ctx.name << ": host file access is turned off\n";
+    return true;
+}
+
+// prints the missing argument message in the style of the current mode
+inline void printMissingArgument(CommandContext& ctx) {
+    if (ctx.style == STYLE_INTUITIVE) {
+        ctx.fs.output() << "Usage: " << ctx.name << " [name]\n";
+    } else {
+        ctx.fs.output() << ctx.name << ": missing operand\n";
+    }
+}
+
+// ls alone lists in creation order; any option gives a sorted page:
+// ls [--sort name|size|mtime] [-r] [--limit n] [--after token] [path]
+inline CommandResult handleList(CommandContext& ctx) {
+    if (ctx.argument == "") {
+        ctx.fs.listDirectory();
+        return CONTINUE;
+    }
+    istringstream in(ctx.argument);
+    ListOrder order = LIST_BY_NAME;
+    bool descending = false;
+    size_t limit = 0;
+    string after;
+    string path;
+    string word;
+    bool valid = true;
+    while (valid && in >> word) {
+        string value;
+        if (word == "-r") {
+            descending = true;
+        } else if ((word == "--sort" || word == "--limit" || word == "--after") && in >> value) {
+            if (word == "--sort" && (value == "name" || value == "size" || value == "mtime")) {
+                order = value == "name" ? LIST_BY_NAME : value == "size" ? LIST_BY_SIZE : LIST_BY_MODIFIED;
+            } else if (word == "--limit" && value.find_first_not_of("0123456789") == string::npos) {
+                limit = strtoull(value.c_str(), nullptr, 10);
+            } else if (word == "--after") {
+                after = value;
+            } else {
+                valid = false;
+            }
+        } else if (word[0] != '-' && path == "") {
+            path = word;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        ctx.fs.output() << "Usage: ls [--sort name|size|mtime] [-r] [--limit n] [--after token] [path]\n";
+        return CONTINUE;
+    }
+    ctx.fs.listSorted(path, order, descending, limit, after);
+    return CONTINUE;
+}
+
+inline CommandResult handleMkdir(CommandContext& ctx) {
+    ctx.fs.createDirectory(ctx.argument);
+    return CONTINUE;
+}
+
+inline CommandResult handleCd(CommandContext& ctx) {
+    ctx.fs.changeDirectory(ctx.argument);
+    return CONTINUE;
+}
+
+inline CommandResult handleTouch(CommandContext& ctx) {
+    ctx.fs.createFile(ctx.argument);
+    return CONTINUE;
+}
+
+inline CommandResult handleCat(CommandContext& ctx) {
+    ctx.fs.readFile(ctx.argument);
+    return CONTINUE;
+}
+
+inline CommandResult handleNano(CommandContext& ctx) {
+    if (ctx.interactive) {
+        ctx.fs.output() << "Enter content (type 'END' on new line to finish):\n";
+    }
+    ctx.fs.writeFile(ctx.argument, readContent(ctx.in));
+    return CONTINUE;
+}
+
+inline CommandResult handleRm(CommandContext& ctx) {
+    ctx.fs.deleteFile(ctx.argument);
+    return CONTINUE;
+}
+
+// find <name>                       files whose name contains name
+// find [path] -size +10M -mmin -60   predicate query, see FileQuery.h
+inline CommandResult handleFind(CommandContext& ctx) {
+    const string& arg = ctx.argument;
+    if (arg[0] == '-' || arg[0] == '/' || arg == "." || arg.compare(0, 2, "./") == 0 ||
+        arg.find(" -") != string::npos) {
+        ctx.fs.findFiles(parseFindArguments(arg));
+    } else {
+        ctx.fs.searchFile(arg);
+    }
+    return CONTINUE;
+}
+
+// glob <pattern>    *.log, data-??.csv, /logs/**/*.txt
+inline CommandResult handleGlob(CommandContext& ctx) {
+    ctx.fs.searchPattern(ctx.argument, PATTERN_GLOB);
+    return CONTINUE;
+}
+
+// regex <pattern>   ^report-\d+\.csv$, error|warn
+inline CommandResult handleRegex(CommandContext& ctx) {
+    ctx.fs.searchPattern(ctx.argument, PATTERN_REGEX);
+    return CONTINUE;
+}
+
+inline CommandResult handleStat(CommandContext& ctx) {
+    ctx.fs.fileInfo(ctx.argument);
+    return CONTINUE;
+}
+
+inline CommandResult handlePwd(CommandContext& ctx) {
+    ctx.fs.output() << ctx.fs.getCurrentPath() << "\n";
+    return CONTINUE;
+}
+
+inline CommandResult handleInfo(CommandContext& ctx) {
+    ctx.fs.displayStats();
+    return CONTINUE;
+}
+
+inline CommandResult handleUndo(CommandContext& ctx) {
+    ctx.fs.undo();
+    return CONTINUE;
+}
+
+inline CommandResult handleRedo(CommandContext& ctx) {
+    ctx.fs.redo();
+    return CONTINUE;
+}
+
+// metrics                 table of calls, errors and latency per operation
+// metrics dump <file>     write them in Prometheus text format
+// metrics reset           start counting from zero
+// metrics sample <n>      time 1 in n calls
+inline CommandResult handleMetrics(CommandContext& ctx) {
+    string action = ctx.argument;
+    string value = "";
+    size_t spacePos = action.find(' ');
+    if (spacePos != string::npos) {
+        value = action.substr(spacePos + 1);
+        action = action.substr(0, spacePos);
+    }
+
+    if (action == "") {
+        printMetrics(ctx.fs.output());
+    } else if (action == "dump" && value != "") {
+        if (refuseHostAccess(ctx)) {
+            return CONTINUE;
+        }
+        ofstream file(value);
+        if (!file) {
+            ctx.fs.output() << "Cannot write " << value << "\n";
+            return CONTINUE;
+        }
+        writePrometheus(file);
+        ctx.fs.output() << "Metrics written to " << value << "\n";
+    } else if (action == "reset") {
+        metricsRegistry().reset();
+        ctx.fs.output() << "Metrics reset\n";
+    } else if (action == "sample" && atoi(value.c_str()) > 0) {
+        metricsRegistry().setSampleEvery(atoi(value.c_str()));
+        ctx.fs.output() << "Timing 1 in " << metricsRegistry().getSampleEvery() << " calls\n";
+    } else {
+        ctx.fs.output() << "Usage: metrics [dump <file> | reset | sample <n>]\n";
+    }
+    return CONTINUE;
+}
+
+inline CommandResult handleMemstats(CommandContext& ctx) {
+    ctx.fs.displayMemory(ctx.argument);
+    return CONTINUE;
+}
+
+// trace on | off           start or stop recording trace events
+// trace dump <file>        write them as Chrome trace JSON
+// trace clear              drop everything recorded so far
+inline CommandResult handleTrace(CommandContext& ctx) {
+    string action = ctx.argument;
+    string value = "";
+    size_t spacePos = action.find(' ');
+    if (spacePos != string::npos) {
+        value = action.substr(spacePos + 1);
+        action = action.substr(0, spacePos);
+    }
+
+    if (action == "on" || action == "off") {
+        setTracing(action == "on");
+        ctx.fs.output() << "Tracing " << action << "\n";
+    } else if (action == "dump" && value != "") {
+        if (refuseHostAccess(ctx)) {
+            return CONTINUE;
+        }
+        ofstream file(value);
+        if (!file) {
+            ctx.fs.output() << "Cannot write " << value << "\n";
+            return CONTINUE;
+        }
+        size_t events = traceRegistry().dump(file);
+        ctx.fs.output() << events << " events written to " << value << "\n";
+    } else if (action == "clear") {
+        traceRegistry().clear();
+        ctx.fs.output() << "Trace cleared\n";
+    } else {
+        ctx.fs.output() << "Usage: trace on | off | dump <file> | clear\n";
+    }
+    return CONTINUE;
+}
+
+inline CommandResult handleCompact(CommandContext& ctx) {
+    ctx.fs.compact();
+    return CONTINUE;
+}
+
+// grep <text> [path]   or   grep "text with spaces" [path]
+inline CommandResult handleGrep(CommandContext& ctx) {
+    string pattern;
+    string path;
+    const string& arg = ctx.argument;
+    if (arg[0] == '"' && arg.find('"', 1) != string::npos) {
+        size_t close = arg.find('"', 1);
+        pattern = arg.substr(1, close - 1);
+        path = close + 2 < arg.length() ? arg.substr(close + 2) : "";
+    } else {
+        size_t spacePos = arg.find(' ');
+        pattern = arg.substr(0, spacePos);
+        path = spacePos == string::npos ? "" : arg.substr(spacePos + 1);
+    }
+    ctx.fs.grep(pattern, path);
+    return CONTINUE;
+}
+
+// index [text] on | off    full-text index of file contents
+// index attrs on | off     ordered size and mtime indexes
+inline CommandResult handleIndex(CommandContext& ctx) {
+    string which = "text";
+    string action = ctx.argument;
+    size_t spacePos = action.find(' ');
+    if (spacePos != string::npos) {
+        which = action.substr(0, spacePos);
+        action = action.substr(spacePos + 1);
+    }
+
+    if ((action == "on" || action == "off") && which == "text") {
+        ctx.fs.setTextIndex(action == "on");
+    } else if ((action == "on" || action == "off") && which == "attrs") {
+        ctx.fs.setAttributeIndex(action == "on");
+    } else {
+        ctx.fs.output() << "Usage: index [text | attrs] on | off\n";
+    }
+    return CONTINUE;
+}
+
+inline CommandResult handleSearch(CommandContext& ctx) {
+    ctx.fs.searchText(ctx.argument);
+    return CONTINUE;
+}
+
+// top size | mtime [n] [path]    the n (default 10) largest or newest files
+inline CommandResult handleTop(CommandContext& ctx) {
+    istringstream in(ctx.argument);
+    string order;
+    string count;
+    string path;
+    in >> order >> count >> path;
+    if (count != "" && (count[0] < '0' || count[0] > '9')) {
+        path = count;   // top size /logs
+        count = "";
+    }
+    if (order == "size" || order == "mtime") {
+        ctx.fs.topFiles(order == "size" ? BY_SIZE : BY_MODIFIED, count == "" ? 10 : atoi(count.c_str()), path);
+    } else {
+        ctx.fs.output() << "Usage: top size | mtime [n] [path]\n";
+    }
+    return CONTINUE;
+}
+
+// import hostdir [path]    copies a folder from the real disk in
+inline CommandResult handleImport(CommandContext& ctx) {
+    size_t spacePos = ctx.argument.find(' ');
+    string hostDir = ctx.argument.substr(0, spacePos);
+    string path = spacePos == string::npos ? "" : ctx.argument.substr(spacePos + 1);
+    ctx.fs.importHost(hostDir, path);
+    return CONTINUE;
+}
+
+// export hostdir [path]     writes a folder out to the real disk
+// export file.tar [path]    or into one tar archive
+inline CommandResult handleExport(CommandContext& ctx) {
+    size_t spacePos = ctx.argument.find(' ');
+    string target = ctx.argument.substr(0, spacePos);
+    string path = spacePos == string::npos ? "" : ctx.argument.substr(spacePos + 1);
+    if (target.length() > 4 && target.compare(target.length() - 4, 4, ".tar") == 0) {
+        ctx.fs.exportTar(target, path);
+    } else {
+        ctx.fs.exportHost(target, path);
+    }
+    return CONTINUE;
+}
+
+inline CommandResult handleHelp(CommandContext& ctx) {
+    if (ctx.style == STYLE_INTUITIVE) {
+        ctx.fs.output() << "Commands: list, createfolder, openfolder, createfile, editfile, view, delete,\n";
+        ctx.fs.output() << "          findfile, glob, regex, searchtext, details, where, report, memstats,\n";
+        ctx.fs.output() << "          undo, redo, compact, index, search, top, import, export, metrics, trace\n";
+    } else {
+        ctx.fs.output() << "Commands: ls, mkdir, cd, touch, cat, nano, rm, find, glob, regex, grep, stat, pwd, info, du,\n";
+        ctx.fs.output() << "          undo, redo, compact, index, search, top, import, export, metrics, trace\n";
+    }
+    ctx.fs.output() << "Use 'mode' to switch modes, 'exit' to quit\n\n";
+    return CONTINUE;
+}
+
+inline CommandResult handleMode(CommandContext&) {
+    return SWITCH_MODE;
+}
+
+inline CommandResult handleExit(CommandContext&) {
+    return EXIT_PROGRAM;
+}
+
+struct CommandInfo {
+    CommandResult (*handler)(CommandContext&);
+    bool needsArgument;
+    bool hostAccess;    // reads or writes the real disk, refused without ctx.hostAccess
+};
+
+// handler table indexed by CommandId
+// metrics and trace only reach the disk through dump, which checks
+// ctx.hostAccess itself
+const CommandInfo commandTable[] = {
+    {handleList, false, false},     // CMD_LIST
+    {handleMkdir, true, false},     // CMD_MKDIR
+    {handleCd, true, false},        // CMD_CD
+    {handleTouch, true, false},     // CMD_TOUCH
+    {handleCat, true, false},       // CMD_CAT
+    {handleNano, true, false},      // CMD_NANO
+    {handleRm, true, false},        // CMD_RM
+    {handleFind, true, false},      // CMD_FIND
+    {handleGlob, true, false},      // CMD_GLOB
+    {handleRegex, true, false},     // CMD_REGEX
+    {handleStat, true, false},      // CMD_STAT
+    {handlePwd, false, false},      // CMD_PWD
+    {handleInfo, false, false},     // CMD_INFO
+    {handleUndo, false, false},     // CMD_UNDO
+    {handleRedo, false, false},     // CMD_REDO
+    {handleMetrics, false, false},  // CMD_METRICS
+    {handleMemstats, false, false}, // CMD_MEMSTATS
+    {handleTrace, false, false},    // CMD_TRACE
+    {handleCompact, false, false},  // CMD_COMPACT
+    {handleGrep, true, false},      // CMD_GREP
+    {handleIndex, true, false},     // CMD_INDEX
+    {handleSearch, true, false},    // CMD_SEARCH
+    {handleTop, true, false},       // CMD_TOP
+    {handleImport, true, true},     // CMD_IMPORT
+    {handleExport, true, true},     // CMD_EXPORT
+    {handleHelp, false, false},     // CMD_HELP
+    {handleMode, false, false},     // CMD_MODE
+    {handleExit, false, false},     // CMD_EXIT
+};
+
+static_assert(sizeof(commandTable) / sizeof(commandTable[0]) == CMD_UNKNOWN,
+              "commandTable needs one entry per CommandId");
+
+// splits "cmd arg with spaces" into ctx.name and ctx.argument
+inline void splitCommand(const string& input, CommandContext& ctx) {
+    size_t spacePos = input.find(' ');
+    if (spacePos == string::npos) {
+        ctx.name = input;
+        ctx.argument = "";
+    } else {
+        ctx.name = input.substr(0, spacePos);
+        ctx.argument = input.substr(spacePos + 1);
+    }
+}
+
+// runs an already looked-up command, errors are printed not thrown
+inline CommandResult runCommand(CommandId id, CommandContext& ctx) {
+    if (id == CMD_UNKNOWN) {
+        if (ctx.style == STYLE_INTUITIVE) {
+            ctx.fs.output() << "Unknown command. Type 'mode' to switch, 'exit' to quit.\n";
+        } else {
+            ctx.fs.output() << "Command not found: " << ctx.name << "\n";
+        }
+        return CONTINUE;
+    }
+
+    const CommandInfo& info = commandTable[id];
+    if (info.needsArgument && ctx.argument == "") {
+        printMissingArgument(ctx);
+        return CONTINUE;
+    }
+    if (info.hostAccess && refuseHostAccess(ctx)) {
+        return CONTINUE;
+    }
+
+    try {
+        return info.handler(ctx);
+    }
+    catch (exception& e) {
+        ctx.fs.output() << "Error: " << e.what() << "\n";
+    }
+    return CONTINUE;
+}
+
+// parses and runs one command line
+inline CommandResult runCommandLine(const string& input, CommandContext& ctx) {
+    splitCommand(input, ctx);
+    return runCommand(lookupCommand(ctx.name), ctx);
+}
+
+#endif
@@ -0,0 +1,137 @@
+// DirEntries.h - iterating a folder's children without copying them
+//
+// DirEntries<Node> is a range over one folder's children in creation
+// order. dereferencing gives a DirEntryView, which is only a pointer to
+// the child node: name() is a string_view into the node, and nothing is
+// copied or allocated while iterating.
+//
+//   for (auto entry : fs.entries("/logs")) {
+//       if (!entry.isDirectory()) total += entry.size();
+//   }
+//
+// the iterators are forward iterators with the typedefs and operators
+// std algorithms and C++20 ranges expect. like vector iterators they are
+// invalidated when the folder gains or loses a child.
+
+#ifndef DIRENTRIES_H
+#define DIRENTRIES_H
+
+#include <vector>
+#include <string_view>
+#include <iterator>
+#include <cstddef>
+#include <ctime>
+
+using namespace std;
+
+template <typename Node>
+class DirEntryView {
+private:
+    const Node* node;
+
+public:
+    DirEntryView(const Node* n = nullptr) {
+        node = n;
+    }
+
+    string_view name() const {
+        return node->name;
+    }
+
+    bool isDirectory() const {
+        return node->isDirectory;
+    }
+
+    // content bytes, 0 for folders
+    size_t size() const {
+        return node->content.length();
+    }
+
+    time_t created() const {
+        return node->createdTime;
+    }
+
+    time_t modified() const {
+        return node->modifiedTime;
+    }
+
+    // the content itself, also a view
+    string_view content() const {
+        return node->content;
+    }
+};
+
+template <typename Node>
+class DirEntries {
+private:
+    typedef typename vector<Node*>::const_iterator Position;
+
+    Position first;
+    Position last;
+
+public:
+    class iterator {
+    private:
+        Position at;
+
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef forward_iterator_tag iterator_concept;
+        typedef DirEntryView<Node> value_type;
+        typedef ptrdiff_t difference_type;
+        typedef DirEntryView<Node> reference;   // views are made on the fly
+        typedef void pointer;
+
+        iterator() {}
+
+        explicit iterator(Position p) {
+            at = p;
+        }
+
+        DirEntryView<Node> operator*() const {
+            return DirEntryView<Node>(*at);
+        }
+
+        iterator& operator++() {
+            ++at;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator before = *this;
+            ++at;
+            return before;
+        }
+
+        bool operator==(const iterator& other) const {
+            return at == other.at;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return at != other.at;
+        }
+    };
+
+    explicit DirEntries(const vector<Node*>& children) {
+        first = children.begin();
+        last = children.end();
+    }
+
+    iterator begin() const {
+        return iterator(first);
+    }
+
+    iterator end() const {
+        return iterator(last);
+    }
+
+    size_t size() const {
+        return last - first;
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+};
+
+#endif
@@ -0,0 +1,415 @@
+// FileQuery.h - find-style predicate queries over file metadata
+//
+// a FileQuery is a set of ranges (size, created, modified, depth), a type
+// and an optional name pattern; a node matches when it is inside all of
+// them. parseFindArguments reads the familiar find syntax:
+//
+//   find [path] [-type f|d] [-size +10M|-4k|512] [-mmin -60] [-cmin +5]
+//        [-mtime -1] [-mindepth n] [-maxdepth n] [-name glob] [-regex re]
+//        [-limit n] [-offset n] [-after token]
+//
+// +n means more than n, -n less than n, a bare n exactly n. -mmin/-cmin
+// count minutes ago, -mtime days ago, so -mmin -60 is "in the last hour".
+// -limit, -offset and -after page through the matches in tree order; each
+// page ends with the token to pass to -after for the next one.
+//
+// folders can carry a SubtreeSummary: ranges covering everything below
+// them. a query that cannot overlap those ranges skips the whole folder.
+
+#ifndef FILEQUERY_H
+#define FILEQUERY_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <ctime>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+#include "NamePattern.h"
+
+using namespace std;
+
+class InvalidQueryException : public runtime_error {
+public:
+    InvalidQueryException(string msg)
+        : runtime_error("Invalid query: " + msg) {}
+};
+
+enum QueryType { QUERY_ANY, QUERY_FILES, QUERY_DIRS };
+
+struct FileQuery {
+    string path;                  // where to start, "" for the current folder
+    QueryType type;
+    uint64_t minSize;             // all ranges are inclusive
+    uint64_t maxSize;
+    time_t createdAfter;
+    time_t createdBefore;
+    time_t modifiedAfter;
+    time_t modifiedBefore;
+    int minDepth;                 // the start folder is depth 0
+    int maxDepth;
+    string namePattern;           // "" for any name
+    PatternKind nameKind;
+    size_t limit;                 // paging: at most this many matches, 0 for all
+    size_t offset;                // paging: matches to skip first
+    string after;                 // paging: resume after this SearchCursor token
+
+    FileQuery() {
+        path = "";
+        type = QUERY_ANY;
+        minSize = 0;
+        maxSize = UINT64_MAX;
+        createdAfter = 0;
+        createdBefore = LLONG_MAX;
+        modifiedAfter = 0;
+        modifiedBefore = LLONG_MAX;
+        minDepth = 0;
+        maxDepth = INT_MAX;
+        namePattern = "";
+        nameKind = PATTERN_GLOB;
+        limit = 0;
+        offset = 0;
+        after = "";
+    }
+
+    bool isPaged() const {
+        return limit > 0 || offset > 0 || after != "";
+    }
+
+    // true when size or time is narrowed, what subtree summaries can prune on
+    bool hasMetadataRange() const {
+        return minSize > 0 || maxSize < UINT64_MAX || createdAfter > 0 || createdBefore < LLONG_MAX ||
+               modifiedAfter > 0 || modifiedBefore < LLONG_MAX;
+    }
+
+    // every predicate except the name and depth
+    bool matchesMetadata(bool isDirectory, uint64_t size, time_t created, time_t modified) const {
+        if ((type == QUERY_FILES && isDirectory) || (type == QUERY_DIRS && !isDirectory)) {
+            return false;
+        }
+        return size >= minSize && size <= maxSize && created >= createdAfter && created <= createdBefore &&
+               modified >= modifiedAfter && modified <= modifiedBefore;
+    }
+};
+
+// ranges over everything below a folder (the folder itself not included)
+// valid is cleared when anything below changes, and the summary is
+// worked out again the next time a query walks the folder
+struct SubtreeSummary {
+    bool valid;
+    uint32_t files;
+    uint32_t dirs;
+    uint32_t height;              // levels below the folder, 0 when empty
+    uint64_t minSize;             // over files only, folders are always 0
+    uint64_t maxSize;
+    time_t minCreated;
+    time_t maxCreated;
+    time_t minModified;
+    time_t maxModified;
+
+    SubtreeSummary() {
+        clear();
+    }
+
+    void clear() {
+        valid = false;
+        files = 0;
+        dirs = 0;
+        height = 0;
+        minSize = UINT64_MAX;
+        maxSize = 0;
+        minCreated = LLONG_MAX;
+        maxCreated = 0;
+        minModified = LLONG_MAX;
+        maxModified = 0;
+    }
+
+    // adds one node below the folder
+    void addNode(bool isDirectory, uint64_t size, time_t created, time_t modified, uint32_t levels) {
+        if (isDirectory) {
+            dirs++;
+        } else {
+            files++;
+            minSize = min(minSize, size);
+            maxSize = max(maxSize, size);
+        }
+        minCreated = min(minCreated, created);
+        maxCreated = max(maxCreated, created);
+        minModified = min(minModified, modified);
+        maxModified = max(maxModified, modified);
+        height = max(height, levels);
+    }
+
+    // adds a child folder's own summary, levels is its distance below
+    void addSummary(const SubtreeSummary& below, uint32_t levels) {
+        if (below.files + below.dirs == 0) {
+            return;
+        }
+        files += below.files;
+        dirs += below.dirs;
+        minSize = min(minSize, below.minSize);
+        maxSize = max(maxSize, below.maxSize);
+        minCreated = min(minCreated, below.minCreated);
+        maxCreated = max(maxCreated, below.maxCreated);
+        minModified = min(minModified, below.minModified);
+        maxModified = max(maxModified, below.maxModified);
+        height = max(height, levels + below.height);
+    }
+
+    // false when no node below a folder at depth can match the query
+    bool mayContainMatch(const FileQuery& query, int depth) const {
+        if (files + dirs == 0 || depth + (int)height < query.minDepth || depth >= query.maxDepth) {
+            return false;
+        }
+        if (maxCreated < query.createdAfter || minCreated > query.createdBefore ||
+            maxModified < query.modifiedAfter || minModified > query.modifiedBefore) {
+            return false;
+        }
+        bool fileMayMatch = files > 0 && query.type != QUERY_DIRS && maxSize >= query.minSize && minSize <= query.maxSize;
+        bool dirMayMatch = dirs > 0 && query.type != QUERY_FILES && query.minSize == 0;
+        return fileMayMatch || dirMayMatch;
+    }
+};
+
+// how a query reaches its candidates, picked by FileSystem::planQuery
+enum QueryAccess {
+    ACCESS_TREE_WALK,     // walk the tree, skip folders by their SubtreeSummary
+    ACCESS_TABLE_SCAN,    // stream the node table rows of the start folder
+    ACCESS_NAME_INDEX,    // vectorized scan of the packed names for the pattern's fixed part
+    ACCESS_SIZE_INDEX,    // range scan of the ordered size index
+    ACCESS_MODIFIED_INDEX // range scan of the ordered mtime index
+};
+
+struct QueryPlan {
+    QueryAccess access;
+    string description;
+};
+
+// a name inside a cursor token, percent-escaped so the token is one word
+// with no '/' or ':' of its own
+inline string escapeTokenName(const string& name) {
+    string text;
+    for (size_t c = 0; c < name.length(); c++) {
+        unsigned char b = name[c];
+        if (isalnum(b) || b == '.' || b == '_' || b == '-') {
+            text += (char)b;
+        } else {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X", b);
+            text += escaped;
+        }
+    }
+    return text;
+}
+
+inline string unescapeTokenName(const string& text) {
+    string name;
+    for (size_t c = 0; c < text.length(); c++) {
+        if (text[c] == '%' && c + 2 < text.length()) {
+            name += (char)strtol(text.substr(c + 1, 2).c_str(), nullptr, 16);
+            c += 2;
+        } else {
+            name += text[c];
+        }
+    }
+    return name;
+}
+
+// where a paged search stopped: the last match reported, as the child
+// index and the name at each level below the start folder. the names find
+// the spot again after other changes, the index is the fallback when the
+// node itself has been deleted. an empty cursor is the start folder itself
+struct SearchCursor {
+    vector<size_t> indexes;
+    vector<string> names;
+
+    // "4.0.15:a/b%20c/x.log", names percent-escaped so the token is one word
+    string token() const {
+        string text;
+        for (size_t i = 0; i < indexes.size(); i++) {
+            text += (i > 0 ? "." : "") + to_string(indexes[i]);
+        }
+        text += ':';
+        for (size_t i = 0; i < names.size(); i++) {
+            if (i > 0) {
+                text += '/';
+            }
+            text += escapeTokenName(names[i]);
+        }
+        return text;
+    }
+
+    static SearchCursor parse(const string& token) {
+        SearchCursor cursor;
+        size_t colon = token.find(':');
+        if (colon == string::npos) {
+            throw InvalidQueryException("bad cursor '" + token + "'");
+        }
+        string indexText = token.substr(0, colon);
+        string nameText = token.substr(colon + 1);
+        if (indexText != "") {
+            istringstream in(indexText);
+            string part;
+            while (getline(in, part, '.')) {
+                if (part == "" || part.find_first_not_of("0123456789") != string::npos) {
+                    throw InvalidQueryException("bad cursor '" + token + "'");
+                }
+                cursor.indexes.push_back(strtoull(part.c_str(), nullptr, 10));
+            }
+        }
+        if (nameText != "") {
+            size_t from = 0;
+            for (size_t c = 0; c <= nameText.length(); c++) {
+                if (c == nameText.length() || nameText[c] == '/') {
+                    cursor.names.push_back(unescapeTokenName(nameText.substr(from, c - from)));
+                    from = c + 1;
+                }
+            }
+        }
+        if (cursor.names.size() != cursor.indexes.size()) {
+            throw InvalidQueryException("bad cursor '" + token + "'");
+        }
+        return cursor;
+    }
+};
+
+// one page of a paged search
+struct SearchPage {
+    vector<string> paths;
+    string next;          // token for the following page, "" when this was the last
+};
+
+// 10M -> 10485760, suffixes k, M and G (powers of 1024), none for bytes
+inline uint64_t parseSizeValue(const string& text) {
+    char* end = nullptr;
+    uint64_t value = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        throw InvalidQueryException("bad size '" + text + "'");
+    }
+    string unit = end;
+    if (unit == "k" || unit == "K") {
+        value *= 1024;
+    } else if (unit == "M") {
+        value *= 1024 * 1024;
+    } else if (unit == "G") {
+        value *= 1024ull * 1024 * 1024;
+    } else if (unit != "" && unit != "c") {
+        throw InvalidQueryException("bad size unit '" + unit + "'");
+    }
+    return value;
+}
+
+// splits "+n" / "-n" / "n" into a sign (+1, -1 or 0) and the rest
+inline int splitSign(string& value) {
+    if (value.length() > 0 && (value[0] == '+' || value[0] == '-')) {
+        int sign = value[0] == '+' ? 1 : -1;
+        value = value.substr(1);
+        return sign;
+    }
+    return 0;
+}
+
+// "-mmin -60" style age in seconds ago, turned into a time range
+inline void parseAge(string value, time_t unit, time_t now, time_t& after, time_t& before) {
+    int sign = splitSign(value);
+    char* end = nullptr;
+    long long amount = strtoll(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0') {
+        throw InvalidQueryException("bad age '" + value + "'");
+    }
+    time_t at = now - amount * unit;
+    if (sign < 0) {
+        after = max(after, at);               // newer than
+    } else if (sign > 0) {
+        before = min(before, at);             // older than
+    } else {
+        after = max(after, at - unit + 1);    // within that unit
+        before = min(before, at);
+    }
+}
+
+// reads find-style arguments, see the top of the file
+inline FileQuery parseFindArguments(const string& arguments, time_t now = time(0)) {
+    FileQuery query;
+    vector<string> words;
+    istringstream in(arguments);
+    string word;
+    while (in >> word) {
+        words.push_back(word);
+    }
+
+    size_t i = 0;
+    if (i < words.size() && words[i][0] != '-') {
+        query.path = words[i++];
+    }
+    while (i < words.size()) {
+        string option = words[i++];
+        if (i >= words.size()) {
+            throw InvalidQueryException(option + " needs a value");
+        }
+        string value = words[i++];
+
+        if (option == "-type") {
+            if (value != "f" && value != "d") {
+                throw InvalidQueryException("-type takes f or d");
+            }
+            query.type = value == "f" ? QUERY_FILES : QUERY_DIRS;
+        } else if (option == "-size") {
+            int sign = splitSign(value);
+            uint64_t size = parseSizeValue(value);
+            if (sign > 0) {
+                query.minSize = max(query.minSize, size + 1);
+            } else if (sign < 0) {
+                if (size == 0) {
+                    throw InvalidQueryException("-size -0 can never match");
+                }
+                query.maxSize = min(query.maxSize, size - 1);
+            } else {
+                query.minSize = max(query.minSize, size);
+                query.maxSize = min(query.maxSize, size);
+            }
+        } else if (option == "-mmin" || option == "-mtime") {
+            parseAge(value, option == "-mmin" ? 60 : 86400, now, query.modifiedAfter, query.modifiedBefore);
+        } else if (option == "-cmin" || option == "-ctime") {
+            parseAge(value, option == "-cmin" ? 60 : 86400, now, query.createdAfter, query.createdBefore);
+        } else if (option == "-mindepth" || option == "-maxdepth") {
+            char* end = nullptr;
+            long depth = strtol(value.c_str(), &end, 10);
+            if (end == value.c_str() || *end != '\0' || depth < 0) {
+                throw InvalidQueryException(option + " takes a number");
+            }
+            if (option == "-mindepth") {
+                query.minDepth = depth;
+            } else {
+                query.maxDepth = depth;
+            }
+        } else if (option == "-limit" || option == "-offset") {
+            char* end = nullptr;
+            unsigned long long count = strtoull(value.c_str(), &end, 10);
+            if (end == value.c_str() || *end != '\0' || value[0] == '-') {
+                throw InvalidQueryException(option + " takes a number");
+            }
+            if (option == "-limit") {
+                query.limit = count;
+            } else {
+                query.offset = count;
+            }
+        } else if (option == "-after") {
+            SearchCursor::parse(value);   // reject a bad token up front
+            query.after = value;
+        } else if (option == "-name" || option == "-regex") {
+            query.namePattern = value;
+            query.nameKind = option == "-name" ? PATTERN_GLOB : PATTERN_REGEX;
+        } else {
+            throw InvalidQueryException("unknown option " + option);
+        }
+    }
+    return query;
+}
+
+#endif
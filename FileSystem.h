@@ -9,6 +9,25 @@
 #include <ctime>
 #include <stdexcept>
 #include <unordered_map>
+#include <deque>
+#include <algorithm>
+#include <string_view>
+#include <memory>
+#include "Metrics.h"
+#include "TreeWalk.h"
+#include "NodeTable.h"
+#include "Grep.h"
+#include "FullTextIndex.h"
+#include "NamePattern.h"
+#include "FileQuery.h"
+#include "AttributeIndex.h"
+#include "SortedChildren.h"
+#include "DirEntries.h"
+#include "NodeArena.h"
+#include "HostTree.h"
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
 using namespace std;
 
@@ -43,43 +62,133 @@ public:
         : runtime_error("Invalid name: " + msg) {}
 };
 
+class NothingToUndoException : public runtime_error {
+public:
+    NothingToUndoException(string action)
+        : runtime_error("Nothing to " + action) {}
+};
+
+// heap bytes held by a set of nodes, split by what they are used for
+struct MemoryUsage {
+    size_t nodes;
+    size_t nodeHeaders;    // the FileNode objects themselves
+    size_t names;          // name strings that outgrew the inline buffer
+    size_t childVectors;   // children arrays
+    size_t childIndexes;   // childIndex buckets, hash nodes and their key strings
+    size_t content;        // file content strings
+
+    MemoryUsage() {
+        nodes = 0;
+        nodeHeaders = 0;
+        names = 0;
+        childVectors = 0;
+        childIndexes = 0;
+        content = 0;
+    }
+
+    size_t total() const {
+        return nodeHeaders + names + childVectors + childIndexes + content;
+    }
+
+    void add(const MemoryUsage& other) {
+        nodes += other.nodes;
+        nodeHeaders += other.nodeHeaders;
+        names += other.names;
+        childVectors += other.childVectors;
+        childIndexes += other.childIndexes;
+        content += other.content;
+    }
+
+    // heap bytes behind a string, 0 while it fits in the inline buffer
+    static size_t stringHeap(const string& s) {
+        static const size_t inlineCapacity = string().capacity();
+        return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+    }
+};
+
 // represents a single file or folder in the tree
 struct FileNode {
     string name;
     bool isDirectory;
+    bool inArena;   // made by bulkLoad in a NodeArena slot, never deleted on its own
     string content;
     time_t createdTime;
     time_t modifiedTime;
     FileNode* parent;
     vector<FileNode*> children;
     unordered_map<string, FileNode*> childIndex;  // O(1) lookup by name
+    SubtreeSummary* summary;   // folders only, made by the first query that walks them
+    SortedChildren<FileNode>* sorted;   // folders only, made by the first sorted listing
 
-    FileNode(string n, bool isDir, FileNode* p = nullptr) {
-        name = n;
+    FileNode(string n, bool isDir, FileNode* p = nullptr) : FileNode(move(n), isDir, p, time(0)) {}
+
+    FileNode(string n, bool isDir, FileNode* p, time_t now) {
+        name = move(n);
         isDirectory = isDir;
+        inArena = false;
         content = "";
         parent = p;
-        createdTime = time(0);
-        modifiedTime = time(0);
+        summary = nullptr;
+        sorted = nullptr;
+        createdTime = now;
+        modifiedTime = now;
+    }
+
+    // frees one node and its subtree, however it was allocated
+    static void destroy(FileNode* node) {
+        if (node->inArena) {
+            node->~FileNode();
+        } else {
+            delete node;
+        }
     }
 
+    // frees the whole subtree bottom-up with walkTree instead of recursion,
+    // so a very deep chain can't overflow the call stack
     ~FileNode() {
-        for (int i = 0; i < children.size(); i++) {
-            delete children[i];
+        delete summary;
+        delete sorted;
+        if (children.size() == 0) {
+            return;
         }
+        struct Deleter : TreeVisitor {
+            FileNode* top;
+            void leave(FileNode* node, int) {
+                if (node != top) {
+                    node->children.clear();   // already freed, don't walk them again
+                    destroy(node);
+                }
+            }
+        };
+        Deleter deleter;
+        deleter.top = this;
+        walkTree(this, deleter);
     }
 
     // adds a child and updates the hash map index
     void addChild(FileNode* child) {
         children.push_back(child);
         childIndex[child->name] = child;
+        if (sorted != nullptr) {
+            sorted->add(child);
+        }
     }
 
     // removes a child and updates the hash map index
+    // the index gives us the node, so the scan only compares pointers (no
+    // string compares touching every child) and starts from the newest child
     void removeChild(string name) {
-        childIndex.erase(name);
-        for (int i = 0; i < children.size(); i++) {
-            if (children[i]->name == name) {
+        auto found = childIndex.find(name);
+        if (found == childIndex.end()) {
+            return;
+        }
+        FileNode* child = found->second;
+        if (sorted != nullptr) {
+            sorted->remove(child);
+        }
+        childIndex.erase(found);
+        for (int i = children.size() - 1; i >= 0; i--) {
+            if (children[i] == child) {
                 children.erase(children.begin() + i);
                 break;
             }
@@ -98,13 +207,122 @@ struct FileNode {
     bool hasChild(string name) {
         return childIndex.find(name) != childIndex.end();
     }
+
+    // adds this node's own heap bytes (not its children's) to usage
+    // the hash node size matches libstdc++: next pointer, key/value pair, cached hash
+    void addMemoryUsed(MemoryUsage& usage) {
+        usage.nodes++;
+        usage.nodeHeaders += sizeof(FileNode);
+        if (summary != nullptr) {
+            usage.nodeHeaders += sizeof(SubtreeSummary);
+        }
+        usage.names += MemoryUsage::stringHeap(name);
+        usage.content += MemoryUsage::stringHeap(content);
+        usage.childVectors += children.capacity() * sizeof(FileNode*);
+
+        // a single bucket lives inside the map, more are one heap array
+        if (childIndex.bucket_count() > 1) {
+            usage.childIndexes += childIndex.bucket_count() * sizeof(void*);
+        }
+        size_t hashNode = sizeof(void*) + sizeof(pair<const string, FileNode*>) + sizeof(size_t);
+        usage.childIndexes += childIndex.size() * hashNode;
+        for (auto& entry : childIndex) {
+            usage.childIndexes += MemoryUsage::stringHeap(entry.first);
+        }
+        if (sorted != nullptr) {
+            usage.childIndexes += sorted->memoryUsed();
+        }
+    }
 };
 
+#if __cplusplus >= 202002L
+static_assert(ranges::forward_range<DirEntries<FileNode>>, "DirEntries should work with std::ranges");
+#endif
+
+// one reversible change in the undo journal
+// the entry only keeps the bytes that are NOT currently in the tree, so
+// undo and redo swap them back and forth instead of copying whole files
+struct JournalEntry {
+    enum Kind { CREATE, DELETE, WRITE };
+
+    Kind kind;
+    string dirPath;        // folder the change happened in
+    string name;
+    bool isDirectory;
+    size_t prefixLen;      // WRITE: bytes shared at the start of old and new content
+    size_t currentLen;     // WRITE: length of the changed section now in the file
+    string saved;          // bytes swapped out of the file (whole content for CREATE/DELETE)
+    time_t savedModified;
+    time_t savedCreated;   // CREATE/DELETE: the node's creation time while it is out of the tree
+
+    JournalEntry(Kind k, string dir, string n, bool isDir) {
+        kind = k;
+        dirPath = dir;
+        name = n;
+        isDirectory = isDir;
+        prefixLen = 0;
+        currentLen = 0;
+        savedModified = 0;
+        savedCreated = 0;
+    }
+
+    // approximate heap + object bytes held by this entry
+    size_t memoryUsed() {
+        return sizeof(JournalEntry) + dirPath.capacity() + name.capacity() + saved.capacity();
+    }
+};
+
+// one path for bulkLoad, "/a/b.txt" or "a/b.txt" from root
+struct BulkEntry {
+    string path;
+    string content;     // files only, moved into the tree
+    bool isDirectory;
+    time_t modified = 0;   // 0 for the time of the load
+};
+
+// orders paths a component at a time ('/' before any other byte), so a
+// folder's whole subtree sorts right after it with nothing in between
+inline bool bulkPathLess(const string& a, const string& b) {
+    size_t n = min(a.length(), b.length());
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            if (a[i] == '/' || b[i] == '/') {
+                return a[i] == '/';
+            }
+            return (unsigned char)a[i] < (unsigned char)b[i];
+        }
+    }
+    return a.length() < b.length();
+}
+
 // manages the entire file system
 class FileSystem {
 private:
     FileNode* root;
     FileNode* currentDir;
+    ostream* out;   // where messages go, cout unless redirected
+
+    // undo/redo journal, oldest entries are dropped once over the budget
+    deque<JournalEntry> undoLog;
+    deque<JournalEntry> redoLog;
+    size_t journalBytes;
+    size_t journalLimit;
+
+    // read-only copy of the tree for fast scans, see NodeTable.h
+    // version counts changes to the tree, the table is only used while
+    // tableVersion still matches it
+    NodeTable<FileNode> table;
+    uint64_t version;
+    uint64_t tableVersion;
+
+    // slots for the nodes bulkLoad makes
+    NodeArena<FileNode> arena;
+
+    // full-text index over file contents, nullptr while turned off
+    FullTextIndex<FileNode>* textIndex;
+
+    // ordered indexes on file size and mtime, nullptr while turned off
+    AttributeIndex<FileNode>* attributeIndex;
 
     void validateName(string name) {
         if (name.length() == 0) {
@@ -119,45 +337,179 @@ public:
     FileSystem() {
         root = new FileNode("root", true);
         currentDir = root;
+        out = &cout;
+        journalBytes = 0;
+        journalLimit = 64 * 1024 * 1024;
+        version = 0;
+        tableVersion = 0;
+        textIndex = nullptr;
+        attributeIndex = nullptr;
     }
 
     ~FileSystem() {
+        delete textIndex;
+        delete attributeIndex;
         delete root;
     }
 
+    // sends all messages to another stream (a buffer, a socket reply, ...)
+    void setOutput(ostream& os) {
+        out = &os;
+    }
+
+    ostream& output() {
+        return *out;
+    }
+
     // creates a new file in the current folder
     void createFile(string fileName, string content = "") {
+        OpTimer timer(MET_CREATE_FILE);
         validateName(fileName);
 
         if (currentDir->hasChild(fileName)) {
             throw AlreadyExistsException(fileName);
         }
 
-        FileNode* newFile = new FileNode(fileName, false, currentDir);
-        newFile->content = content;
-        currentDir->addChild(newFile);
-        cout << "File '" << fileName << "' created\n";
+        FileNode* newFile;
+        {
+            TraceScope scope("allocate", "phase");
+            newFile = new FileNode(fileName, false, currentDir);
+            newFile->content = content;
+            currentDir->addChild(newFile);
+        }
+        nodeChanged(newFile);
+        if (journalLimit > 0) {
+            record(JournalEntry(JournalEntry::CREATE, currentPath(), fileName, false));
+        }
+        *out << "File '" << fileName << "' created\n";
     }
 
     // creates a new folder in the current folder
     void createDirectory(string dirName) {
+        OpTimer timer(MET_CREATE_DIR);
         validateName(dirName);
 
         if (currentDir->hasChild(dirName)) {
             throw AlreadyExistsException(dirName);
         }
 
-        FileNode* newDir = new FileNode(dirName, true, currentDir);
-        currentDir->addChild(newDir);
-        cout << "Directory '" << dirName << "' created\n";
+        FileNode* newDir;
+        {
+            TraceScope scope("allocate", "phase");
+            newDir = new FileNode(dirName, true, currentDir);
+            currentDir->addChild(newDir);
+        }
+        nodeChanged(newDir);
+        if (journalLimit > 0) {
+            record(JournalEntry(JournalEntry::CREATE, currentPath(), dirName, true));
+        }
+        *out << "Directory '" << dirName << "' created\n";
+    }
+
+    // makes many files and folders at once, far faster than a createFile
+    // or createDirectory per path: nothing is printed or journaled, child
+    // arrays and hash maps are sized once, and nodes come from one arena
+    // block. missing parent folders are made and existing folders are
+    // merged into. entries sorted by bulkPathLess are used in place, others
+    // are sorted first. every check runs before the tree is touched, so a
+    // bad name, a path below a file or a file that already exists throws
+    // with nothing loaded. the undo history is dropped, since it may no
+    // longer apply. returns how many nodes were made
+    size_t bulkLoad(vector<BulkEntry> entries) {
+        OpTimer timer(MET_BULK_LOAD);
+        return loadEntries(entries);
+    }
+
+    // copies a folder from the host's disk into the folder at path ("" for
+    // the current folder): subfolders and regular files with their
+    // contents and mtimes. the host is read by parallel workers (threads =
+    // 0 for one per hardware thread, see HostTree.h), then it all goes in
+    // with one bulkLoad, so a clash with an existing file loads nothing
+    HostTreeStats importHost(string hostDir, string path = "", int threads = 0) {
+        OpTimer timer(MET_IMPORT_HOST);
+        auto start = chrono::steady_clock::now();
+        FileNode* dir = findDirectory(path);
+        string prefix = dir == root ? "/" : pathOf(dir) + "/";
+
+        HostTreeReader reader;
+        HostTreeStats stats;
+        vector<HostEntry> found = reader.read(hostDir, threads, stats);
+        vector<BulkEntry> entries(found.size());
+        for (size_t i = 0; i < found.size(); i++) {
+            entries[i].path = prefix + found[i].path;
+            entries[i].content.swap(found[i].content);
+            entries[i].isDirectory = found[i].isDirectory;
+            entries[i].modified = found[i].modified;
+        }
+        vector<HostEntry>().swap(found);
+        double readSeconds = stats.seconds;
+        loadEntries(entries);
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        char summary[200];
+        snprintf(summary, sizeof(summary),
+                 "Imported %zu files, %zu folders (%zu skipped), %.1f MB in %.3f s (read %.3f s): %.0f files/s, "
+                 "%.1f MB/s\n",
+                 stats.files, stats.dirs, stats.skipped, stats.bytes / 1e6, stats.seconds, readSeconds,
+                 stats.filesPerSecond(), stats.megabytesPerSecond());
+        *out << summary;
+        return stats;
+    }
+
+    // writes the folder at path ("" for the current folder) and everything
+    // under it into hostDir on the real disk, made if missing. files are
+    // written by parallel workers straight from the tree, see HostTree.h
+    HostTreeStats exportHost(string hostDir, string path = "", int threads = 0) {
+        OpTimer timer(MET_EXPORT_HOST);
+        vector<HostOutEntry> entries = exportEntries(findDirectory(path));
+        HostTreeWriter writer;
+        HostTreeStats stats;
+        writer.write(hostDir, entries, threads, stats);
+        reportExport("Exported", stats, hostDir);
+        return stats;
+    }
+
+    // the same as one ustar archive (pax records where ustar runs out)
+    HostTreeStats exportTar(string tarFile, string path = "") {
+        OpTimer timer(MET_EXPORT_TAR);
+        auto start = chrono::steady_clock::now();
+        vector<HostOutEntry> entries = exportEntries(findDirectory(path));
+        int fd = open(tarFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw HostIOException("cannot create " + tarFile);
+        }
+        HostTreeStats stats = {0, 0, 0, 0, 0};
+        try {
+            TarWriter tar(fd);
+            for (size_t e = 0; e < entries.size(); e++) {
+                tar.add(entries[e]);
+                if (entries[e].isDirectory) {
+                    stats.dirs++;
+                } else {
+                    stats.files++;
+                    stats.bytes += entries[e].content.length();
+                }
+            }
+            tar.finish();
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        if (close(fd) != 0) {
+            throw HostIOException("cannot write " + tarFile);
+        }
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        reportExport("Archived", stats, tarFile);
+        return stats;
     }
 
     // changes which folder we're currently in
     void changeDirectory(string dirName) {
+        OpTimer timer(MET_CHANGE_DIR);
         if (dirName == "..") {
             if (currentDir->parent != nullptr) {
                 currentDir = currentDir->parent;
-                cout << "Changed to parent directory\n";
+                *out << "Changed to parent directory\n";
                 return;
             } else {
                 throw DirectoryNotFoundException("..");
@@ -166,14 +518,14 @@ public:
 
         if (dirName == "/") {
             currentDir = root;
-            cout << "Changed to root\n";
+            *out << "Changed to root\n";
             return;
         }
 
         FileNode* child = currentDir->getChild(dirName);
         if (child != nullptr && child->isDirectory) {
             currentDir = child;
-            cout << "Changed to directory '" << dirName << "'\n";
+            *out << "Changed to directory '" << dirName << "'\n";
             return;
         }
 
@@ -182,41 +534,106 @@ public:
 
     // shows all files and folders in current directory
     void listDirectory() {
-        cout << "\n--- Directory: " << getCurrentPath() << " ---\n";
-        cout << "[DIR]  ..\n";
-        cout << "[DIR]  .\n";
+        OpTimer timer(MET_LIST_DIR);
+        *out << "\n--- Directory: " << currentPath() << " ---\n";
+        *out << "[DIR]  ..\n";
+        *out << "[DIR]  .\n";
 
-        if (currentDir->children.size() == 0) {
-            cout << "(empty)\n";
+        DirEntries<FileNode> list(currentDir->children);
+        if (list.empty()) {
+            *out << "(empty)\n";
         } else {
-            for (int i = 0; i < currentDir->children.size(); i++) {
-                FileNode* child = currentDir->children[i];
-
-                if (child->isDirectory) {
-                    cout << "[DIR]  ";
+            for (DirEntryView<FileNode> entry : list) {
+                if (entry.isDirectory()) {
+                    *out << "[DIR]  ";
                 } else {
-                    cout << "[FILE] ";
+                    *out << "[FILE] ";
                 }
 
-                cout << child->name;
+                *out << entry.name();
 
-                if (!child->isDirectory && child->content.length() > 0) {
-                    cout << " (" << child->content.length() << " bytes)";
+                if (!entry.isDirectory() && entry.size() > 0) {
+                    *out << " (" << entry.size() << " bytes)";
                 }
-                cout << "\n";
+                *out << "\n";
             }
         }
-        cout << "\n";
+        *out << "\n";
+    }
+
+    // the children of the folder at path ("" for the current folder), in
+    // creation order, as views into the tree; see DirEntries.h
+    DirEntries<FileNode> entries(string path = "") {
+        return DirEntries<FileNode>(findDirectory(path)->children);
+    }
+
+    // one page of the folder at path ("" for the current folder) sorted by
+    // name, size or mtime, ties by name. limit 0 means the rest of the
+    // folder. after is the next token of the page before, "" to start
+    ListPage listPage(string path, ListOrder order, bool descending, size_t limit, string after) {
+        OpTimer timer(MET_LIST_PAGE);
+        return sortedPage(findDirectory(path), order, descending, limit, after);
+    }
+
+    // prints a page of a sorted listing the way listDirectory does, and the
+    // token to pass as after for the page that follows
+    void listSorted(string path, ListOrder order, bool descending, size_t limit, string after) {
+        OpTimer timer(MET_LIST_DIR);
+        FileNode* dir = findDirectory(path);
+        ListPage page = sortedPage(dir, order, descending, limit, after);
+        const char* orderNames[LIST_ORDER_COUNT] = {"name", "size", "mtime"};
+        *out << "\n--- Directory: " << pathOf(dir) << " (by " << orderNames[order] << (descending ? ", reversed" : "")
+             << ") ---\n";
+        if (page.entries.size() == 0) {
+            *out << "(empty)\n";
+        }
+        for (int i = 0; i < page.entries.size(); i++) {
+            ListEntry& entry = page.entries[i];
+            *out << (entry.isDirectory ? "[DIR]  " : "[FILE] ") << entry.name;
+            if (!entry.isDirectory && entry.size > 0) {
+                *out << " (" << entry.size << " bytes)";
+            }
+            *out << "\n";
+        }
+        if (page.next != "") {
+            *out << "more: --after " << page.next << "\n";
+        }
+        *out << "\n";
     }
 
     // writes content to an existing file
     void writeFile(string fileName, string content) {
+        OpTimer timer(MET_WRITE_FILE);
         FileNode* child = currentDir->getChild(fileName);
         if (child != nullptr && !child->isDirectory) {
-            child->content = content;
+            size_t length = content.length();
+            if (journalLimit > 0) {
+                JournalEntry entry(JournalEntry::WRITE, currentPath(), fileName, false);
+                string& old = child->content;
+
+                // only keep the section that actually changed
+                size_t shorter = min(old.length(), content.length());
+                size_t prefix = 0;
+                while (prefix < shorter && old[prefix] == content[prefix]) {
+                    prefix++;
+                }
+                size_t suffix = 0;
+                while (suffix < shorter - prefix &&
+                       old[old.length() - 1 - suffix] == content[content.length() - 1 - suffix]) {
+                    suffix++;
+                }
+                entry.prefixLen = prefix;
+                entry.currentLen = content.length() - prefix - suffix;
+                entry.saved = old.substr(prefix, old.length() - prefix - suffix);
+                entry.savedModified = child->modifiedTime;
+                record(move(entry));
+            }
+
+            child->content = move(content);
             child->modifiedTime = time(0);
-            cout << "File '" << fileName << "' written (";
-            cout << content.length() << " bytes)\n";
+            nodeChanged(child);
+            *out << "File '" << fileName << "' written (";
+            *out << length << " bytes)\n";
             return;
         }
         throw FileNotFoundException(fileName);
@@ -224,15 +641,16 @@ public:
 
     // reads and returns a file's content
     string readFile(string fileName) {
+        OpTimer timer(MET_READ_FILE);
         FileNode* child = currentDir->getChild(fileName);
         if (child != nullptr && !child->isDirectory) {
-            cout << "\n--- Content of " << fileName << " ---\n";
+            *out << "\n--- Content of " << fileName << " ---\n";
             if (child->content.length() == 0) {
-                cout << "(empty)";
+                *out << "(empty)";
             } else {
-                cout << child->content;
+                *out << child->content;
             }
-            cout << "\n\n";
+            *out << "\n\n";
             return child->content;
         }
         throw FileNotFoundException(fileName);
@@ -240,15 +658,25 @@ public:
 
     // deletes a file or empty folder
     void deleteFile(string fileName) {
+        OpTimer timer(MET_DELETE_FILE);
         FileNode* child = currentDir->getChild(fileName);
         if (child != nullptr) {
             if (child->isDirectory && child->children.size() > 0) {
                 throw DirectoryNotEmptyException(fileName);
             }
 
+            if (journalLimit > 0) {
+                JournalEntry entry(JournalEntry::DELETE, currentPath(), fileName, child->isDirectory);
+                entry.saved.swap(child->content);
+                entry.savedModified = child->modifiedTime;
+                entry.savedCreated = child->createdTime;
+                record(move(entry));
+            }
+
+            nodeRemoved(child);
             currentDir->removeChild(fileName);
-            delete child;
-            cout << "'" << fileName << "' deleted\n";
+            FileNode::destroy(child);
+            *out << "'" << fileName << "' deleted\n";
             return;
         }
         throw FileNotFoundException(fileName);
@@ -256,105 +684,1565 @@ public:
 
     // searches for files by name recursively from root
     vector<string> searchFile(string fileName) {
-        cout << "Searching for '" << fileName << "'...\n";
+        OpTimer timer(MET_SEARCH_FILE);
+        *out << "Searching for '" << fileName << "'...\n";
         vector<string> results;
-        searchHelper(root, fileName, results, "");
+        {
+            TraceScope scope("traversal", "phase");
+            if (isCompacted()) {
+                searchTable(fileName, results);
+            } else {
+                searchHelper(root, fileName, results, "");
+            }
+        }
+
+        if (results.size() == 0) {
+            *out << "No files found\n";
+        } else {
+            for (int i = 0; i < results.size(); i++) {
+                *out << "Found: " << results[i] << "\n";
+            }
+        }
+        *out << "\n";
+        return results;
+    }
+
+    // searches for files by glob (*.log, data-??.csv) or regex
+    // a pattern with a '/' is matched against the full path, like /logs/*.txt,
+    // and folders that can no longer lead to a match are skipped
+    vector<string> searchPattern(string pattern, PatternKind kind) {
+        OpTimer timer(kind == PATTERN_GLOB ? MET_SEARCH_GLOB : MET_SEARCH_REGEX);
+        NamePattern compiled(pattern, kind);
+        *out << "Searching for '" << pattern << "'...\n";
+        vector<string> results;
+        {
+            TraceScope scope("traversal", "phase");
+            if (isCompacted()) {
+                searchPatternTable(compiled, results);
+            } else {
+                searchPatternTree(compiled, results);
+            }
+        }
 
         if (results.size() == 0) {
-            cout << "No files found\n";
+            *out << "No files found\n";
         } else {
             for (int i = 0; i < results.size(); i++) {
-                cout << "Found: " << results[i] << "\n";
+                *out << "Found: " << results[i] << "\n";
             }
         }
-        cout << "\n";
+        *out << "\n";
         return results;
     }
 
+    // how findFiles would run a query, see QueryAccess
+    // the node table is only usable while it matches the tree; with it, a
+    // name pattern that has a fixed part narrows rows fastest. a size or
+    // time range is cheapest on the tree once the start folder has a
+    // summary, since whole folders drop out. otherwise the table is
+    // streamed, or without one the tree is walked
+    QueryPlan planQuery(const FileQuery& query) {
+        FileNode* start = findDirectory(query.path);
+        NamePattern* pattern = nullptr;
+        if (query.namePattern != "") {
+            pattern = new NamePattern(query.namePattern, query.nameKind);
+        }
+        QueryPlan plan = choosePlan(query, pattern, start);
+        delete pattern;
+        return plan;
+    }
+
+    // files and folders under query.path matching every predicate of the
+    // query, as absolute paths in tree order, except that the size and
+    // mtime index plans give them in index order (smallest or oldest first)
+    vector<string> findFiles(const FileQuery& query) {
+        OpTimer timer(MET_FIND_FILES);
+        if (query.isPaged()) {
+            return findFilesPaged(query);
+        }
+        FileNode* start = findDirectory(query.path);
+        NamePattern* pattern = nullptr;
+        if (query.namePattern != "") {
+            pattern = new NamePattern(query.namePattern, query.nameKind);
+        }
+        QueryPlan plan = choosePlan(query, pattern, start);
+
+        vector<FileNode*> found;
+        size_t visited = 0;
+        size_t skipped = 0;
+        {
+            TraceScope scope("traversal", "phase");
+            if (plan.access == ACCESS_TREE_WALK) {
+                queryTree(start, query, pattern, found, visited, skipped);
+            } else if (plan.access == ACCESS_SIZE_INDEX || plan.access == ACCESS_MODIFIED_INDEX) {
+                queryIndex(start, query, pattern, plan.access, found, visited);
+            } else {
+                queryTable(start, query, pattern, plan.access == ACCESS_NAME_INDEX, found, visited, skipped);
+            }
+        }
+        delete pattern;
+
+        vector<string> paths;
+        for (int i = 0; i < found.size(); i++) {
+            paths.push_back(pathOf(found[i]));
+            *out << paths[i] << "\n";
+        }
+        *out << paths.size() << " found (" << plan.description << ", " << visited << " nodes visited, "
+             << skipped << " folders skipped)\n\n";
+        return paths;
+    }
+
+    // calls onMatch with the path of each match, in tree order, as soon as
+    // the walk reaches it; nothing is collected. after is a token from an
+    // earlier call ("" to start at the beginning). returns the token of the
+    // last match when onMatch returned false to stop and more matches are
+    // left, "" when there are none. query paging fields are ignored here
+    string findEach(const FileQuery& query, const string& after, function<bool(const string&)> onMatch) {
+        OpTimer timer(MET_FIND_FILES);
+        return cursorWalk(query, after, onMatch);
+    }
+
+    // one page of matches using query.limit, query.offset and query.after
+    // page.next resumes right after the page, even if the tree has changed
+    SearchPage findPage(const FileQuery& query) {
+        OpTimer timer(MET_FIND_FILES);
+        SearchPage page;
+        size_t toSkip = query.offset;
+        page.next = cursorWalk(query, query.after, [&](const string& path) {
+            if (toSkip > 0) {
+                toSkip--;
+                return true;
+            }
+            page.paths.push_back(path);
+            return query.limit == 0 || page.paths.size() < query.limit;
+        });
+        return page;
+    }
+
     // shows info about a file or folder
     void fileInfo(string fileName) {
+        OpTimer timer(MET_FILE_INFO);
         FileNode* child = currentDir->getChild(fileName);
         if (child != nullptr) {
-            cout << "\n--- File Info ---\n";
-            cout << "Name: " << child->name << "\n";
+            *out << "\n--- File Info ---\n";
+            *out << "Name: " << child->name << "\n";
 
             if (child->isDirectory) {
-                cout << "Type: Directory\n";
+                *out << "Type: Directory\n";
             } else {
-                cout << "Type: File\n";
+                *out << "Type: File\n";
             }
 
-            cout << "Size: " << child->content.length() << " bytes\n";
-            cout << "Created: " << ctime(&child->createdTime);
-            cout << "Modified: " << ctime(&child->modifiedTime);
-            cout << "\n";
+            *out << "Size: " << child->content.length() << " bytes\n";
+            *out << "Created: " << ctime(&child->createdTime);
+            *out << "Modified: " << ctime(&child->modifiedTime);
+            *out << "\n";
             return;
         }
         throw FileNotFoundException(fileName);
     }
 
-    // builds the current path by going up through parents
+    // full path of the current folder, like /a/b
     string getCurrentPath() {
-        string path = "";
-        vector<string> pathParts;
-        FileNode* node = currentDir;
+        OpTimer timer(MET_GET_PATH);
+        return currentPath();
+    }
+
+    // moves to a folder given by its full path, like /a/b
+    void setCurrentPath(string path) {
+        OpTimer timer(MET_SET_PATH);
+        FileNode* dir = resolveDirectory(path);
+        if (dir == nullptr) {
+            throw DirectoryNotFoundException(path);
+        }
+        currentDir = dir;
+    }
+
+    // shows statistics about the file system
+    void displayStats() {
+        OpTimer timer(MET_DISPLAY_STATS);
+        size_t fileCount = 0;
+        size_t dirCount = 0;
+        uint64_t totalSize = 0;
+
+        {
+            TraceScope scope("traversal", "phase");
+            if (isCompacted()) {
+                countTableStats(fileCount, dirCount, totalSize);
+            } else {
+                countStats(root, fileCount, dirCount, totalSize);
+            }
+        }
+
+        *out << "\n--- File System Statistics ---\n";
+        *out << "Total Files: " << fileCount << "\n";
+        *out << "Total Directories: " << dirCount << "\n";
+        *out << "Total Size: " << totalSize << " bytes\n";
+        *out << "\n";
+    }
+
+    // heap bytes used by a folder and everything under it
+    // path is absolute (/a/b), relative to the current folder, or "" for the current folder
+    MemoryUsage getMemoryUsage(string path = "") {
+        OpTimer timer(MET_GET_MEMORY_USAGE);
+        MemoryUsage usage;
+        countMemory(findDirectory(path), usage);
+        return usage;
+    }
+
+    // shows where the memory of a subtree goes, and its biggest entries
+    void displayMemory(string path = "") {
+        OpTimer timer(MET_DISPLAY_MEMORY);
+        FileNode* dir = findDirectory(path);
+        MemoryUsage usage;
+        {
+            TraceScope scope("traversal", "phase");
+            countMemory(dir, usage);
+        }
+
+        *out << "\n--- Memory: " << (path == "" ? currentPath() : path) << " ---\n";
+        *out << "Nodes:          " << usage.nodes << "\n";
+        *out << "Node headers:   " << usage.nodeHeaders << " bytes\n";
+        *out << "Names:          " << usage.names << " bytes\n";
+        *out << "Child vectors:  " << usage.childVectors << " bytes\n";
+        *out << "Child indexes:  " << usage.childIndexes << " bytes\n";
+        *out << "Content:        " << usage.content << " bytes\n";
+        *out << "Total:          " << usage.total() << " bytes\n";
+        if (dir == root) {
+            *out << "Undo journal:   " << journalBytes << " bytes\n";
+            *out << "Node table:     " << table.memoryUsed() << " bytes" << (isCompacted() ? "" : " (stale)") << "\n";
+            if (attributeIndex != nullptr) {
+                *out << "Size/mtime idx: " << attributeIndex->memoryUsed() << " bytes\n";
+            }
+        }
+
+        // the ten largest children, like du | sort -rn | head
+        vector<pair<size_t, FileNode*>> sizes;
+        for (int i = 0; i < dir->children.size(); i++) {
+            MemoryUsage childUsage;
+            countMemory(dir->children[i], childUsage);
+            sizes.push_back(make_pair(childUsage.total(), dir->children[i]));
+        }
+        sort(sizes.begin(), sizes.end(), [](const pair<size_t, FileNode*>& a, const pair<size_t, FileNode*>& b) {
+            return a.first > b.first;
+        });
+        for (int i = 0; i < sizes.size() && i < 10; i++) {
+            *out << (sizes[i].second->isDirectory ? "[DIR]  " : "[FILE] ");
+            *out << sizes[i].second->name << " " << sizes[i].first << " bytes\n";
+        }
+        *out << "\n";
+    }
+
+    // searches file contents under a folder (path as in getMemoryUsage) and
+    // calls onMatch with each matching line's file path, line number and text,
+    // in tree order, while the search is still running
+    GrepStats grepContent(string pattern, string path,
+                          function<void(const string&, size_t, string_view)> onMatch, int threads = 0) {
+        FileNode* dir = findDirectory(path);
+        vector<FileNode*> files;
+        {
+            TraceScope scope("traversal", "phase");
+            collectFiles(dir, files);
+        }
+
+        TraceScope scope("scan", "phase");
+        ContentSearch<FileNode> search(files, pattern);
+        size_t lastFile = (size_t)-1;
+        string filePath;
+        return search.run(threads, [&](const GrepMatch& match) {
+            if (match.file != lastFile) {
+                filePath = pathOf(files[match.file]);
+                lastFile = match.file;
+            }
+            onMatch(filePath, match.line, match.text);
+        });
+    }
+
+    // prints every line containing pattern as path:line: text
+    void grep(string pattern, string path = "") {
+        OpTimer timer(MET_GREP);
+        GrepStats stats = grepContent(pattern, path, [&](const string& file, size_t line, string_view text) {
+            *out << file << ":" << line << ": " << text << "\n";
+        });
+        char summary[160];
+        snprintf(summary, sizeof(summary), "%zu matching lines in %zu of %zu files, %.1f MB in %.3f s (%.2f GB/s)\n\n",
+                 stats.matches, stats.filesMatched, stats.files, stats.bytes / 1e6, stats.seconds,
+                 stats.gigabytesPerSecond());
+        *out << summary;
+    }
+
+    // turns the full-text index on (indexing every file now) or off
+    void setTextIndex(bool on) {
+        OpTimer timer(MET_TEXT_INDEX);
+        delete textIndex;
+        textIndex = nullptr;
+        if (!on) {
+            *out << "Text index off\n";
+            return;
+        }
+
+        textIndex = new FullTextIndex<FileNode>();
+        vector<FileNode*> files;
+        collectFiles(root, files);
+        for (int i = 0; i < files.size(); i++) {
+            textIndex->update(files[i]);
+        }
+        *out << "Text index on: " << textIndex->fileCount() << " files, " << textIndex->termCount()
+             << " terms, " << textIndex->postingsSize() << " bytes of postings\n";
+    }
+
+    bool hasTextIndex() {
+        return textIndex != nullptr;
+    }
+
+    // paths of files matching a full-text query (see FullTextIndex.h), sorted
+    vector<string> searchText(string query) {
+        OpTimer timer(MET_SEARCH_TEXT);
+        if (textIndex == nullptr) {
+            throw runtime_error("Text index is off, turn it on with 'index on'");
+        }
+        vector<FileNode*> files = textIndex->search(query);
+        vector<string> paths;
+        for (int i = 0; i < files.size(); i++) {
+            paths.push_back(pathOf(files[i]));
+        }
+        sort(paths.begin(), paths.end());
+
+        for (int i = 0; i < paths.size(); i++) {
+            *out << paths[i] << "\n";
+        }
+        *out << paths.size() << " files match\n\n";
+        return paths;
+    }
+
+    // turns the size and mtime indexes on (filing every file now) or off
+    void setAttributeIndex(bool on) {
+        OpTimer timer(MET_ATTRIBUTE_INDEX);
+        delete attributeIndex;
+        attributeIndex = nullptr;
+        if (!on) {
+            *out << "Size and mtime indexes off\n";
+            return;
+        }
+
+        attributeIndex = new AttributeIndex<FileNode>();
+        vector<FileNode*> files;
+        collectFiles(root, files, true);
+        for (int i = 0; i < files.size(); i++) {
+            attributeIndex->update(files[i]);
+        }
+        *out << "Size and mtime indexes on: " << attributeIndex->fileCount() << " files, "
+             << attributeIndex->memoryUsed() << " bytes\n";
+    }
+
+    bool hasAttributeIndex() {
+        return attributeIndex != nullptr;
+    }
+
+    // the k largest (BY_SIZE) or most recently modified (BY_MODIFIED) files
+    // under a folder (path as in getMemoryUsage), biggest or newest first
+    // with the indexes on this reads entries off the end of one of them
+    // until k are under the folder, each checked by climbing its parents.
+    // that only pays when the folder holds a good share of the files: for
+    // the root, or a folder whose valid summary says it holds at least a
+    // quarter of them. any other folder is walked, looking at every file
+    // in it once
+    vector<string> topFiles(AttributeOrder order, size_t k, string path = "") {
+        OpTimer timer(MET_TOP_FILES);
+        FileNode* start = findDirectory(path);
+        bool useIndex = attributeIndex != nullptr &&
+            (start == root || (start->summary != nullptr && start->summary->valid &&
+                               start->summary->files * 4 >= attributeIndex->fileCount()));
+        vector<FileNode*> top;
+        {
+            TraceScope scope("traversal", "phase");
+            if (useIndex) {
+                auto take = [&](FileNode* node) {
+                    int depth;
+                    if (start == root || isUnder(node, start, depth)) {
+                        top.push_back(node);
+                    }
+                    return top.size() < k;
+                };
+                if (k > 0 && order == BY_SIZE) {
+                    attributeIndex->largestFirst(take);
+                } else if (k > 0) {
+                    attributeIndex->newestFirst(take);
+                }
+            } else {
+                collectFiles(start, top, true);
+                // the same tie break as the index: higher key, then higher address
+                auto before = [&](FileNode* a, FileNode* b) {
+                    if (order == BY_SIZE && a->content.length() != b->content.length()) {
+                        return a->content.length() > b->content.length();
+                    }
+                    if (order == BY_MODIFIED && a->modifiedTime != b->modifiedTime) {
+                        return a->modifiedTime > b->modifiedTime;
+                    }
+                    return a > b;
+                };
+                size_t count = min(k, top.size());
+                partial_sort(top.begin(), top.begin() + count, top.end(), before);
+                top.resize(count);
+            }
+        }
+
+        vector<string> paths;
+        for (int i = 0; i < top.size(); i++) {
+            paths.push_back(pathOf(top[i]));
+            if (order == BY_SIZE) {
+                *out << top[i]->content.length() << " bytes  " << paths[i] << "\n";
+            } else {
+                char when[32];
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&top[i]->modifiedTime));
+                *out << when << "  " << paths[i] << "\n";
+            }
+        }
+        *out << "\n";
+        return paths;
+    }
+
+    // builds the node table so whole-tree scans can stream through arrays
+    // until the next change
+    void compact() {
+        OpTimer timer(MET_COMPACT);
+        {
+            TraceScope scope("traversal", "phase");
+            table.build(root);
+            tableVersion = version;
+        }
+        *out << "Node table built: " << table.rows() << " nodes, " << table.memoryUsed() << " bytes\n";
+    }
+
+    // true while the node table matches the tree
+    bool isCompacted() {
+        return table.rows() > 0 && tableVersion == version;
+    }
+
+    // the table built by the last compact(), check isCompacted() before trusting it
+    const NodeTable<FileNode>& nodeTable() {
+        return table;
+    }
+
+    // reverts the most recent change
+    // if it can't be reverted the entry stays in the journal
+    void undo() {
+        OpTimer timer(MET_UNDO);
+        if (undoLog.size() == 0) {
+            throw NothingToUndoException("undo");
+        }
+        applyEntry(undoLog.back(), true);
+        *out << "Undo: " << describeEntry(undoLog.back()) << "\n";
+        redoLog.push_back(move(undoLog.back()));
+        undoLog.pop_back();
+    }
+
+    // re-applies the most recently undone change
+    void redo() {
+        OpTimer timer(MET_REDO);
+        if (redoLog.size() == 0) {
+            throw NothingToUndoException("redo");
+        }
+        applyEntry(redoLog.back(), false);
+        *out << "Redo: " << describeEntry(redoLog.back()) << "\n";
+        undoLog.push_back(move(redoLog.back()));
+        redoLog.pop_back();
+    }
+
+    // sets how many bytes the undo/redo journal may hold
+    void setJournalLimit(size_t bytes) {
+        journalLimit = bytes;
+        trimJournal();
+    }
+
+    size_t getJournalBytes() {
+        return journalBytes;
+    }
+
+    int undoCount() {
+        return undoLog.size();
+    }
+
+    int redoCount() {
+        return redoLog.size();
+    }
+
+private:
+    // builds the current path by going up through parents
+    // (internal callers use this so they don't show up in the metrics)
+    string currentPath() {
+        return pathOf(currentDir);
+    }
+
+    // full path of any node, like /a/b/file.txt
+    string pathOf(FileNode* target) {
+        vector<FileNode*> pathParts;
+        size_t length = 0;
+        FileNode* node = target;
 
         while (node != root) {
-            pathParts.push_back(node->name);
+            pathParts.push_back(node);
+            length += node->name.length() + 1;
             node = node->parent;
         }
 
-        path = "/";
+        string path = "/";
+        path.reserve(length + 1);
 
         // reverse order since we collected from bottom up
         for (int i = pathParts.size() - 1; i >= 0; i--) {
-            path = path + pathParts[i];
+            path += pathParts[i]->name;
             if (i > 0) {
-                path = path + "/";
+                path += '/';
             }
         }
 
         return path;
     }
 
-    // shows statistics about the file system
-    void displayStats() {
-        int fileCount = 0;
-        int dirCount = 0;
-        int totalSize = 0;
+    // the folders and files under dir, in tree order, paths relative to it
+    // contents are views into the tree, which must not change while they
+    // are used. a name that would climb out of the target is refused
+    vector<HostOutEntry> exportEntries(FileNode* dir) {
+        struct Collector : TreeVisitor {
+            vector<HostOutEntry> entries;
+            vector<string> paths;   // path of the folder at each depth
+            bool enter(FileNode* node, int depth) {
+                if (depth == 0) {
+                    return true;
+                }
+                if (node->name == "." || node->name == "..") {
+                    throw InvalidNameException("'" + node->name + "' can't be exported");
+                }
+                string path = depth == 1 ? node->name : paths[depth - 2] + "/" + node->name;
+                entries.push_back(HostOutEntry{path, node->content, node->isDirectory, node->modifiedTime});
+                if (node->isDirectory) {
+                    paths.resize(depth);
+                    paths[depth - 1] = path;
+                }
+                return true;
+            }
+        };
+        Collector collector;
+        TraceScope scope("traversal", "phase");
+        walkTree(dir, collector);
+        return move(collector.entries);
+    }
 
-        countStats(root, fileCount, dirCount, totalSize);
+    void reportExport(const char* action, const HostTreeStats& stats, const string& target) {
+        // the target goes in as is, a buffer would cut long paths short
+        char counts[100];
+        snprintf(counts, sizeof(counts), "%s %zu files, %zu folders, %.1f MB to ", action, stats.files, stats.dirs,
+                 stats.bytes / 1e6);
+        char rates[100];
+        snprintf(rates, sizeof(rates), " in %.3f s: %.0f files/s, %.1f MB/s\n", stats.seconds,
+                 stats.filesPerSecond(), stats.megabytesPerSecond());
+        *out << counts << target << rates;
+    }
 
-        cout << "\n--- File System Statistics ---\n";
-        cout << "Total Files: " << fileCount << "\n";
-        cout << "Total Directories: " << dirCount << "\n";
-        cout << "Total Size: " << totalSize << " bytes\n";
-        cout << "\n";
+    // bulkLoad without its own metrics entry, for importHost
+    size_t loadEntries(vector<BulkEntry>& entries) {
+        vector<size_t> order(entries.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        auto byPath = [&](size_t a, size_t b) {
+            return bulkPathLess(entries[a].path, entries[b].path);
+        };
+        if (!is_sorted(order.begin(), order.end(), byPath)) {
+            stable_sort(order.begin(), order.end(), byPath);
+        }
+
+        vector<size_t> childCounts;
+        size_t made;
+        {
+            TraceScope scope("lookup", "phase");
+            made = bulkPass(entries, order, childCounts, false);
+        }
+        {
+            TraceScope scope("allocate", "phase");
+            arena.reserve(made);
+            bulkPass(entries, order, childCounts, true);
+        }
+        clearJournal();
+        return made;
+    }
+
+    // one bulkLoad pass over the entries in path order. the first checks
+    // everything and counts each folder's new children into childCounts,
+    // the second (building) makes the nodes, sizing each folder from the
+    // count. both open folders in the same order, so their slots line up.
+    // open holds the folder chain of the last path; sorted input means a
+    // folder left behind never comes back, and an existing folder is
+    // only looked up in when it was there before the load
+    size_t bulkPass(vector<BulkEntry>& entries, const vector<size_t>& order, vector<size_t>& childCounts,
+                    bool building) {
+        struct Open {
+            string_view name;
+            FileNode* node;     // nullptr for a new folder while checking
+            bool isFile;
+            bool existed;
+            size_t slot;        // index into childCounts
+            size_t children;    // new children so far
+        };
+        vector<Open> open;
+        open.push_back(Open{string_view(), root, false, true, 0, 0});
+        size_t slots = 1;
+        if (!building) {
+            childCounts.assign(1, 0);
+        }
+
+        // closes folders above depth, recording their counts
+        auto closeTo = [&](size_t depth) {
+            while (open.size() > depth) {
+                Open& top = open.back();
+                if (!building && !top.isFile) {
+                    childCounts[top.slot] = top.children;
+                }
+                if (building && top.existed && top.children > 0) {
+                    invalidateSummaries(top.node);
+                }
+                open.pop_back();
+            }
+        };
+        // sizes a folder's child containers for the children it will get
+        auto presize = [&](FileNode* dir, size_t slot) {
+            size_t total = dir->children.size() + childCounts[slot];
+            dir->children.reserve(total);
+            dir->childIndex.reserve(total);
+        };
+        if (building) {
+            presize(root, 0);
+        }
+
+        time_t now = time(0);
+        size_t made = 0;
+        vector<string_view> parts;
+        for (size_t e = 0; e < order.size(); e++) {
+            BulkEntry& entry = entries[order[e]];
+            splitBulkPath(entry.path, parts);
+
+            // how much of the path is already open
+            size_t depth = 0;
+            while (depth + 1 < open.size() && depth < parts.size() && open[depth + 1].name == parts[depth]) {
+                depth++;
+            }
+            if (depth > 0 && open[depth].isFile) {
+                if (depth == parts.size()) {
+                    throw AlreadyExistsException(entry.path);
+                }
+                throw InvalidNameException("'" + entry.path + "' is below a file");
+            }
+            if (depth == parts.size()) {
+                if (!entry.isDirectory) {
+                    throw AlreadyExistsException(entry.path);
+                }
+                continue;   // the same folder twice
+            }
+            closeTo(depth + 1);
+
+            for (size_t k = depth; k < parts.size(); k++) {
+                bool isDir = k + 1 < parts.size() || entry.isDirectory;
+                Open& parent = open.back();
+                FileNode* existing = parent.existed ? parent.node->getChild(string(parts[k])) : nullptr;
+                if (existing != nullptr) {
+                    if (!isDir || !existing->isDirectory) {
+                        throw AlreadyExistsException(entry.path);
+                    }
+                    if (building) {
+                        presize(existing, slots);
+                    } else {
+                        childCounts.push_back(0);
+                    }
+                    open.push_back(Open{parts[k], existing, false, true, slots++, 0});
+                    continue;
+                }
+
+                parent.children++;
+                made++;
+                FileNode* node = nullptr;
+                if (building) {
+                    node = new (arena.allocate()) FileNode(string(parts[k]), isDir, parent.node, now);
+                    node->inArena = true;
+                    if (k + 1 == parts.size() && entry.modified != 0) {
+                        node->modifiedTime = entry.modified;
+                    }
+                    if (!isDir) {
+                        node->content.swap(entry.content);
+                    } else if (childCounts[slots] > 0) {
+                        presize(node, slots);
+                    }
+                    parent.node->addChild(node);
+                    nodeChanged(node);
+                } else if (isDir) {
+                    childCounts.push_back(0);
+                }
+                open.push_back(Open{parts[k], node, !isDir, false, isDir ? slots : 0, 0});
+                if (isDir) {
+                    slots++;
+                }
+            }
+        }
+        closeTo(0);
+        return made;
+    }
+
+    // the names in a bulkLoad path, as views into it
+    static void splitBulkPath(const string& path, vector<string_view>& parts) {
+        parts.clear();
+        size_t start = path.length() > 0 && path[0] == '/' ? 1 : 0;
+        if (start == path.length()) {
+            throw InvalidNameException("empty path");
+        }
+        while (true) {
+            size_t slash = path.find('/', start);
+            size_t end = slash == string::npos ? path.length() : slash;
+            if (end == start) {
+                throw InvalidNameException("empty name in '" + path + "'");
+            }
+            parts.push_back(string_view(path).substr(start, end - start));
+            if (slash == string::npos) {
+                return;
+            }
+            start = slash + 1;
+        }
+    }
+
+    // adds a change to the journal, a new change makes the redo history invalid
+    void record(JournalEntry entry) {
+        TraceScope scope("journal", "phase");
+        for (int i = 0; i < redoLog.size(); i++) {
+            journalBytes -= redoLog[i].memoryUsed();
+        }
+        redoLog.clear();
+
+        // later entries depend on earlier ones, so an entry too big to keep
+        // means the whole history has to go
+        if (entry.memoryUsed() > journalLimit) {
+            clearJournal();
+            return;
+        }
+        journalBytes += entry.memoryUsed();
+        undoLog.push_back(move(entry));
+        trimJournal();
+    }
+
+    // drops the oldest entries until the journal fits in its budget
+    void trimJournal() {
+        while (journalBytes > journalLimit && redoLog.size() > 0) {
+            journalBytes -= redoLog.front().memoryUsed();
+            redoLog.pop_front();
+        }
+        while (journalBytes > journalLimit && undoLog.size() > 0) {
+            journalBytes -= undoLog.front().memoryUsed();
+            undoLog.pop_front();
+        }
+    }
+
+    void clearJournal() {
+        undoLog.clear();
+        redoLog.clear();
+        journalBytes = 0;
+    }
+
+    // finds a folder from a path like /a/b, returns nullptr if missing
+    FileNode* resolveDirectory(string path) {
+        TraceScope scope("lookup", "phase");
+        FileNode* node = root;
+        int start = 1;
+        while (start < path.length()) {
+            int end = path.find('/', start);
+            if (end == string::npos) {
+                end = path.length();
+            }
+            node = node->getChild(path.substr(start, end - start));
+            if (node == nullptr || !node->isDirectory) {
+                return nullptr;
+            }
+            start = end + 1;
+        }
+        return node;
+    }
+
+    // like resolveDirectory, but also takes paths relative to the current
+    // folder and throws when the folder does not exist
+    FileNode* findDirectory(string path) {
+        TraceScope scope("lookup", "phase");
+        if (path == "") {
+            return currentDir;
+        }
+        FileNode* dir = path[0] == '/' ? root : currentDir;
+        size_t start = 0;
+        while (start < path.length()) {
+            size_t end = path.find('/', start);
+            if (end == string::npos) {
+                end = path.length();
+            }
+            string part = path.substr(start, end - start);
+            if (part == "..") {
+                dir = dir->parent;
+            } else if (part != "" && part != ".") {
+                dir = dir->getChild(part);
+            }
+            if (dir == nullptr || !dir->isDirectory) {
+                throw DirectoryNotFoundException(path);
+            }
+            start = end + 1;
+        }
+        return dir;
+    }
+
+    // every change to the tree goes through these two, so the node table
+    // version and the optional indexes stay in step with it
+    // nodeChanged: a node was created or its content replaced
+    void nodeChanged(FileNode* node) {
+        version++;
+        invalidateSummaries(node->parent);
+        if (node->parent != nullptr && node->parent->sorted != nullptr) {
+            node->parent->sorted->update(node);
+        }
+        if (textIndex != nullptr && !node->isDirectory) {
+            textIndex->update(node);
+        }
+        if (attributeIndex != nullptr && !node->isDirectory) {
+            attributeIndex->update(node);
+        }
+    }
+
+    // nodeRemoved: a node is about to be deleted
+    void nodeRemoved(FileNode* node) {
+        version++;
+        invalidateSummaries(node->parent);
+        if (textIndex != nullptr) {
+            textIndex->remove(node);
+        }
+        if (attributeIndex != nullptr) {
+            attributeIndex->remove(node);
+        }
+    }
+
+    // marks the summaries of dir and the folders above it out of date
+    // a folder's summary is only valid while all folders below it have a
+    // valid one, so the climb can stop at the first folder without one
+    void invalidateSummaries(FileNode* dir) {
+        while (dir != nullptr && dir->summary != nullptr && dir->summary->valid) {
+            dir->summary->valid = false;
+            dir = dir->parent;
+        }
+    }
+
+    // undoes (or redoes) one journal entry by swapping its saved state into the tree
+    // every check comes before the first change, so a throw leaves the
+    // tree, the entry and journalBytes as they were
+    void applyEntry(JournalEntry& entry, bool undoing) {
+        FileNode* dir = resolveDirectory(entry.dirPath);
+        if (dir == nullptr) {
+            throw DirectoryNotFoundException(entry.dirPath);
+        }
+
+        if (entry.kind == JournalEntry::WRITE) {
+            FileNode* file = dir->getChild(entry.name);
+            if (file == nullptr) {
+                throw FileNotFoundException(entry.name);
+            }
+            string current = file->content.substr(entry.prefixLen, entry.currentLen);
+            file->content.replace(entry.prefixLen, entry.currentLen, entry.saved);
+            journalBytes -= entry.saved.capacity();
+            entry.currentLen = entry.saved.length();
+            entry.saved.swap(current);
+            string().swap(current);
+            journalBytes += entry.saved.capacity();
+            swap(file->modifiedTime, entry.savedModified);
+            nodeChanged(file);
+            return;
+        }
+
+        // undoing a create or redoing a delete removes the node
+        bool removing = (entry.kind == JournalEntry::CREATE) == undoing;
+        if (removing) {
+            FileNode* node = dir->getChild(entry.name);
+            if (node == nullptr) {
+                throw FileNotFoundException(entry.name);
+            }
+            if (node->children.size() > 0) {
+                throw DirectoryNotEmptyException(entry.name);
+            }
+            journalBytes -= entry.saved.capacity();
+            nodeRemoved(node);
+            entry.saved.swap(node->content);
+            entry.savedModified = node->modifiedTime;
+            entry.savedCreated = node->createdTime;
+            dir->removeChild(entry.name);
+            FileNode::destroy(node);
+        } else {
+            if (dir->hasChild(entry.name)) {
+                throw AlreadyExistsException(entry.name);
+            }
+            journalBytes -= entry.saved.capacity();
+            FileNode* node = new FileNode(entry.name, entry.isDirectory, dir, entry.savedCreated);
+            node->content.swap(entry.saved);
+            string().swap(entry.saved);
+            node->modifiedTime = entry.savedModified;
+            dir->addChild(node);
+            nodeChanged(node);
+        }
+        journalBytes += entry.saved.capacity();
+    }
+
+    // short description of a journal entry for undo/redo messages
+    string describeEntry(JournalEntry& entry) {
+        string path = entry.dirPath;
+        if (path != "/") {
+            path = path + "/";
+        }
+        path = path + entry.name;
+
+        if (entry.kind == JournalEntry::WRITE) {
+            return "write '" + path + "'";
+        }
+        if (entry.kind == JournalEntry::CREATE) {
+            return "create '" + path + "'";
+        }
+        return "delete '" + path + "'";
     }
 
-private:
     // recursively searches for files matching target name
-    void searchHelper(FileNode* node, string target, vector<string>& results, string path) {
-        if (node->name.find(target) != string::npos && !node->isDirectory) {
-            results.push_back(path + node->name);
+    // collects the paths of files whose name contains target
+    // one path string is shared by the whole walk: a folder's name is added
+    // when the walk enters it and cut off again when it leaves
+    void searchHelper(FileNode* start, string target, vector<string>& results, string startPath) {
+        struct Searcher : TreeVisitor {
+            string target;
+            string path;
+            vector<string>* results;
+
+            bool enter(FileNode* node, int) {
+                if (!node->isDirectory) {
+                    if (node->name.find(target) != string::npos) {
+                        results->push_back(path + node->name);
+                    }
+                    return false;
+                }
+                path += node->name;
+                path += '/';
+                return true;
+            }
+
+            void leave(FileNode* node, int) {
+                if (node->isDirectory) {
+                    path.resize(path.length() - node->name.length() - 1);
+                }
+            }
+        };
+        Searcher searcher;
+        searcher.target = target;
+        searcher.path = startPath;
+        searcher.results = &results;
+        walkTree(start, searcher);
+    }
+
+    // counts files, dirs, and total size
+    void countStats(FileNode* start, size_t& files, size_t& dirs, uint64_t& size) {
+        struct Counter : TreeVisitor {
+            size_t files = 0;
+            size_t dirs = 0;
+            uint64_t size = 0;
+
+            bool enter(FileNode* node, int) {
+                if (node->isDirectory) {
+                    dirs++;
+                } else {
+                    files++;
+                    size = size + node->content.length();
+                }
+                return true;
+            }
+        };
+        Counter counter;
+        walkTree(start, counter);
+        files += counter.files;
+        dirs += counter.dirs;
+        size += counter.size;
+    }
+
+    // searchHelper over the node table, rows are already in the same order
+    // one vectorized search over the packed names replaces a find per node
+    void searchTable(string target, vector<string>& results) {
+        vector<uint32_t> rows;
+        table.findNames(target, false, rows);
+        for (int i = 0; i < rows.size(); i++) {
+            if (!table.isDirectory[rows[i]]) {
+                results.push_back(table.pathOf(rows[i]));
+            }
         }
+    }
 
-        for (int i = 0; i < node->children.size(); i++) {
-            searchHelper(node->children[i], target, results, path + node->name + "/");
+    // pattern search by walking the tree, same result order as searchHelper
+    // for a path pattern the DFA state after "/a/b/" is kept per depth, and a
+    // folder whose state is dead is not entered
+    void searchPatternTree(const NamePattern& pattern, vector<string>& results) {
+        struct PatternSearcher : TreeVisitor {
+            const NamePattern* pattern;
+            string path;
+            vector<uint32_t> states;   // DFA state after each open folder's path
+            vector<string>* results;
+
+            bool enter(FileNode* node, int depth) {
+                if (!node->isDirectory) {
+                    uint32_t state = pattern->isPathPattern()
+                        ? pattern->run(states[depth - 1], node->name.data(), node->name.length())
+                        : pattern->run(pattern->start(), node->name.data(), node->name.length());
+                    if (pattern->accepts(state)) {
+                        results->push_back(path + node->name);
+                    }
+                    return false;
+                }
+                path += node->name;
+                path += '/';
+                if (pattern->isPathPattern()) {
+                    uint32_t state = depth == 0 ? pattern->start()
+                                                : pattern->run(states[depth - 1], node->name.data(), node->name.length());
+                    state = pattern->step(state, '/');
+                    states.resize(depth + 1);
+                    states[depth] = state;
+                    return state != NamePattern::deadState;
+                }
+                return true;
+            }
+
+            void leave(FileNode* node, int) {
+                if (node->isDirectory) {
+                    path.resize(path.length() - node->name.length() - 1);
+                }
+            }
+        };
+        PatternSearcher searcher;
+        searcher.pattern = &pattern;
+        searcher.results = &results;
+        walkTree(root, searcher);
+    }
+
+    // pattern search over the node table
+    // name patterns with a fixed part (".log" in *.log) first narrow the rows
+    // down with the vectorized name scan, then run the DFA on those names
+    // path patterns keep a DFA state per row and jump over dead subtrees
+    void searchPatternTable(const NamePattern& pattern, vector<string>& results) {
+        if (!pattern.isPathPattern()) {
+            vector<uint32_t> rows;
+            if (pattern.requiredLiteral() != "") {
+                table.findNames(pattern.requiredLiteral(), false, rows);
+            } else {
+                for (uint32_t row = 0; row < table.rows(); row++) {
+                    rows.push_back(row);
+                }
+            }
+            for (int i = 0; i < rows.size(); i++) {
+                uint32_t row = rows[i];
+                if (!table.isDirectory[row] &&
+                    pattern.accepts(pattern.run(pattern.start(), table.name(row), table.nameLength[row]))) {
+                    results.push_back(table.pathOf(row));
+                }
+            }
+            return;
+        }
+
+        vector<uint32_t> states(table.rows(), NamePattern::deadState);
+        states[0] = pattern.step(pattern.start(), '/');
+        uint32_t row = 1;
+        while (row < table.rows()) {
+            uint32_t state = pattern.run(states[table.parent[row]], table.name(row), table.nameLength[row]);
+            if (!table.isDirectory[row]) {
+                if (pattern.accepts(state)) {
+                    results.push_back(table.pathOf(row));
+                }
+                row++;
+                continue;
+            }
+            state = pattern.step(state, '/');
+            states[row] = state;
+            row = state == NamePattern::deadState ? table.subtreeEnd[row] : row + 1;
+        }
+    }
+
+    QueryPlan choosePlan(const FileQuery& query, const NamePattern* pattern, FileNode* start) {
+        QueryPlan plan;
+        bool summarized = start->summary != nullptr && start->summary->valid;
+        // only files are in the attribute indexes: a lower size bound rules
+        // folders out by itself, an mtime window needs -type f
+        if (query.isPaged()) {
+            // pages must come in tree order and resume from a tree position
+            plan.access = ACCESS_TREE_WALK;
+            plan.description = "cursor walk";
+        } else if (attributeIndex != nullptr && query.modifiedAfter > 0 && query.type == QUERY_FILES) {
+            plan.access = ACCESS_MODIFIED_INDEX;
+            plan.description = "mtime index range";
+        } else if (attributeIndex != nullptr && query.minSize > 0) {
+            plan.access = ACCESS_SIZE_INDEX;
+            plan.description = "size index range";
+        } else if (!isCompacted()) {
+            plan.access = ACCESS_TREE_WALK;
+            plan.description = "tree walk";
+        } else if (pattern != nullptr && !pattern->isPathPattern() && pattern->requiredLiteral() != "") {
+            plan.access = ACCESS_NAME_INDEX;
+            plan.description = "name index on '" + pattern->requiredLiteral() + "'";
+        } else if (summarized && query.hasMetadataRange()) {
+            plan.access = ACCESS_TREE_WALK;
+            plan.description = "tree walk over subtree summaries";
+        } else {
+            plan.access = ACCESS_TABLE_SCAN;
+            plan.description = "table scan";
+        }
+        return plan;
+    }
+
+    // DFA state of a path pattern after reading start's path and a '/'
+    uint32_t pathPatternState(const NamePattern& pattern, FileNode* start) {
+        string path = start == root ? "" : pathOf(start);
+        return pattern.step(pattern.run(pattern.start(), path.data(), path.length()), '/');
+    }
+
+    // what a tree query reports and where it goes, decided node by node in
+    // pre-order. shared by the full walk and the resumable cursor
+    struct QueryFilter {
+        const FileQuery* query;
+        const NamePattern* pattern;
+        uint32_t startState;       // path pattern: state after the start's parent path
+        vector<uint32_t> states;   // path pattern: state after each open folder's path + '/'
+        size_t visited;
+        size_t skipped;
+
+        QueryFilter(const FileQuery& q, const NamePattern* p, uint32_t state) {
+            query = &q;
+            pattern = p;
+            startState = state;
+            visited = 0;
+            skipped = 0;
         }
+
+        // true when node matches, descend says whether its children can
+        // a folder is not entered when the query cannot match anything below
+        // it: past -maxdepth, a path pattern that can no longer match, or a
+        // valid summary whose ranges miss the query's
+        bool visit(FileNode* node, int depth, bool& descend) {
+            visited++;
+            uint32_t state = 0;
+            bool nameMatches = true;
+            if (pattern != nullptr && pattern->isPathPattern()) {
+                // the root's path is just "/", its name is not part of it
+                state = node->parent == nullptr ? startState
+                      : pattern->run(depth == 0 ? startState : states[depth - 1], node->name.data(), node->name.length());
+                nameMatches = pattern->accepts(state);
+            } else if (pattern != nullptr) {
+                nameMatches = pattern->matches(node->name);
+            }
+            bool matched = nameMatches && depth >= query->minDepth &&
+                query->matchesMetadata(node->isDirectory, node->content.length(), node->createdTime, node->modifiedTime);
+
+            descend = false;
+            if (!node->isDirectory || depth >= query->maxDepth) {
+                return matched;
+            }
+            if (pattern != nullptr && pattern->isPathPattern()) {
+                states.resize(depth + 1);
+                states[depth] = pattern->step(state, '/');
+                if (states[depth] == NamePattern::deadState) {
+                    skipped++;
+                    return matched;
+                }
+            }
+            if (node->summary != nullptr && node->summary->valid && !node->summary->mayContainMatch(*query, depth)) {
+                skipped++;
+                return matched;
+            }
+            descend = true;
+            return matched;
+        }
+    };
+
+    // the QueryFilter startState for a walk from start
+    uint32_t queryStartState(FileNode* start, const NamePattern* pattern) {
+        if (pattern == nullptr || !pattern->isPathPattern() || start == root) {
+            return pattern == nullptr ? 0 : pattern->start();
+        }
+        // the start folder's own name is read by visit, so begin at its parent
+        return pathPatternState(*pattern, start->parent);
     }
 
-    // recursively counts files, dirs, and total size
-    void countStats(FileNode* node, int& files, int& dirs, int& size) {
-        if (node->isDirectory) {
-            dirs++;
-            for (int i = 0; i < node->children.size(); i++) {
-                countStats(node->children[i], files, dirs, size);
+    // findFiles by walking the tree
+    // on the way out a folder whose child folders all have valid summaries
+    // gets its own summary again
+    void queryTree(FileNode* start, const FileQuery& query, const NamePattern* pattern,
+                   vector<FileNode*>& found, size_t& visited, size_t& skipped) {
+        struct QueryWalker : TreeVisitor {
+            QueryFilter* filter;
+            vector<FileNode*>* found;
+
+            bool enter(FileNode* node, int depth) {
+                bool descend;
+                if (filter->visit(node, depth, descend)) {
+                    found->push_back(node);
+                }
+                return descend;
+            }
+
+            void leave(FileNode* node, int) {
+                if (!node->isDirectory || (node->summary != nullptr && node->summary->valid)) {
+                    return;
+                }
+                SubtreeSummary below;
+                for (int i = 0; i < node->children.size(); i++) {
+                    FileNode* child = node->children[i];
+                    if (child->isDirectory) {
+                        if (child->summary == nullptr || !child->summary->valid) {
+                            return;   // not walked this time, try again on a later query
+                        }
+                        below.addSummary(*child->summary, 1);
+                    }
+                    below.addNode(child->isDirectory, child->content.length(), child->createdTime, child->modifiedTime, 1);
+                }
+                if (node->summary == nullptr) {
+                    node->summary = new SubtreeSummary();
+                }
+                *node->summary = below;
+                node->summary->valid = true;
+            }
+        };
+
+        QueryFilter filter(query, pattern, queryStartState(start, pattern));
+        QueryWalker walker;
+        walker.filter = &filter;
+        walker.found = &found;
+        walkTree(start, walker);
+        visited += filter.visited;
+        skipped += filter.skipped;
+    }
+
+    // a page from dir's ordered child index, built the first time this
+    // order is asked for. tokens are "key:name" of the last entry, e.g.
+    // "2048:big.log", so the next page starts with one tree lookup
+    ListPage sortedPage(FileNode* dir, ListOrder order, bool descending, size_t limit, const string& after) {
+        ListPosition from = {0, string_view()};
+        string afterName;
+        if (after != "") {
+            size_t colon = after.find(':');
+            if (colon == string::npos || colon == 0 || after.find_first_not_of("0123456789") < colon) {
+                throw InvalidQueryException("bad cursor '" + after + "'");
+            }
+            afterName = unescapeTokenName(after.substr(colon + 1));
+            from.key = strtoull(after.c_str(), nullptr, 10);
+            from.name = afterName;
+        }
+        if (dir->sorted == nullptr) {
+            dir->sorted = new SortedChildren<FileNode>();
+        }
+        if (!dir->sorted->has(order)) {
+            dir->sorted->build(order, dir->children);
+        }
+
+        ListPage page;
+        uint64_t lastKey = 0;
+        bool more = dir->sorted->page(order, descending, after != "" ? &from : nullptr, [&](FileNode* child) {
+            ListEntry entry;
+            entry.name = child->name;
+            entry.isDirectory = child->isDirectory;
+            entry.size = child->content.length();
+            entry.modified = child->modifiedTime;
+            page.entries.push_back(entry);
+            lastKey = order == LIST_BY_SIZE ? entry.size : order == LIST_BY_MODIFIED ? entry.modified : 0;
+            return limit == 0 || page.entries.size() < limit;
+        });
+        if (more) {
+            page.next = to_string(lastKey) + ":" + escapeTokenName(page.entries.back().name);
+        }
+        return page;
+    }
+
+    // findFiles with -limit/-offset/-after: prints each match as it is found
+    vector<string> findFilesPaged(const FileQuery& query) {
+        vector<string> paths;
+        size_t toSkip = query.offset;
+        string next = cursorWalk(query, query.after, [&](const string& path) {
+            if (toSkip > 0) {
+                toSkip--;
+                return true;
+            }
+            *out << path << "\n";
+            paths.push_back(path);
+            return query.limit == 0 || paths.size() < query.limit;
+        });
+        *out << paths.size() << " found";
+        if (next != "") {
+            *out << ", next page: -after " << next;
+        }
+        *out << "\n\n";
+        return paths;
+    }
+
+    // a pre-order walk that can stop after any match and later pick up
+    // again from a SearchCursor token, with only the stack of open folders
+    // in memory. the QueryFilter is the one queryTree uses, so pages come
+    // out in the same order as a full findFiles walk. once onMatch asks to
+    // stop, the walk goes on to the next match: the token of the stopping
+    // match comes back only if there is one, "" when nothing is left
+    string cursorWalk(const FileQuery& query, const string& after, function<bool(const string&)> onMatch) {
+        struct Frame {
+            FileNode* node;
+            size_t next;   // index of the next child to visit
+        };
+
+        FileNode* start = findDirectory(query.path);
+        unique_ptr<NamePattern> pattern;
+        if (query.namePattern != "") {
+            pattern.reset(new NamePattern(query.namePattern, query.nameKind));
+        }
+        QueryFilter filter(query, pattern.get(), queryStartState(start, pattern.get()));
+        vector<Frame> stack;
+        TraceScope scope("traversal", "phase");
+
+        // token of the match just visited at depth, read off the stack
+        auto tokenAt = [&](FileNode* node, int depth) {
+            SearchCursor cursor;
+            for (int d = 0; d < depth; d++) {
+                cursor.indexes.push_back(stack[d].next - 1);
+                cursor.names.push_back(d + 1 < depth ? stack[d + 1].node->name : node->name);
+            }
+            return cursor.token();
+        };
+
+        bool stopped = false;
+        string stoppedAt;   // token of the match onMatch stopped on
+        bool descend;
+        if (after == "") {
+            if (filter.visit(start, 0, descend) && !onMatch(pathOf(start))) {
+                stopped = true;
+                stoppedAt = tokenAt(start, 0);
+            }
+            if (descend) {
+                stack.push_back(Frame{start, 0});
             }
         } else {
-            files++;
-            size = size + node->content.length();
+            // rebuild the stack down to the cursor's node, visiting each
+            // folder on the way again so the filter's states are set up
+            SearchCursor cursor = SearchCursor::parse(after);
+            filter.visit(start, 0, descend);
+            if (descend) {
+                stack.push_back(Frame{start, 0});
+            }
+            for (size_t level = 0; level < cursor.names.size() && descend; level++) {
+                FileNode* parent = stack.back().node;
+                FileNode* child = parent->getChild(cursor.names[level]);
+                size_t index = cursor.indexes[level];
+                if (child == nullptr) {
+                    // gone: whatever moved into its slot comes next
+                    stack.back().next = min(index, parent->children.size());
+                    break;
+                }
+                if (index >= parent->children.size() || parent->children[index] != child) {
+                    index = find(parent->children.begin(), parent->children.end(), child) - parent->children.begin();
+                }
+                stack.back().next = index + 1;
+                filter.visit(child, level + 1, descend);
+                if (descend) {
+                    stack.push_back(Frame{child, 0});
+                }
+            }
         }
+
+        while (stack.size() > 0) {
+            Frame& frame = stack.back();
+            if (frame.next >= frame.node->children.size()) {
+                stack.pop_back();
+                continue;
+            }
+            FileNode* child = frame.node->children[frame.next];
+            frame.next++;
+
+            int depth = stack.size();
+            if (filter.visit(child, depth, descend)) {
+                if (stopped) {
+                    return stoppedAt;
+                }
+                if (!onMatch(pathOf(child))) {
+                    stopped = true;
+                    stoppedAt = tokenAt(child, depth);
+                }
+            }
+            if (descend) {
+                stack.push_back(Frame{child, 0});   // invalidates frame
+            }
+        }
+        return "";
+    }
+
+    // findFiles over the node table rows of the start folder
+    // with useNameIndex only rows whose name holds the pattern's fixed part
+    // are looked at, otherwise every row, jumping over folders past
+    // -maxdepth or that a path pattern rules out
+    void queryTable(FileNode* start, const FileQuery& query, const NamePattern* pattern, bool useNameIndex,
+                    vector<FileNode*>& found, size_t& visited, size_t& skipped) {
+        uint32_t first = table.rowOf(start);
+        uint32_t end = table.subtreeEnd[first];
+
+        if (useNameIndex) {
+            vector<uint32_t> rows;
+            table.findNames(pattern->requiredLiteral(), false, rows);
+            for (int i = 0; i < rows.size(); i++) {
+                uint32_t row = rows[i];
+                if (row < first || row >= end) {
+                    continue;
+                }
+                visited++;
+                int depth = 0;
+                for (uint32_t r = row; r != first; r = table.parent[r]) {
+                    depth++;
+                }
+                if (depth >= query.minDepth && depth <= query.maxDepth &&
+                    query.matchesMetadata(table.isDirectory[row], table.size[row], table.createdTime[row],
+                                          table.modifiedTime[row]) &&
+                    pattern->accepts(pattern->run(pattern->start(), table.name(row), table.nameLength[row]))) {
+                    found.push_back(table.node[row]);
+                }
+            }
+            return;
+        }
+
+        bool pathPattern = pattern != nullptr && pattern->isPathPattern();
+        vector<int> depths(end - first, 0);
+        vector<uint32_t> states(pathPattern ? end - first : 0, NamePattern::deadState);
+        uint32_t startState = pathPattern && start != root ? pathPatternState(*pattern, start->parent)
+                                                           : (pattern != nullptr ? pattern->start() : 0);
+        uint32_t row = first;
+        while (row < end) {
+            visited++;
+            int depth = row == first ? 0 : depths[table.parent[row] - first] + 1;
+            depths[row - first] = depth;
+
+            uint32_t state = 0;
+            bool nameMatches = true;
+            if (pattern != nullptr) {
+                uint32_t from = pathPattern && row != first ? states[table.parent[row] - first] : startState;
+                state = pathPattern && table.parent[row] == noNode ? from
+                                                                   : pattern->run(from, table.name(row), table.nameLength[row]);
+                nameMatches = pattern->accepts(state);
+            }
+            if (nameMatches && depth >= query.minDepth &&
+                query.matchesMetadata(table.isDirectory[row], table.size[row], table.createdTime[row],
+                                      table.modifiedTime[row])) {
+                found.push_back(table.node[row]);
+            }
+
+            bool prune = false;
+            if (table.isDirectory[row]) {
+                prune = depth >= query.maxDepth;
+                if (pathPattern) {
+                    states[row - first] = pattern->step(state, '/');
+                    prune = prune || states[row - first] == NamePattern::deadState;
+                }
+            }
+            if (prune && table.subtreeEnd[row] > row + 1) {
+                skipped++;
+                row = table.subtreeEnd[row];
+            } else {
+                row++;
+            }
+        }
+    }
+
+    // findFiles over a range of the size or mtime index
+    // matches come out in index order (smallest or oldest first)
+    void queryIndex(FileNode* start, const FileQuery& query, const NamePattern* pattern, QueryAccess access,
+                    vector<FileNode*>& found, size_t& visited) {
+        auto check = [&](FileNode* node) {
+            visited++;
+            int depth;
+            if (!isUnder(node, start, depth) || depth < query.minDepth || depth > query.maxDepth ||
+                !query.matchesMetadata(false, node->content.length(), node->createdTime, node->modifiedTime)) {
+                return true;
+            }
+            if (pattern != nullptr && pattern->isPathPattern()) {
+                string path = pathOf(node);
+                if (!pattern->matches(path)) {
+                    return true;
+                }
+            } else if (pattern != nullptr && !pattern->matches(node->name)) {
+                return true;
+            }
+            found.push_back(node);
+            return true;
+        };
+        if (access == ACCESS_SIZE_INDEX) {
+            attributeIndex->sizeRange(query.minSize, query.maxSize, check);
+        } else {
+            attributeIndex->modifiedRange(query.modifiedAfter, query.modifiedBefore, check);
+        }
+    }
+
+    // true when dir is node or one of its ancestors, depth is how far up it is
+    bool isUnder(FileNode* node, FileNode* dir, int& depth) {
+        depth = 0;
+        while (node != dir) {
+            if (node == nullptr) {
+                return false;
+            }
+            node = node->parent;
+            depth++;
+        }
+        return true;
+    }
+
+    // countStats over the node table
+    void countTableStats(size_t& files, size_t& dirs, uint64_t& size) {
+        for (uint32_t row = 0; row < table.rows(); row++) {
+            if (table.isDirectory[row]) {
+                dirs++;
+            } else {
+                files++;
+                size = size + table.size[row];
+            }
+        }
+    }
+
+    // every file with content (or every file, withEmpty) under start, in tree order
+    void collectFiles(FileNode* start, vector<FileNode*>& files, bool withEmpty = false) {
+        if (isCompacted()) {
+            uint32_t first = table.rowOf(start);
+            for (uint32_t row = first; row < table.subtreeEnd[first]; row++) {
+                if (!table.isDirectory[row] && (withEmpty || table.size[row] > 0)) {
+                    files.push_back(table.node[row]);
+                }
+            }
+            return;
+        }
+
+        struct Collector : TreeVisitor {
+            vector<FileNode*>* files;
+            bool withEmpty;
+
+            bool enter(FileNode* node, int) {
+                if (!node->isDirectory && (withEmpty || node->content.length() > 0)) {
+                    files->push_back(node);
+                }
+                return true;
+            }
+        };
+        Collector collector;
+        collector.files = &files;
+        collector.withEmpty = withEmpty;
+        walkTree(start, collector);
+    }
+
+    void countMemory(FileNode* start, MemoryUsage& usage) {
+        struct MemoryCounter : TreeVisitor {
+            MemoryUsage* usage;
+
+            bool enter(FileNode* node, int) {
+                node->addMemoryUsed(*usage);
+                return true;
+            }
+        };
+        MemoryCounter counter;
+        counter.usage = &usage;
+        walkTree(start, counter);
     }
 };
 
@@ -0,0 +1,381 @@
+// FullTextIndex.h - inverted index over file contents
+//
+// content is split into terms (runs of letters and digits, lowercased).
+// each term has a posting list: for every file holding it, the file's doc
+// id and the positions of the term in that file. lists are stored as
+// varints, doc ids and positions as deltas from the previous one, so a
+// common term costs a byte or two per occurrence.
+//
+// doc ids only ever grow: re-indexing a file gives it a new id, and its
+// postings are appended to the end of each list without decoding it. the
+// old id is marked dead and skipped by queries. when dead ids outnumber
+// live ones every list is rebuilt from the files.
+//
+// queries: words must all appear (AND), "quoted words" must appear in that
+// order next to each other, -word must not appear, and OR between groups
+// matches either group, e.g.   error "disk full" -test OR panic
+
+#ifndef FULLTEXTINDEX_H
+#define FULLTEXTINDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cctype>
+
+using namespace std;
+
+// appends v as a varint, 7 bits per byte, high bit set on all but the last
+inline void appendVarint(string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+inline uint32_t readVarint(const string& in, size_t& pos) {
+    uint32_t v = 0;
+    int shift = 0;
+    while (true) {
+        uint8_t b = in[pos++];
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (b < 0x80) {
+            return v;
+        }
+        shift += 7;
+    }
+}
+
+// calls onTerm(term, position) for every term in text, positions count terms
+template <typename Callback>
+void forEachTerm(string_view text, Callback onTerm) {
+    string term;
+    uint32_t position = 0;
+    for (size_t i = 0; i <= text.length(); i++) {
+        unsigned char c = i < text.length() ? text[i] : ' ';
+        if (isalnum(c)) {
+            term += (char)tolower(c);
+        } else if (term.length() > 0) {
+            onTerm(term, position++);
+            term.clear();
+        }
+    }
+}
+
+struct PostingList {
+    string bytes;        // per doc: doc delta, position count, position deltas
+    uint32_t lastDoc;
+    uint32_t docs;       // entries, dead ones included
+};
+
+// one decoded posting
+struct Posting {
+    uint32_t doc;
+    vector<uint32_t> positions;
+};
+
+template <typename Node>
+class FullTextIndex {
+private:
+    unordered_map<string, PostingList> terms;
+    vector<Node*> docs;                   // by doc id, nullptr once dead
+    unordered_map<Node*, uint32_t> docOf; // live doc id of each indexed file
+    size_t deadDocs;
+    size_t postingBytes;
+
+    // adds a new doc id for node and appends its postings
+    void add(Node* node) {
+        uint32_t doc = docs.size();
+        docs.push_back(node);
+        docOf[node] = doc;
+
+        unordered_map<string, vector<uint32_t>> positions;
+        forEachTerm(node->content, [&](const string& term, uint32_t position) {
+            positions[term].push_back(position);
+        });
+
+        for (auto& entry : positions) {
+            PostingList& list = terms[entry.first];
+            size_t before = list.bytes.size();
+            appendVarint(list.bytes, list.docs == 0 ? doc : doc - list.lastDoc);
+            appendVarint(list.bytes, entry.second.size());
+            uint32_t previous = 0;
+            for (size_t i = 0; i < entry.second.size(); i++) {
+                appendVarint(list.bytes, entry.second[i] - previous);
+                previous = entry.second[i];
+            }
+            list.lastDoc = doc;
+            list.docs++;
+            postingBytes += list.bytes.size() - before;
+        }
+    }
+
+    // live postings of one term, in doc order
+    // positions are skipped over, not stored, unless asked for
+    vector<Posting> postings(const string& term, bool withPositions) {
+        vector<Posting> result;
+        auto found = terms.find(term);
+        if (found == terms.end()) {
+            return result;
+        }
+        const string& bytes = found->second.bytes;
+        size_t pos = 0;
+        uint32_t doc = 0;
+        for (uint32_t i = 0; i < found->second.docs; i++) {
+            doc = i == 0 ? readVarint(bytes, pos) : doc + readVarint(bytes, pos);
+            uint32_t count = readVarint(bytes, pos);
+            if (docs[doc] == nullptr || !withPositions) {
+                for (uint32_t p = 0; p < count; p++) {
+                    readVarint(bytes, pos);
+                }
+                if (docs[doc] != nullptr) {
+                    result.push_back(Posting{doc, vector<uint32_t>()});
+                }
+                continue;
+            }
+            Posting posting;
+            posting.doc = doc;
+            uint32_t position = 0;
+            for (uint32_t p = 0; p < count; p++) {
+                position += readVarint(bytes, pos);
+                posting.positions.push_back(position);
+            }
+            result.push_back(move(posting));
+        }
+        return result;
+    }
+
+    // docs where the words appear next to each other in order
+    // starts from the word in the fewest docs, so the candidate list is
+    // short from the beginning, and tracks where the phrase would start
+    vector<uint32_t> phraseDocs(const vector<string>& words) {
+        vector<uint32_t> result;
+        vector<size_t> order;
+        for (size_t w = 0; w < words.size(); w++) {
+            auto found = terms.find(words[w]);
+            if (found == terms.end()) {
+                return result;
+            }
+            order.push_back(w);
+        }
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return terms[words[a]].docs < terms[words[b]].docs;
+        });
+
+        bool single = words.size() == 1;
+        vector<Posting> current = postings(words[order[0]], !single);
+        for (size_t c = 0; c < current.size(); c++) {
+            // positions become phrase start positions
+            vector<uint32_t> starts;
+            for (size_t p = 0; p < current[c].positions.size(); p++) {
+                if (current[c].positions[p] >= order[0]) {
+                    starts.push_back(current[c].positions[p] - order[0]);
+                }
+            }
+            current[c].positions.swap(starts);
+        }
+
+        for (size_t k = 1; k < order.size() && current.size() > 0; k++) {
+            vector<Posting> next = postings(words[order[k]], true);
+            vector<Posting> kept;
+            size_t a = 0;
+            size_t b = 0;
+            while (a < current.size() && b < next.size()) {
+                if (current[a].doc < next[b].doc) {
+                    a++;
+                } else if (current[a].doc > next[b].doc) {
+                    b++;
+                } else {
+                    // starts where this word sits at its offset in the phrase
+                    Posting joined;
+                    joined.doc = current[a].doc;
+                    for (size_t p = 0; p < current[a].positions.size(); p++) {
+                        uint32_t at = current[a].positions[p] + order[k];
+                        if (binary_search(next[b].positions.begin(), next[b].positions.end(), at)) {
+                            joined.positions.push_back(current[a].positions[p]);
+                        }
+                    }
+                    if (joined.positions.size() > 0) {
+                        kept.push_back(move(joined));
+                    }
+                    a++;
+                    b++;
+                }
+            }
+            current.swap(kept);
+        }
+
+        for (size_t i = 0; i < current.size(); i++) {
+            result.push_back(current[i].doc);
+        }
+        return result;
+    }
+
+    static vector<uint32_t> intersect(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+        vector<uint32_t> result;
+        set_intersection(a.begin(), a.end(), b.begin(), b.end(), back_inserter(result));
+        return result;
+    }
+
+    static vector<uint32_t> subtract(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+        vector<uint32_t> result;
+        set_difference(a.begin(), a.end(), b.begin(), b.end(), back_inserter(result));
+        return result;
+    }
+
+    static vector<uint32_t> unite(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+        vector<uint32_t> result;
+        set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(result));
+        return result;
+    }
+
+    // rebuilds every list from the live files, dropping dead doc ids
+    void rebuild() {
+        vector<Node*> live;
+        for (size_t i = 0; i < docs.size(); i++) {
+            if (docs[i] != nullptr) {
+                live.push_back(docs[i]);
+            }
+        }
+        clear();
+        for (size_t i = 0; i < live.size(); i++) {
+            add(live[i]);
+        }
+    }
+
+public:
+    FullTextIndex() {
+        deadDocs = 0;
+        postingBytes = 0;
+    }
+
+    void clear() {
+        terms.clear();
+        docs.clear();
+        docOf.clear();
+        deadDocs = 0;
+        postingBytes = 0;
+    }
+
+    // (re)indexes a file after its content changed or it was created
+    void update(Node* node) {
+        remove(node);
+        add(node);
+    }
+
+    // forgets a file, call before it is deleted
+    void remove(Node* node) {
+        auto found = docOf.find(node);
+        if (found == docOf.end()) {
+            return;
+        }
+        docs[found->second] = nullptr;
+        docOf.erase(found);
+        deadDocs++;
+        if (deadDocs > 1000 && deadDocs > docOf.size()) {
+            rebuild();
+        }
+    }
+
+    // files matching a query, in the order they were (last) indexed
+    vector<Node*> search(const string& query) {
+        vector<uint32_t> result;
+        vector<uint32_t> group;
+        vector<uint32_t> excluded;
+        bool groupStarted = false;
+        bool groupEmpty = false;   // a term with no docs makes the whole group empty
+
+        auto require = [&](vector<uint32_t> docsWithTerm) {
+            group = groupStarted ? intersect(group, docsWithTerm) : docsWithTerm;
+            groupStarted = true;
+        };
+        auto finishGroup = [&]() {
+            if (groupStarted && !groupEmpty) {
+                result = unite(result, subtract(group, excluded));
+            }
+            group.clear();
+            excluded.clear();
+            groupStarted = false;
+            groupEmpty = false;
+        };
+
+        size_t i = 0;
+        while (i < query.length()) {
+            if (isspace((unsigned char)query[i])) {
+                i++;
+                continue;
+            }
+            bool negate = query[i] == '-';
+            if (negate) {
+                i++;
+            }
+
+            // one item: a "phrase" or a single word
+            string text;
+            bool phrase = i < query.length() && query[i] == '"';
+            if (phrase) {
+                size_t close = query.find('"', i + 1);
+                if (close == string::npos) {
+                    close = query.length();
+                }
+                text = query.substr(i + 1, close - i - 1);
+                i = close + 1;
+            } else {
+                size_t end = i;
+                while (end < query.length() && !isspace((unsigned char)query[end])) {
+                    end++;
+                }
+                text = query.substr(i, end - i);
+                i = end;
+            }
+
+            if (!phrase && !negate && text == "OR") {
+                finishGroup();
+                continue;
+            }
+
+            vector<string> words;
+            forEachTerm(text, [&](const string& term, uint32_t) {
+                words.push_back(term);
+            });
+            if (words.size() == 0) {
+                continue;
+            }
+            vector<uint32_t> matched = phraseDocs(words);
+            if (negate) {
+                excluded = unite(excluded, matched);
+            } else {
+                require(matched);
+                if (matched.size() == 0) {
+                    groupEmpty = true;
+                }
+            }
+        }
+        finishGroup();
+
+        vector<Node*> files;
+        for (size_t r = 0; r < result.size(); r++) {
+            files.push_back(docs[result[r]]);
+        }
+        return files;
+    }
+
+    size_t fileCount() {
+        return docOf.size();
+    }
+
+    size_t termCount() {
+        return terms.size();
+    }
+
+    // bytes of encoded postings, dead docs included
+    size_t postingsSize() {
+        return postingBytes;
+    }
+};
+
+#endif
@@ -0,0 +1,210 @@
+// Grep.h - parallel search of file contents
+//
+// the files are cut into chunks of roughly equal size. worker threads take
+// the next chunk from a shared counter and search each file with the
+// vectorized findSubstring. the calling thread hands finished chunks to the
+// callback in file order, so matches stream out in the same order as a
+// one-thread search would give, while the workers keep going.
+//
+// the tree must not change while a search runs. the workers only read it.
+
+#ifndef GREP_H
+#define GREP_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include "StringSearch.h"
+
+using namespace std;
+
+struct GrepMatch {
+    size_t file;       // index into the file list
+    size_t line;       // 1-based
+    string_view text;  // the line without its '\n', points into the file content
+};
+
+struct GrepStats {
+    size_t files;
+    size_t filesMatched;
+    size_t matches;
+    size_t bytes;
+    double seconds;
+
+    double gigabytesPerSecond() const {
+        return seconds > 0 ? bytes / seconds / 1e9 : 0;
+    }
+};
+
+template <typename Node>
+class ContentSearch {
+private:
+    struct Chunk {
+        size_t firstFile;
+        size_t endFile;
+        vector<GrepMatch> matches;
+        bool done;
+    };
+
+    const vector<Node*>& files;
+    string pattern;
+    vector<Chunk> chunks;
+    atomic<size_t> nextChunk;
+    mutex lock;
+    condition_variable chunkDone;
+
+    // every line of one file that contains the pattern
+    void searchFile(size_t index, vector<GrepMatch>& out) {
+        const string& content = files[index]->content;
+        const char* data = content.data();
+        size_t length = content.length();
+        size_t pos = 0;
+        size_t line = 1;
+        size_t counted = 0;   // newlines before this offset are already in 'line'
+
+        while (pos < length) {
+            size_t found = findSubstring(data + pos, length - pos, pattern.data(), pattern.length());
+            if (found == length - pos) {
+                break;
+            }
+            size_t at = pos + found;
+            size_t lineStart = at;
+            while (lineStart > counted && data[lineStart - 1] != '\n') {
+                lineStart--;
+            }
+            line += count(data + counted, data + lineStart, '\n');
+            const char* newline = (const char*)memchr(data + at, '\n', length - at);
+            size_t lineEnd = newline == nullptr ? length : newline - data;
+
+            GrepMatch match;
+            match.file = index;
+            match.line = line;
+            match.text = string_view(data + lineStart, lineEnd - lineStart);
+            out.push_back(match);
+
+            // one report per line, go on from the next line
+            line++;
+            counted = lineEnd + 1;
+            pos = lineEnd + 1;
+        }
+    }
+
+    void worker() {
+        while (true) {
+            size_t c = nextChunk.fetch_add(1);
+            if (c >= chunks.size()) {
+                return;
+            }
+            vector<GrepMatch> found;
+            for (size_t f = chunks[c].firstFile; f < chunks[c].endFile; f++) {
+                searchFile(f, found);
+            }
+            lock_guard<mutex> guard(lock);
+            chunks[c].matches.swap(found);
+            chunks[c].done = true;
+            chunkDone.notify_all();
+        }
+    }
+
+public:
+    ContentSearch(const vector<Node*>& fileList, string text) : files(fileList) {
+        pattern = text;
+        nextChunk = 0;
+    }
+
+    // calls onMatch for every matching line, in file order
+    // threads = 0 means one per hardware thread
+    GrepStats run(int threads, function<void(const GrepMatch&)> onMatch) {
+        auto start = chrono::steady_clock::now();
+        GrepStats stats;
+        stats.files = files.size();
+        stats.filesMatched = 0;
+        stats.matches = 0;
+        stats.bytes = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            stats.bytes += files[i]->content.length();
+        }
+
+        if (threads <= 0) {
+            threads = thread::hardware_concurrency();
+        }
+        if (threads <= 0) {
+            threads = 1;   // hardware_concurrency() may not know
+        }
+        // small chunks keep threads busy to the end, but not too small:
+        // each one costs a lock and a wakeup
+        size_t chunkBytes = stats.bytes / (threads * 8) + 1;
+        if (chunkBytes < 256 * 1024) {
+            chunkBytes = 256 * 1024;
+        }
+        size_t first = 0;
+        size_t bytes = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            bytes += files[i]->content.length() + 64;   // + per-file overhead
+            if (bytes >= chunkBytes || i + 1 == files.size()) {
+                chunks.push_back(Chunk{first, i + 1, vector<GrepMatch>(), false});
+                first = i + 1;
+                bytes = 0;
+            }
+        }
+        if (threads > chunks.size()) {
+            threads = chunks.size();
+        }
+
+        // with one thread the caller does the work itself, otherwise it
+        // only passes results on
+        vector<thread> pool;
+        try {
+            if (threads <= 1) {
+                worker();
+            } else {
+                for (int t = 0; t < threads; t++) {
+                    pool.push_back(thread(&ContentSearch::worker, this));
+                }
+            }
+
+            // hand out results in order as chunks finish
+            size_t lastFile = (size_t)-1;
+            for (size_t c = 0; c < chunks.size(); c++) {
+                vector<GrepMatch> ready;
+                {
+                    unique_lock<mutex> guard(lock);
+                    chunkDone.wait(guard, [&]() { return chunks[c].done; });
+                    ready.swap(chunks[c].matches);
+                }
+                for (size_t m = 0; m < ready.size(); m++) {
+                    if (ready[m].file != lastFile) {
+                        stats.filesMatched++;
+                        lastFile = ready[m].file;
+                    }
+                    stats.matches++;
+                    onMatch(ready[m]);
+                }
+            }
+        } catch (...) {
+            // onMatch threw or a thread couldn't start: hand out no more
+            // chunks and let the workers finish before passing it on
+            nextChunk = chunks.size();
+            for (size_t t = 0; t < pool.size(); t++) {
+                pool[t].join();
+            }
+            throw;
+        }
+
+        for (size_t t = 0; t < pool.size(); t++) {
+            pool[t].join();
+        }
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+// Histogram.h - HDR-style latency histogram
+// values are bucketed log-linearly: every power of two is split into 16
+// sub-buckets, so any recorded value is within ~6% of its bucket bounds
+// and recording is a couple of shifts plus one increment
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <cstring>
+
+class Histogram {
+public:
+    static const int subBuckets = 16;
+    static const int bucketCount = (64 - 3) * subBuckets;
+
+private:
+    uint64_t counts[bucketCount];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t maxValue;
+
+public:
+    // bucket a value lands in
+    static int bucketFor(uint64_t value) {
+        if (value < subBuckets) {
+            return value;
+        }
+        int bits = 63 - __builtin_clzll(value);              // >= 4
+        int sub = (value >> (bits - 4)) & (subBuckets - 1);
+        return (bits - 3) * subBuckets + sub;
+    }
+
+    // largest value that lands in a bucket
+    static uint64_t bucketTop(int index) {
+        if (index < subBuckets) {
+            return index;
+        }
+        int bits = index / subBuckets + 3;
+        uint64_t sub = index % subBuckets;
+        uint64_t low = (uint64_t(1) << bits) | (sub << (bits - 4));
+        return low + (uint64_t(1) << (bits - 4)) - 1;
+    }
+
+    Histogram() {
+        clear();
+    }
+
+    void clear() {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+        sum = 0;
+        maxValue = 0;
+    }
+
+    void record(uint64_t value) {
+        counts[bucketFor(value)]++;
+        total++;
+        sum += value;
+        if (value > maxValue) {
+            maxValue = value;
+        }
+    }
+
+    // adds counts gathered elsewhere, e.g. from per-thread atomic buckets
+    void addBucket(int index, uint64_t count) {
+        counts[index] += count;
+        total += count;
+    }
+
+    void addTotals(uint64_t addSum, uint64_t newMax) {
+        sum += addSum;
+        if (newMax > maxValue) {
+            maxValue = newMax;
+        }
+    }
+
+    void merge(const Histogram& other) {
+        for (int i = 0; i < bucketCount; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        if (other.maxValue > maxValue) {
+            maxValue = other.maxValue;
+        }
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t getSum() const {
+        return sum;
+    }
+
+    uint64_t max() const {
+        return maxValue;
+    }
+
+    double mean() const {
+        return total == 0 ? 0 : (double)sum / total;
+    }
+
+    // value at a percentile (0-100), reported as its bucket's upper bound
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p / 100.0 * total);
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < bucketCount; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                uint64_t top = bucketTop(i);
+                return top < maxValue ? top : maxValue;
+            }
+        }
+        return maxValue;
+    }
+
+    // number of values recorded at or below 'value' (rounded to bucket bounds)
+    uint64_t countAtOrBelow(uint64_t value) const {
+        int last = bucketFor(value);
+        uint64_t seen = 0;
+        for (int i = 0; i <= last; i++) {
+            seen += counts[i];
+        }
+        return seen;
+    }
+};
+
+#endif
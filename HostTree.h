@@ -0,0 +1,563 @@
+// HostTree.h - reading and writing directory trees on the host's disk
+//
+// HostTreeReader walks a real directory with a pool of worker threads.
+// folders wait in a shared queue; a worker takes one, lists it with raw
+// getdents64 calls into a 64 KB buffer, queues the folders it finds and
+// reads the regular files itself, opening each with openat on the
+// folder's descriptor so no path is resolved twice. small files are read
+// with one read() of their whole size, large ones are mmapped and copied
+// out in one go. each worker collects into its own list, so the only
+// shared state is the folder queue.
+//
+// symlinks, devices, sockets and anything unreadable are skipped and
+// counted, not followed or treated as errors.
+//
+// HostTreeWriter goes the other way: folders are made first, in tree
+// order, then worker threads take files from a shared counter and write
+// each with one write() of its whole content straight from the tree.
+// TarWriter streams the same entries into one ustar archive instead,
+// through a 1 MB buffer, with pax records for long paths and big files.
+
+#ifndef HOSTTREE_H
+#define HOSTTREE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <string_view>
+#include <cstdio>
+
+using namespace std;
+
+class HostIOException : public runtime_error {
+public:
+    HostIOException(string msg)
+        : runtime_error("Host I/O error: " + msg + " (" + strerror(errno) + ")") {}
+};
+
+// one folder or file found on the host
+struct HostEntry {
+    string path;        // relative to the top folder, "a/b.txt"
+    string content;
+    bool isDirectory;
+    time_t modified;
+};
+
+// one folder or file to write out, content points into the tree
+struct HostOutEntry {
+    string path;        // relative to the target, "a/b.txt"
+    string_view content;
+    bool isDirectory;
+    time_t modified;
+};
+
+struct HostTreeStats {
+    size_t files;
+    size_t dirs;
+    size_t skipped;
+    uint64_t bytes;
+    double seconds;
+
+    double filesPerSecond() const {
+        return seconds > 0 ? files / seconds : 0;
+    }
+
+    double megabytesPerSecond() const {
+        return seconds > 0 ? bytes / seconds / 1e6 : 0;
+    }
+};
+
+class HostTreeReader {
+private:
+    // the kernel's record layout, getdents64 isn't wrapped by every libc
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    struct Job {
+        string hostPath;
+        string treePath;   // "" for the top folder
+    };
+
+    static const size_t direntBufferSize = 64 * 1024;
+    static const size_t mmapThreshold = 1024 * 1024;
+
+    mutex lock;
+    condition_variable changed;
+    deque<Job> jobs;
+    size_t pending;   // folders queued or being read
+
+    struct Worker {
+        vector<HostEntry> found;
+        HostTreeStats stats;
+    };
+    vector<Worker> workers;
+
+    void work(Worker& worker) {
+        vector<char> buffer(direntBufferSize);
+        while (true) {
+            Job job;
+            {
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [&]() {
+                    return jobs.size() > 0 || pending == 0;
+                });
+                if (jobs.size() == 0) {
+                    return;
+                }
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+
+            vector<Job> subfolders;
+            readFolder(job, worker, buffer, subfolders);
+
+            lock_guard<mutex> guard(lock);
+            pending += subfolders.size();
+            pending--;
+            for (size_t i = 0; i < subfolders.size(); i++) {
+                jobs.push_back(move(subfolders[i]));
+            }
+            changed.notify_all();
+        }
+    }
+
+    void readFolder(const Job& job, Worker& worker, vector<char>& buffer, vector<Job>& subfolders) {
+        int dirFd = open(job.hostPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            worker.stats.skipped++;
+            return;
+        }
+        string prefix = job.treePath == "" ? "" : job.treePath + "/";
+        while (true) {
+            long n = syscall(SYS_getdents64, dirFd, buffer.data(), buffer.size());
+            if (n <= 0) {
+                break;
+            }
+            for (long offset = 0; offset < n;) {
+                LinuxDirent64* entry = (LinuxDirent64*)(buffer.data() + offset);
+                offset += entry->d_reclen;
+                const char* name = entry->d_name;
+                if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                    continue;
+                }
+
+                unsigned char type = entry->d_type;
+                if (type == DT_UNKNOWN) {
+                    // some file systems don't fill d_type in
+                    struct stat info;
+                    if (fstatat(dirFd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                        worker.stats.skipped++;
+                        continue;
+                    }
+                    type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_LNK;
+                }
+
+                if (type == DT_DIR) {
+                    HostEntry folder;
+                    folder.path = prefix + name;
+                    folder.isDirectory = true;
+                    folder.modified = 0;
+                    worker.found.push_back(move(folder));
+                    worker.stats.dirs++;
+                    subfolders.push_back(Job{job.hostPath + "/" + name, prefix + name});
+                } else if (type == DT_REG) {
+                    HostEntry file;
+                    file.path = prefix + name;
+                    file.isDirectory = false;
+                    if (readFile(dirFd, name, file)) {
+                        worker.stats.files++;
+                        worker.stats.bytes += file.content.length();
+                        worker.found.push_back(move(file));
+                    } else {
+                        worker.stats.skipped++;
+                    }
+                } else {
+                    worker.stats.skipped++;
+                }
+            }
+        }
+        close(dirFd);
+    }
+
+    // reads a whole regular file into file.content, false if it can't be
+    static bool readFile(int dirFd, const char* name, HostEntry& file) {
+        int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            close(fd);
+            return false;
+        }
+        file.modified = info.st_mtime;
+        size_t size = info.st_size;
+
+        bool ok = true;
+        if (size >= mmapThreshold) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ok = false;
+            } else {
+                madvise(mapped, size, MADV_SEQUENTIAL);
+                file.content.assign((const char*)mapped, size);
+                munmap(mapped, size);
+            }
+        } else {
+            // one read normally does it; loop for short reads and a file
+            // that shrank since fstat
+            file.content.resize(size);
+            size_t done = 0;
+            while (done < size) {
+                ssize_t n = ::read(fd, &file.content[done], size - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    ok = n == 0;
+                    break;
+                }
+                done += n;
+            }
+            file.content.resize(done);
+        }
+        close(fd);
+        return ok;
+    }
+
+public:
+    HostTreeReader() {
+        pending = 0;
+    }
+
+    // everything under hostDir, in no particular order
+    // threads = 0 means one per hardware thread
+    vector<HostEntry> read(const string& hostDir, int threads, HostTreeStats& stats) {
+        auto start = chrono::steady_clock::now();
+        int topFd = open(hostDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (topFd < 0) {
+            throw HostIOException("cannot read folder " + hostDir);
+        }
+        close(topFd);
+        if (threads <= 0) {
+            threads = thread::hardware_concurrency();
+        }
+        if (threads <= 0) {
+            threads = 1;
+        }
+
+        jobs.push_back(Job{hostDir, ""});
+        pending = 1;
+        workers.assign(threads, Worker());
+        for (int w = 0; w < threads; w++) {
+            workers[w].stats = HostTreeStats{0, 0, 0, 0, 0};
+        }
+        vector<thread> pool;
+        for (int w = 1; w < threads; w++) {
+            pool.push_back(thread([this, w]() {
+                work(workers[w]);
+            }));
+        }
+        work(workers[0]);
+        for (size_t t = 0; t < pool.size(); t++) {
+            pool[t].join();
+        }
+
+        vector<HostEntry> found;
+        stats = HostTreeStats{0, 0, 0, 0, 0};
+        size_t total = 0;
+        for (int w = 0; w < threads; w++) {
+            total += workers[w].found.size();
+        }
+        found.reserve(total);
+        for (int w = 0; w < threads; w++) {
+            for (size_t i = 0; i < workers[w].found.size(); i++) {
+                found.push_back(move(workers[w].found[i]));
+            }
+            stats.files += workers[w].stats.files;
+            stats.dirs += workers[w].stats.dirs;
+            stats.skipped += workers[w].stats.skipped;
+            stats.bytes += workers[w].stats.bytes;
+        }
+        workers.clear();
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return found;
+    }
+};
+
+class HostTreeWriter {
+private:
+    int topFd;
+    atomic<size_t> nextEntry;
+    mutex lock;
+    string failedPath;   // first failure, reported after the workers stop
+    int failedErrno;
+
+    void fail(const string& path) {
+        lock_guard<mutex> guard(lock);
+        if (failedPath == "") {
+            failedPath = path;
+            failedErrno = errno;
+        }
+    }
+
+    void work(const vector<HostOutEntry>& entries) {
+        while (true) {
+            size_t e = nextEntry.fetch_add(1);
+            if (e >= entries.size()) {
+                return;
+            }
+            const HostOutEntry& entry = entries[e];
+            if (entry.isDirectory) {
+                continue;
+            }
+            int fd = openat(topFd, entry.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0644);
+            if (fd < 0) {
+                fail(entry.path);
+                continue;
+            }
+            size_t done = 0;
+            while (done < entry.content.length()) {
+                ssize_t n = ::write(fd, entry.content.data() + done, entry.content.length() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    fail(entry.path);
+                    break;
+                }
+                done += n;
+            }
+            struct timespec times[2] = {{0, UTIME_OMIT}, {entry.modified, 0}};
+            futimens(fd, times);
+            if (close(fd) != 0) {
+                fail(entry.path);
+            }
+        }
+    }
+
+public:
+    // writes entries under hostDir, which is made if missing. folders must
+    // come before what is in them, as a tree walk gives them. files that
+    // are already there are overwritten. threads = 0 means one per
+    // hardware thread
+    void write(const string& hostDir, const vector<HostOutEntry>& entries, int threads, HostTreeStats& stats) {
+        auto start = chrono::steady_clock::now();
+        stats = HostTreeStats{0, 0, 0, 0, 0};
+        if (mkdir(hostDir.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw HostIOException("cannot make folder " + hostDir);
+        }
+        topFd = open(hostDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (topFd < 0) {
+            throw HostIOException("cannot open folder " + hostDir);
+        }
+
+        for (size_t e = 0; e < entries.size(); e++) {
+            if (entries[e].isDirectory) {
+                if (mkdirat(topFd, entries[e].path.c_str(), 0755) != 0 && errno != EEXIST) {
+                    close(topFd);
+                    throw HostIOException("cannot make folder " + entries[e].path);
+                }
+                stats.dirs++;
+            } else {
+                stats.files++;
+                stats.bytes += entries[e].content.length();
+            }
+        }
+
+        if (threads <= 0) {
+            threads = thread::hardware_concurrency();
+        }
+        if (threads <= 0) {
+            threads = 1;
+        }
+        nextEntry = 0;
+        failedPath = "";
+        vector<thread> pool;
+        for (int w = 1; w < threads; w++) {
+            pool.push_back(thread([&]() {
+                work(entries);
+            }));
+        }
+        work(entries);
+        for (size_t t = 0; t < pool.size(); t++) {
+            pool[t].join();
+        }
+
+        // writing files touched their folders, so folder times go last,
+        // deepest first
+        for (size_t e = entries.size(); e > 0; e--) {
+            if (entries[e - 1].isDirectory) {
+                struct timespec times[2] = {{0, UTIME_OMIT}, {entries[e - 1].modified, 0}};
+                utimensat(topFd, entries[e - 1].path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+            }
+        }
+        close(topFd);
+        if (failedPath != "") {
+            errno = failedErrno;
+            throw HostIOException("cannot write " + failedPath);
+        }
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+};
+
+// a ustar archive written front to back to a file descriptor
+class TarWriter {
+private:
+    static const size_t blockSize = 512;
+    static const size_t bufferSize = 1024 * 1024;
+
+    int fd;
+    string buffer;
+
+    void writeAll(const char* data, size_t length) {
+        size_t done = 0;
+        while (done < length) {
+            ssize_t n = ::write(fd, data + done, length - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw HostIOException("cannot write archive");
+            }
+            done += n;
+        }
+    }
+
+    void flush() {
+        writeAll(buffer.data(), buffer.length());
+        buffer.clear();
+    }
+
+    void append(const char* data, size_t length) {
+        if (buffer.length() + length > bufferSize) {
+            flush();
+        }
+        if (length >= bufferSize) {
+            writeAll(data, length);   // a big file goes out in one write, uncopied
+            return;
+        }
+        buffer.append(data, length);
+    }
+
+    void pad(size_t length) {
+        static const char zeros[blockSize] = {};
+        if (length % blockSize != 0) {
+            append(zeros, blockSize - length % blockSize);
+        }
+    }
+
+    // value as octal digits filling width - 1 bytes, then a NUL
+    static void octal(char* field, size_t width, uint64_t value) {
+        for (size_t i = width - 1; i > 0; i--) {
+            field[i - 1] = '0' + (value & 7);
+            value >>= 3;
+        }
+        field[width - 1] = '\0';
+    }
+
+    void header(const string& name, const string& prefix, char type, uint64_t size, time_t modified) {
+        char block[blockSize] = {};
+        memcpy(block, name.data(), min(name.length(), (size_t)100));
+        octal(block + 100, 8, type == '5' ? 0755 : 0644);
+        octal(block + 108, 8, 0);
+        octal(block + 116, 8, 0);
+        octal(block + 124, 12, size);
+        octal(block + 136, 12, modified > 0 ? modified : 0);
+        memset(block + 148, ' ', 8);
+        block[156] = type;
+        memcpy(block + 257, "ustar", 6);
+        memcpy(block + 263, "00", 2);
+        memcpy(block + 345, prefix.data(), min(prefix.length(), (size_t)155));
+        unsigned sum = 0;
+        for (size_t i = 0; i < blockSize; i++) {
+            sum += (unsigned char)block[i];
+        }
+        octal(block + 148, 7, sum);   // six digits, NUL, and the space already there
+        append(block, blockSize);
+    }
+
+    // "<length> key=value\n", the length counting its own digits
+    static string paxRecord(const string& key, const string& value) {
+        size_t body = key.length() + value.length() + 3;   // space, '=', newline
+        size_t length = body + 1;
+        while (to_string(length).length() + body != length) {
+            length = to_string(length).length() + body;
+        }
+        return to_string(length) + " " + key + "=" + value + "\n";
+    }
+
+public:
+    explicit TarWriter(int out) {
+        fd = out;
+        buffer.reserve(bufferSize);
+    }
+
+    void add(const HostOutEntry& entry) {
+        string path = entry.isDirectory ? entry.path + "/" : entry.path;
+        uint64_t size = entry.isDirectory ? 0 : entry.content.length();
+
+        // ustar holds 100 bytes of name plus 155 of prefix split at a '/',
+        // and sizes under 8 GB; anything else needs a pax record first
+        string name = path;
+        string prefix;
+        if (path.length() > 100) {
+            size_t slash = path.find('/', path.length() > 101 ? path.length() - 101 : 0);
+            if (slash != string::npos && slash <= 155 && path.length() - slash - 1 <= 100 && slash > 0) {
+                prefix = path.substr(0, slash);
+                name = path.substr(slash + 1);
+            }
+        }
+        bool longPath = path.length() > 100 && prefix == "";
+        bool bigFile = size > 077777777777ULL;
+        if (longPath || bigFile) {
+            string records;
+            if (longPath) {
+                records += paxRecord("path", path);
+                name = path.substr(0, 99);
+            }
+            if (bigFile) {
+                records += paxRecord("size", to_string(size));
+            }
+            header("PaxHeaders/" + name.substr(0, 89), "", 'x', records.length(), entry.modified);
+            append(records.data(), records.length());
+            pad(records.length());
+        }
+
+        header(name, prefix, entry.isDirectory ? '5' : '0', bigFile ? 0 : size, entry.modified);
+        if (size > 0) {
+            append(entry.content.data(), size);
+            pad(size);
+        }
+    }
+
+    // the two empty blocks that end an archive
+    void finish() {
+        static const char zeros[2 * blockSize] = {};
+        append(zeros, sizeof(zeros));
+        flush();
+    }
+};
+
+#endif
@@ -0,0 +1,323 @@
+// Metrics.h - per-operation counters and latency histograms for FileSystem
+//
+// every public FileSystem method starts an OpTimer. each thread writes only
+// to its own ThreadMetrics (relaxed atomics, no locks, no shared cache
+// lines), calls and errors are always counted and 1 in every sampleEvery
+// calls is timed with steady_clock. readers sum all threads on demand.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <exception>
+#include <cstdint>
+#include <cstdio>
+#include "Histogram.h"
+#include "Trace.h"
+
+using namespace std;
+
+enum MetricOp {
+    MET_CREATE_FILE,
+    MET_CREATE_DIR,
+    MET_BULK_LOAD,
+    MET_IMPORT_HOST,
+    MET_EXPORT_HOST,
+    MET_EXPORT_TAR,
+    MET_CHANGE_DIR,
+    MET_LIST_DIR,
+    MET_LIST_PAGE,
+    MET_WRITE_FILE,
+    MET_READ_FILE,
+    MET_DELETE_FILE,
+    MET_SEARCH_FILE,
+    MET_SEARCH_GLOB,
+    MET_SEARCH_REGEX,
+    MET_FIND_FILES,
+    MET_FILE_INFO,
+    MET_GET_PATH,
+    MET_SET_PATH,
+    MET_DISPLAY_STATS,
+    MET_GET_MEMORY_USAGE,
+    MET_DISPLAY_MEMORY,
+    MET_COMPACT,
+    MET_GREP,
+    MET_TEXT_INDEX,
+    MET_SEARCH_TEXT,
+    MET_ATTRIBUTE_INDEX,
+    MET_TOP_FILES,
+    MET_UNDO,
+    MET_REDO,
+    MET_OP_COUNT
+};
+
+const char* const metricOpNames[MET_OP_COUNT] = {
+    "createFile", "createDirectory", "bulkLoad", "importHost", "exportHost",
+    "exportTar", "changeDirectory", "listDirectory", "listPage",
+    "writeFile", "readFile", "deleteFile", "searchFile", "searchGlob", "searchRegex", "findFiles", "fileInfo", "getCurrentPath",
+    "setCurrentPath", "displayStats", "getMemoryUsage", "displayMemory", "compact", "grep", "setTextIndex", "searchText", "setAttributeIndex", "topFiles", "undo", "redo"
+};
+
+// one thread's counters, only that thread ever writes them
+struct ThreadMetrics {
+    atomic<uint64_t> calls[MET_OP_COUNT];
+    atomic<uint64_t> errors[MET_OP_COUNT];
+    atomic<uint64_t> timedSum[MET_OP_COUNT];
+    atomic<uint64_t> timedMax[MET_OP_COUNT];
+    atomic<uint64_t> buckets[MET_OP_COUNT][Histogram::bucketCount];
+
+    ThreadMetrics() {
+        reset();
+    }
+
+    void reset() {
+        for (int op = 0; op < MET_OP_COUNT; op++) {
+            calls[op].store(0, memory_order_relaxed);
+            errors[op].store(0, memory_order_relaxed);
+            timedSum[op].store(0, memory_order_relaxed);
+            timedMax[op].store(0, memory_order_relaxed);
+            for (int b = 0; b < Histogram::bucketCount; b++) {
+                buckets[op][b].store(0, memory_order_relaxed);
+            }
+        }
+    }
+
+    // single writer, so a load + store is enough and avoids a locked add
+    static void bump(atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+    void recordTime(int op, uint64_t ns) {
+        bump(buckets[op][Histogram::bucketFor(ns)], 1);
+        bump(timedSum[op], ns);
+        if (ns > timedMax[op].load(memory_order_relaxed)) {
+            timedMax[op].store(ns, memory_order_relaxed);
+        }
+    }
+};
+
+// totals for one op across every thread
+struct OpSnapshot {
+    uint64_t calls;
+    uint64_t errors;
+    Histogram latency;   // nanoseconds, sampled calls only
+};
+
+class MetricsRegistry {
+private:
+    mutex lock;
+    vector<ThreadMetrics*> live;
+    ThreadMetrics retired;        // totals from threads that have exited
+    atomic<uint32_t> sampleEvery;
+
+    static void addInto(ThreadMetrics& from, ThreadMetrics& to) {
+        for (int op = 0; op < MET_OP_COUNT; op++) {
+            ThreadMetrics::bump(to.calls[op], from.calls[op].load(memory_order_relaxed));
+            ThreadMetrics::bump(to.errors[op], from.errors[op].load(memory_order_relaxed));
+            ThreadMetrics::bump(to.timedSum[op], from.timedSum[op].load(memory_order_relaxed));
+            uint64_t m = from.timedMax[op].load(memory_order_relaxed);
+            if (m > to.timedMax[op].load(memory_order_relaxed)) {
+                to.timedMax[op].store(m, memory_order_relaxed);
+            }
+            for (int b = 0; b < Histogram::bucketCount; b++) {
+                ThreadMetrics::bump(to.buckets[op][b], from.buckets[op][b].load(memory_order_relaxed));
+            }
+        }
+    }
+
+    static void addInto(ThreadMetrics& from, vector<OpSnapshot>& to) {
+        for (int op = 0; op < MET_OP_COUNT; op++) {
+            to[op].calls += from.calls[op].load(memory_order_relaxed);
+            to[op].errors += from.errors[op].load(memory_order_relaxed);
+            for (int b = 0; b < Histogram::bucketCount; b++) {
+                uint64_t count = from.buckets[op][b].load(memory_order_relaxed);
+                if (count > 0) {
+                    to[op].latency.addBucket(b, count);
+                }
+            }
+            to[op].latency.addTotals(from.timedSum[op].load(memory_order_relaxed),
+                                     from.timedMax[op].load(memory_order_relaxed));
+        }
+    }
+
+public:
+    MetricsRegistry() {
+        sampleEvery = 16;
+    }
+
+    void add(ThreadMetrics* metrics) {
+        lock_guard<mutex> guard(lock);
+        live.push_back(metrics);
+    }
+
+    // keeps an exiting thread's numbers
+    void remove(ThreadMetrics* metrics) {
+        lock_guard<mutex> guard(lock);
+        addInto(*metrics, retired);
+        for (int i = 0; i < live.size(); i++) {
+            if (live[i] == metrics) {
+                live.erase(live.begin() + i);
+                break;
+            }
+        }
+    }
+
+    vector<OpSnapshot> snapshot() {
+        vector<OpSnapshot> result(MET_OP_COUNT);
+        for (int op = 0; op < MET_OP_COUNT; op++) {
+            result[op].calls = 0;
+            result[op].errors = 0;
+        }
+        lock_guard<mutex> guard(lock);
+        addInto(retired, result);
+        for (int i = 0; i < live.size(); i++) {
+            addInto(*live[i], result);
+        }
+        return result;
+    }
+
+    // counts updated by other threads while this runs may survive the reset
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        retired.reset();
+        for (int i = 0; i < live.size(); i++) {
+            live[i]->reset();
+        }
+    }
+
+    // time 1 in n calls, n is rounded down to a power of two
+    void setSampleEvery(uint32_t n) {
+        uint32_t power = 1;
+        while (power * 2 <= n && power < (1u << 30)) {
+            power = power * 2;
+        }
+        sampleEvery = power;
+    }
+
+    uint32_t getSampleEvery() {
+        return sampleEvery.load(memory_order_relaxed);
+    }
+};
+
+inline MetricsRegistry& metricsRegistry() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+// registers the thread's metrics on first use and folds them into the
+// registry when the thread exits
+struct ThreadMetricsHandle {
+    ThreadMetrics* metrics;
+
+    ThreadMetricsHandle() {
+        metrics = new ThreadMetrics();
+        metricsRegistry().add(metrics);
+    }
+
+    ~ThreadMetricsHandle() {
+        metricsRegistry().remove(metrics);
+        delete metrics;
+    }
+};
+
+inline ThreadMetrics& threadMetrics() {
+    static thread_local ThreadMetricsHandle handle;
+    return *handle.metrics;
+}
+
+// counts one call of a FileSystem method, times it if sampled, and counts
+// it as an error if it ends by throwing. also emits a trace event for the
+// call when tracing is on
+class OpTimer {
+private:
+    TraceScope trace;
+    ThreadMetrics& metrics;
+    int op;
+    int exceptionsAtStart;
+    bool timed;
+    chrono::steady_clock::time_point start;
+
+public:
+    OpTimer(MetricOp o) : trace(metricOpNames[o], "op"), metrics(threadMetrics()) {
+        op = o;
+        exceptionsAtStart = uncaught_exceptions();
+        uint64_t call = metrics.calls[op].load(memory_order_relaxed);
+        ThreadMetrics::bump(metrics.calls[op], 1);
+        timed = (call & (metricsRegistry().getSampleEvery() - 1)) == 0;
+        if (timed) {
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    ~OpTimer() {
+        if (timed) {
+            uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now() - start).count();
+            metrics.recordTime(op, ns);
+        }
+        if (uncaught_exceptions() > exceptionsAtStart) {
+            ThreadMetrics::bump(metrics.errors[op], 1);
+        }
+    }
+};
+
+// human readable table of every op that has been called
+inline void printMetrics(ostream& out) {
+    vector<OpSnapshot> ops = metricsRegistry().snapshot();
+    char line[160];
+    out << "\n--- Operation Metrics (1 in " << metricsRegistry().getSampleEvery() << " calls timed) ---\n";
+    snprintf(line, sizeof(line), "%-16s %10s %8s %10s %10s %10s %10s\n",
+             "operation", "calls", "errors", "p50 us", "p99 us", "max us", "mean us");
+    out << line;
+    for (int op = 0; op < MET_OP_COUNT; op++) {
+        if (ops[op].calls == 0) {
+            continue;
+        }
+        Histogram& h = ops[op].latency;
+        snprintf(line, sizeof(line), "%-16s %10llu %8llu %10.2f %10.2f %10.2f %10.2f\n",
+                 metricOpNames[op], (unsigned long long)ops[op].calls,
+                 (unsigned long long)ops[op].errors, h.percentile(50) / 1000.0,
+                 h.percentile(99) / 1000.0, h.max() / 1000.0, h.mean() / 1000.0);
+        out << line;
+    }
+    out << "\n";
+}
+
+// Prometheus text exposition format
+inline void writePrometheus(ostream& out) {
+    vector<OpSnapshot> ops = metricsRegistry().snapshot();
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    out << "# HELP filesystem_op_calls_total Calls to each FileSystem operation.\n";
+    out << "# TYPE filesystem_op_calls_total counter\n";
+    for (int op = 0; op < MET_OP_COUNT; op++) {
+        out << "filesystem_op_calls_total{op=\"" << metricOpNames[op] << "\"} " << ops[op].calls << "\n";
+    }
+
+    out << "# HELP filesystem_op_errors_total Calls that ended with an exception.\n";
+    out << "# TYPE filesystem_op_errors_total counter\n";
+    for (int op = 0; op < MET_OP_COUNT; op++) {
+        out << "filesystem_op_errors_total{op=\"" << metricOpNames[op] << "\"} " << ops[op].errors << "\n";
+    }
+
+    out << "# HELP filesystem_op_latency_seconds Latency of sampled calls.\n";
+    out << "# TYPE filesystem_op_latency_seconds summary\n";
+    for (int op = 0; op < MET_OP_COUNT; op++) {
+        Histogram& h = ops[op].latency;
+        for (int q = 0; q < 4; q++) {
+            out << "filesystem_op_latency_seconds{op=\"" << metricOpNames[op] << "\",quantile=\""
+                << quantiles[q] << "\"} " << h.percentile(quantiles[q] * 100) / 1e9 << "\n";
+        }
+        out << "filesystem_op_latency_seconds_sum{op=\"" << metricOpNames[op] << "\"} "
+            << h.getSum() / 1e9 << "\n";
+        out << "filesystem_op_latency_seconds_count{op=\"" << metricOpNames[op] << "\"} "
+            << h.count() << "\n";
+    }
+}
+
+#endif
@@ -0,0 +1,561 @@
+// NamePattern.h - glob and regex name patterns compiled to a DFA
+//
+// a pattern is parsed once into an NFA (Thompson construction) and turned
+// into a DFA by subset construction. bytes that every NFA edge treats the
+// same share one column of the transition table, so a table row is only a
+// few entries wide. matching is then one table lookup per byte, with no
+// backtracking, whatever the pattern.
+//
+// state 0 is the dead state: once reached nothing can match any more. a
+// walk that feeds a folder's path into the DFA can skip the whole folder
+// when it lands there, which is how path patterns prune the tree.
+//
+// regex: literals, ., [a-z] and [^...], \d \w \s \D \W \S, * + ?, |, ( ),
+// ^ at the start and $ at the end of a top-level branch, which anchor only
+// that branch as in other regex engines. without them it matches anywhere.
+// glob: * and ? (not across '/'), ** (across '/'), [abc] and [!abc],
+// always matches the whole string.
+
+#ifndef NAMEPATTERN_H
+#define NAMEPATTERN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <bitset>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+using namespace std;
+
+class InvalidPatternException : public runtime_error {
+public:
+    InvalidPatternException(string msg)
+        : runtime_error("Invalid pattern: " + msg) {}
+};
+
+enum PatternKind { PATTERN_GLOB, PATTERN_REGEX };
+
+class NamePattern {
+public:
+    static constexpr uint32_t deadState = 0;
+    static constexpr size_t maxStates = 4096;
+
+    NamePattern(string text, PatternKind kind) {
+        source = text;
+        // a pattern with a '/' is matched against the whole path
+        pathPattern = text.find('/') != string::npos;
+        if (kind == PATTERN_GLOB) {
+            compile(globToRegex(text));
+        } else {
+            compile(text);
+        }
+    }
+
+    uint32_t start() const {
+        return startState;
+    }
+
+    uint32_t step(uint32_t state, unsigned char c) const {
+        return table[state * classCount + byteClass[c]];
+    }
+
+    // feeds bytes into the DFA, stops early in the dead state
+    uint32_t run(uint32_t state, const char* text, size_t length) const {
+        for (size_t i = 0; i < length && state != deadState; i++) {
+            state = table[state * classCount + byteClass[(unsigned char)text[i]]];
+        }
+        return state;
+    }
+
+    bool accepts(uint32_t state) const {
+        return accepting[state];
+    }
+
+    bool matches(string_view text) const {
+        return accepting[run(startState, text.data(), text.length())];
+    }
+
+    // true when the pattern has a '/' and should see paths like /a/b/x.log
+    bool isPathPattern() const {
+        return pathPattern;
+    }
+
+    // a string every match contains, "" when there is none worth using
+    // lets callers cut the candidates down with a substring search first
+    const string& requiredLiteral() const {
+        return literal;
+    }
+
+    const string& text() const {
+        return source;
+    }
+
+    size_t stateCount() const {
+        return accepting.size();
+    }
+
+private:
+    enum NfaKind { NFA_BYTES, NFA_SPLIT, NFA_EMPTY, NFA_MATCH };
+
+    struct NfaState {
+        NfaKind kind;
+        bitset<256> bytes;  // NFA_BYTES: which bytes lead to next
+        int next;
+        int alt;            // NFA_SPLIT: second way out
+    };
+
+    // a piece of NFA with a start and the dangling exits still to connect
+    // an exit is (state, 0 for next or 1 for alt)
+    struct Fragment {
+        int start;
+        vector<pair<int, int>> exits;
+        string literal;     // longest run of fixed bytes every match has
+    };
+
+    string source;
+    bool pathPattern;
+    string literal;
+
+    // parser and NFA, only used while compiling
+    string pattern;
+    size_t pos;
+    vector<NfaState> nfa;
+
+    // the DFA
+    uint8_t byteClass[256];
+    uint32_t classCount;
+    vector<uint32_t> table;     // state * classCount + class -> state
+    vector<bool> accepting;
+    uint32_t startState;
+
+    // glob syntax written as a regex, anchored at both ends
+    static string globToRegex(const string& glob) {
+        string regex = "^";
+        size_t i = 0;
+        while (i < glob.length()) {
+            char c = glob[i];
+            if (c == '*' && i + 1 < glob.length() && glob[i + 1] == '*') {
+                // "**/" is zero or more folders, a bare "**" is anything
+                if (i + 2 < glob.length() && glob[i + 2] == '/') {
+                    regex += "(.*/)?";
+                    i += 3;
+                } else {
+                    regex += ".*";
+                    i += 2;
+                }
+                continue;
+            }
+            if (c == '*') {
+                regex += "[^/]*";
+            } else if (c == '?') {
+                regex += "[^/]";
+            } else if (c == '[') {
+                size_t close = glob.find(']', i + 2);
+                if (close == string::npos) {
+                    throw InvalidPatternException("missing ] in " + glob);
+                }
+                string inside = glob.substr(i + 1, close - i - 1);
+                if (inside[0] == '!') {
+                    inside[0] = '^';
+                }
+                regex += "[" + inside + "]";
+                i = close;
+            } else {
+                if (string("\\.^$|()[]*+?{}").find(c) != string::npos) {
+                    regex += '\\';
+                }
+                regex += c;
+            }
+            i++;
+        }
+        return regex + "$";
+    }
+
+    int addState(NfaKind kind, int next = -1, int alt = -1) {
+        NfaState state;
+        state.kind = kind;
+        state.next = next;
+        state.alt = alt;
+        nfa.push_back(state);
+        return nfa.size() - 1;
+    }
+
+    void connect(const vector<pair<int, int>>& exits, int target) {
+        for (size_t i = 0; i < exits.size(); i++) {
+            if (exits[i].second == 0) {
+                nfa[exits[i].first].next = target;
+            } else {
+                nfa[exits[i].first].alt = target;
+            }
+        }
+    }
+
+    Fragment bytesFragment(const bitset<256>& bytes) {
+        Fragment f;
+        f.start = addState(NFA_BYTES);
+        nfa[f.start].bytes = bytes;
+        f.exits.push_back(make_pair(f.start, 0));
+        if (bytes.count() == 1) {
+            for (int c = 0; c < 256; c++) {
+                if (bytes[c]) {
+                    f.literal = string(1, (char)c);
+                }
+            }
+        }
+        return f;
+    }
+
+    // alternation := concat ('|' concat)*
+    Fragment parseAlternation() {
+        Fragment left = parseConcat();
+        while (pos < pattern.length() && pattern[pos] == '|') {
+            pos++;
+            Fragment right = parseConcat();
+            Fragment both;
+            both.start = addState(NFA_SPLIT, left.start, right.start);
+            both.exits = left.exits;
+            both.exits.insert(both.exits.end(), right.exits.begin(), right.exits.end());
+            left = both;   // no literal is required by every branch
+        }
+        return left;
+    }
+
+    // true at a '$' that ends a top-level branch
+    bool atEndAnchor() const {
+        return pos < pattern.length() && pattern[pos] == '$' &&
+               (pos + 1 == pattern.length() || pattern[pos + 1] == '|');
+    }
+
+    // concat := repeat*
+    // at the top level a '$' closing the branch is left for compile
+    Fragment parseConcat(bool topLevel = false) {
+        Fragment result;
+        result.start = addState(NFA_EMPTY);
+        result.exits.push_back(make_pair(result.start, 0));
+        string run;   // fixed bytes in a row, the current literal candidate
+
+        while (pos < pattern.length() && pattern[pos] != '|' && pattern[pos] != ')' &&
+               !(topLevel && atEndAnchor())) {
+            bool single = false;
+            Fragment piece = parseRepeat(single);
+            connect(result.exits, piece.start);
+            result.exits = piece.exits;
+
+            if (single) {
+                run += piece.literal;
+            } else {
+                run.clear();
+            }
+            if (run.length() > result.literal.length()) {
+                result.literal = run;
+            }
+            if (piece.literal.length() > result.literal.length()) {
+                result.literal = piece.literal;
+            }
+        }
+        return result;
+    }
+
+    // repeat := atom ('*' | '+' | '?')*
+    // single is set when the piece is exactly one fixed byte
+    Fragment parseRepeat(bool& single) {
+        Fragment atom = parseAtom(single);
+        while (pos < pattern.length() && (pattern[pos] == '*' || pattern[pos] == '+' || pattern[pos] == '?')) {
+            char op = pattern[pos++];
+            single = false;
+            int split = addState(NFA_SPLIT, atom.start);
+            Fragment repeated;
+            if (op == '*') {
+                connect(atom.exits, split);
+                repeated.start = split;
+                repeated.exits.push_back(make_pair(split, 1));
+            } else if (op == '+') {
+                connect(atom.exits, split);
+                repeated.start = atom.start;
+                repeated.exits.push_back(make_pair(split, 1));
+                repeated.literal = atom.literal;
+            } else {
+                repeated.start = split;
+                repeated.exits = atom.exits;
+                repeated.exits.push_back(make_pair(split, 1));
+            }
+            atom = repeated;
+        }
+        return atom;
+    }
+
+    Fragment parseAtom(bool& single) {
+        char c = pattern[pos];
+        single = false;
+        if (c == '*' || c == '+' || c == '?') {
+            throw InvalidPatternException("nothing to repeat before '" + string(1, c) + "' in " + source);
+        }
+        if (c == '(') {
+            pos++;
+            Fragment inner = parseAlternation();
+            if (pos >= pattern.length() || pattern[pos] != ')') {
+                throw InvalidPatternException("missing ) in " + source);
+            }
+            pos++;
+            return inner;
+        }
+
+        bitset<256> bytes;
+        if (c == '.') {
+            bytes.set();
+            pos++;
+        } else if (c == '[') {
+            bytes = parseClass();
+        } else if (c == '\\') {
+            if (pos + 1 >= pattern.length()) {
+                throw InvalidPatternException("trailing \\ in " + source);
+            }
+            bytes = escapeClass(pattern[pos + 1]);
+            pos += 2;
+        } else {
+            bytes.set((unsigned char)c);
+            pos++;
+        }
+        single = bytes.count() == 1;
+        return bytesFragment(bytes);
+    }
+
+    // [abc], [a-z], [^...], escapes allowed inside
+    bitset<256> parseClass() {
+        pos++;
+        bool negate = pos < pattern.length() && pattern[pos] == '^';
+        if (negate) {
+            pos++;
+        }
+        bitset<256> bytes;
+        bool first = true;
+        while (pos < pattern.length() && (pattern[pos] != ']' || first)) {
+            first = false;
+            unsigned char low = pattern[pos];
+            if (low == '\\' && pos + 1 < pattern.length()) {
+                bitset<256> escaped = escapeClass(pattern[pos + 1]);
+                pos += 2;
+                if (escaped.count() != 1) {
+                    bytes |= escaped;
+                    continue;
+                }
+                low = (unsigned char)pattern[pos - 1];
+            } else {
+                pos++;
+            }
+            unsigned char high = low;
+            if (pos + 1 < pattern.length() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+                high = pattern[pos + 1];
+                pos += 2;
+                if (high < low) {
+                    throw InvalidPatternException("bad range in " + source);
+                }
+            }
+            for (int b = low; b <= high; b++) {
+                bytes.set(b);
+            }
+        }
+        if (pos >= pattern.length()) {
+            throw InvalidPatternException("missing ] in " + source);
+        }
+        pos++;
+        if (negate) {
+            bytes.flip();
+        }
+        return bytes;
+    }
+
+    static bitset<256> escapeClass(char c) {
+        bitset<256> bytes;
+        char lower = tolower(c);
+        if (lower == 'd' || lower == 'w' || lower == 's') {
+            for (int b = 0; b < 256; b++) {
+                bool in = lower == 'd' ? isdigit(b) : lower == 'w' ? (isalnum(b) || b == '_') : isspace(b);
+                bytes.set(b, in);
+            }
+            if (c != lower) {
+                bytes.flip();
+            }
+        } else {
+            bytes.set((unsigned char)c);
+        }
+        return bytes;
+    }
+
+    // NFA states reachable from these without reading a byte, sorted
+    vector<int> closure(vector<int> states) const {
+        vector<bool> seen(nfa.size(), false);
+        vector<int> result;
+        while (states.size() > 0) {
+            int s = states.back();
+            states.pop_back();
+            if (s < 0 || seen[s]) {
+                continue;
+            }
+            seen[s] = true;
+            if (nfa[s].kind == NFA_SPLIT) {
+                states.push_back(nfa[s].next);
+                states.push_back(nfa[s].alt);
+            } else if (nfa[s].kind == NFA_EMPTY) {
+                states.push_back(nfa[s].next);
+            } else {
+                result.push_back(s);
+            }
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+    void compile(string regex) {
+        // each top-level branch is parsed on its own so its ^ and $ anchor
+        // just that branch; anchors anywhere else are plain bytes
+        pattern = regex;
+        nfa.clear();
+        pos = 0;
+        int match = addState(NFA_MATCH);      // accepts whatever follows
+        int matchEnd = addState(NFA_MATCH);   // only at the end of the input
+        vector<int> anchoredStarts;
+        vector<int> floatingStarts;
+        size_t branches = 0;
+        while (true) {
+            bool anchoredStart = pos < pattern.length() && pattern[pos] == '^';
+            if (anchoredStart) {
+                pos++;
+            }
+            Fragment branch = parseConcat(true);
+            bool anchoredEnd = atEndAnchor();
+            if (anchoredEnd) {
+                pos++;
+            }
+            connect(branch.exits, anchoredEnd ? matchEnd : match);
+            (anchoredStart ? anchoredStarts : floatingStarts).push_back(branch.start);
+            literal = branches++ == 0 ? branch.literal : "";   // no literal is required by every branch
+            if (pos >= pattern.length() || pattern[pos] != '|') {
+                break;
+            }
+            pos++;
+        }
+        if (pos < pattern.length()) {
+            throw InvalidPatternException("unexpected '" + string(1, pattern[pos]) + "' in " + source);
+        }
+
+        int begin = fork(anchoredStarts);
+        if (floatingStarts.size() > 0) {
+            // any bytes may come first: loop on any byte, then the branches
+            int loop = addState(NFA_SPLIT, -1, fork(floatingStarts));
+            int any = addState(NFA_BYTES, loop);
+            nfa[any].bytes.set();
+            nfa[loop].next = any;
+            begin = begin < 0 ? loop : addState(NFA_SPLIT, begin, loop);
+        }
+
+        buildByteClasses();
+        buildDfa(begin, match, matchEnd);
+        nfa.clear();
+        pattern.clear();
+    }
+
+    // one state leading to each of starts, -1 when there are none
+    int fork(const vector<int>& starts) {
+        int joined = -1;
+        for (size_t i = 0; i < starts.size(); i++) {
+            joined = joined < 0 ? starts[i] : addState(NFA_SPLIT, joined, starts[i]);
+        }
+        return joined;
+    }
+
+    // groups bytes no NFA edge tells apart, each group is one table column
+    void buildByteClasses() {
+        vector<int> group(256, 0);
+        int groups = 1;
+        for (size_t s = 0; s < nfa.size(); s++) {
+            if (nfa[s].kind != NFA_BYTES) {
+                continue;
+            }
+            // split every group by whether its bytes are in this edge's set
+            map<pair<int, bool>, int> renumber;
+            for (int b = 0; b < 256; b++) {
+                pair<int, bool> key(group[b], nfa[s].bytes[b]);
+                auto found = renumber.find(key);
+                if (found == renumber.end()) {
+                    found = renumber.insert(make_pair(key, (int)renumber.size())).first;
+                }
+                group[b] = found->second;
+            }
+            groups = renumber.size();
+        }
+        for (int b = 0; b < 256; b++) {
+            byteClass[b] = group[b];
+        }
+        classCount = groups;
+    }
+
+    // subset construction, state 0 is the empty set (dead)
+    // a state holding match accepts whatever follows, so it becomes an
+    // accepting state that loops to itself; one holding only matchEnd
+    // accepts but carries on like any other
+    void buildDfa(int begin, int match, int matchEnd) {
+        // one byte of each class, to look up the NFA edges with
+        vector<int> sample(classCount, 0);
+        for (int b = 255; b >= 0; b--) {
+            sample[byteClass[b]] = b;
+        }
+
+        map<vector<int>, uint32_t> ids;
+        vector<vector<int>> sets;
+        sets.push_back(vector<int>());
+        ids[sets[0]] = 0;
+        table.assign(classCount, deadState);
+        accepting.assign(1, false);
+
+        vector<int> first = closure(vector<int>(1, begin));
+        ids[first] = 1;
+        sets.push_back(first);
+        table.resize(2 * classCount, deadState);
+        accepting.push_back(false);
+        startState = 1;
+
+        for (uint32_t d = 1; d < sets.size(); d++) {
+            bool hasMatch = binary_search(sets[d].begin(), sets[d].end(), match);
+            accepting[d] = hasMatch || binary_search(sets[d].begin(), sets[d].end(), matchEnd);
+            if (hasMatch) {
+                for (uint32_t c = 0; c < classCount; c++) {
+                    table[d * classCount + c] = d;
+                }
+                continue;
+            }
+
+            for (uint32_t c = 0; c < classCount; c++) {
+                vector<int> next;
+                for (size_t i = 0; i < sets[d].size(); i++) {
+                    const NfaState& s = nfa[sets[d][i]];
+                    if (s.kind == NFA_BYTES && s.bytes[sample[c]]) {
+                        next.push_back(s.next);
+                    }
+                }
+                next = closure(next);
+
+                auto found = ids.find(next);
+                uint32_t target;
+                if (found != ids.end()) {
+                    target = found->second;
+                } else {
+                    if (sets.size() >= maxStates) {
+                        throw InvalidPatternException("too complex: " + source);
+                    }
+                    target = sets.size();
+                    ids[next] = target;
+                    sets.push_back(next);
+                    table.resize(sets.size() * classCount, deadState);
+                    accepting.push_back(false);
+                }
+                table[d * classCount + c] = target;
+            }
+        }
+    }
+};
+
+#endif
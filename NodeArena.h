@@ -0,0 +1,67 @@
+// NodeArena.h - bump allocator for nodes made in bulk
+//
+// hands out raw slots for T from large blocks, one pointer bump each, so
+// loading millions of nodes costs a handful of heap calls instead of one
+// per node. slots are never freed one by one: the owner runs each
+// object's destructor itself and the blocks go back to the heap when the
+// arena is destroyed.
+
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include <vector>
+#include <new>
+#include <cstddef>
+
+using namespace std;
+
+template <typename T>
+class NodeArena {
+private:
+    vector<char*> blocks;
+    size_t used;       // slots taken in the last block
+    size_t capacity;   // slots in the last block
+    size_t reserved;   // slots in all blocks
+
+public:
+    NodeArena() {
+        used = 0;
+        capacity = 0;
+        reserved = 0;
+    }
+
+    ~NodeArena() {
+        for (size_t i = 0; i < blocks.size(); i++) {
+            ::operator delete(blocks[i]);
+        }
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // makes sure the next count slots come from the same block
+    void reserve(size_t count) {
+        if (capacity - used >= count) {
+            return;
+        }
+        blocks.push_back((char*)::operator new(count * sizeof(T)));
+        used = 0;
+        capacity = count;
+        reserved += count;
+    }
+
+    // room for one T, construct it with placement new
+    void* allocate() {
+        if (used == capacity) {
+            reserve(capacity < 1024 ? 1024 : capacity);
+        }
+        return blocks.back() + sizeof(T) * used++;
+    }
+
+    // heap bytes held by the blocks, taken slots or not
+    size_t memoryUsed() const {
+        return reserved * sizeof(T);
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+// NodeTable.h - structure-of-arrays snapshot of a FileNode tree
+//
+// every node gets one row, numbered in depth-first order, and each field
+// lives in its own contiguous array. a whole-tree scan then reads a few
+// dense arrays front to back instead of chasing one heap pointer per node,
+// and the subtree of row i is simply rows [i, subtreeEnd[i]).
+//
+// names are packed into one buffer with a '\0' before and after each one,
+// so a scan can search the whole buffer with one vectorized call: a match
+// never spans two names, and searching for '\0' + prefix finds prefixes.
+//
+// the table is a read-only copy. FileSystem rebuilds it on request
+// ('compact') and only uses it while no change has been made since.
+
+#ifndef NODETABLE_H
+#define NODETABLE_H
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+#include <string_view>
+#include <algorithm>
+#include <unordered_map>
+#include "TreeWalk.h"
+#include "StringSearch.h"
+
+using namespace std;
+
+const uint32_t noNode = 0xffffffff;
+
+template <typename Node>
+class NodeTable {
+public:
+    string names;                   // '\0', then every name followed by '\0'
+    vector<uint32_t> nameOffset;    // where each row's name starts in names
+    vector<uint32_t> nameLength;
+    vector<uint8_t> isDirectory;
+    vector<uint32_t> parent;        // noNode for the first row
+    vector<uint32_t> firstChild;    // noNode when there are no children
+    vector<uint32_t> nextSibling;   // noNode for the last child
+    vector<uint32_t> subtreeEnd;    // one past the row's last descendant
+    vector<uint64_t> size;          // content bytes
+    vector<time_t> createdTime;
+    vector<time_t> modifiedTime;
+    vector<Node*> node;             // back to the tree, for content and paths
+    unordered_map<const Node*, uint32_t> folderRow;   // row of each folder, where subtree scans start
+
+    // copies the tree under start, start becomes row 0
+    void build(Node* start) {
+        clear();
+        names += '\0';
+        Builder builder;
+        builder.table = this;
+        walkTree(start, builder);
+    }
+
+    void clear() {
+        names.clear();
+        nameOffset.clear();
+        nameLength.clear();
+        isDirectory.clear();
+        parent.clear();
+        firstChild.clear();
+        nextSibling.clear();
+        subtreeEnd.clear();
+        size.clear();
+        createdTime.clear();
+        modifiedTime.clear();
+        node.clear();
+        folderRow.clear();
+    }
+
+    size_t rows() const {
+        return node.size();
+    }
+
+    // row of a folder in the table, noNode if it isn't one
+    uint32_t rowOf(const Node* folder) const {
+        auto found = folderRow.find(folder);
+        return found == folderRow.end() ? noNode : found->second;
+    }
+
+    // row's name without copying it
+    const char* name(uint32_t row) const {
+        return names.data() + nameOffset[row];
+    }
+
+    // path from row 0 down to row, names joined by '/'
+    // measured on a first walk up the parents, filled from the end on a second
+    string pathOf(uint32_t row) const {
+        size_t length = 0;
+        for (uint32_t r = row; r != noNode; r = parent[r]) {
+            length += nameLength[r] + 1;
+        }
+
+        string path(length - 1, '/');
+        size_t end = length - 1;
+        for (uint32_t r = row; r != noNode; r = parent[r]) {
+            end -= nameLength[r];
+            path.replace(end, nameLength[r], name(r), nameLength[r]);
+            if (end > 0) {
+                end--;   // skip the '/' already there
+            }
+        }
+        return path;
+    }
+
+    // rows whose name contains pattern (or starts with it), in row order
+    void findNames(string_view pattern, bool prefix, vector<uint32_t>& matches,
+                   SubstringFinder finder = findSubstring) const {
+        string needle = prefix ? string(1, '\0') : string();
+        needle.append(pattern.data(), pattern.length());
+        size_t skip = prefix ? 1 : 0;   // a prefix match starts at the '\0' before the name
+
+        const char* hay = names.data();
+        size_t length = names.length();
+        size_t pos = 1 - skip;
+        uint32_t row = 0;
+        while (pos < length) {
+            size_t found = finder(hay + pos, length - pos, needle.data(), needle.length());
+            size_t at = pos + found + skip;
+            if (found == length - pos || at >= length) {
+                break;
+            }
+            // last row starting at or before the match
+            row = upper_bound(nameOffset.begin() + row, nameOffset.end(), (uint32_t)at) - nameOffset.begin() - 1;
+            matches.push_back(row);
+            pos = nameOffset[row] + nameLength[row] + 1 - skip;   // on to the next name
+        }
+    }
+
+    // heap bytes held by the arrays
+    size_t memoryUsed() const {
+        return names.capacity() + (nameOffset.capacity() + nameLength.capacity() + parent.capacity() +
+                                   firstChild.capacity() + nextSibling.capacity() + subtreeEnd.capacity()) * sizeof(uint32_t) +
+               isDirectory.capacity() + size.capacity() * sizeof(uint64_t) +
+               (createdTime.capacity() + modifiedTime.capacity()) * sizeof(time_t) + node.capacity() * sizeof(Node*) +
+               folderRow.size() * (sizeof(void*) + sizeof(pair<const Node* const, uint32_t>) + sizeof(size_t)) +
+               folderRow.bucket_count() * sizeof(void*);
+    }
+
+private:
+    // appends rows in the order walkTree enters nodes
+    struct Builder : TreeVisitor {
+        NodeTable* table;
+        vector<uint32_t> rowAtDepth;       // row of the folder open at each depth
+        vector<uint32_t> lastChildAtDepth; // last row added under that folder
+
+        bool enter(Node* n, int depth) {
+            NodeTable& t = *table;
+            uint32_t row = t.node.size();
+            t.nameOffset.push_back(t.names.length());
+            t.nameLength.push_back(n->name.length());
+            t.names += n->name;
+            t.names += '\0';
+            t.isDirectory.push_back(n->isDirectory);
+            t.parent.push_back(depth == 0 ? noNode : rowAtDepth[depth - 1]);
+            t.firstChild.push_back(noNode);
+            t.nextSibling.push_back(noNode);
+            t.subtreeEnd.push_back(row + 1);
+            t.size.push_back(n->content.length());
+            t.createdTime.push_back(n->createdTime);
+            t.modifiedTime.push_back(n->modifiedTime);
+            t.node.push_back(n);
+            if (n->isDirectory) {
+                t.folderRow[n] = row;
+            }
+
+            if (depth > 0) {
+                uint32_t previous = lastChildAtDepth[depth - 1];
+                if (previous == noNode) {
+                    t.firstChild[rowAtDepth[depth - 1]] = row;
+                } else {
+                    t.nextSibling[previous] = row;
+                }
+                lastChildAtDepth[depth - 1] = row;
+            }
+
+            if (rowAtDepth.size() <= depth) {
+                rowAtDepth.resize(depth + 1);
+                lastChildAtDepth.resize(depth + 1);
+            }
+            rowAtDepth[depth] = row;
+            lastChildAtDepth[depth] = noNode;
+            return true;
+        }
+
+        void leave(Node*, int depth) {
+            table->subtreeEnd[rowAtDepth[depth]] = table->node.size();
+        }
+    };
+};
+
+#endif
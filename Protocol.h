@@ -0,0 +1,279 @@
+// Protocol.h - compact binary protocol for the FileSystem server
+//
+// a binary client starts by sending the 4 magic bytes, after that every
+// message is a length-prefixed frame (all integers little-endian u32):
+//
+//   request:  length | id | op (u8)     | arg1 len | arg1 | arg2 len | arg2
+//   response: length | id | status (u8) | count | count x (len | bytes)
+//
+// length counts the bytes after itself. clients may send many requests
+// before reading any replies (pipelining); replies come back in order and
+// the server writes everything it has for a connection in one go.
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// first bytes on a binary connection, the NUL can never start a text command
+const char protocolMagic[4] = {0, 'F', 'S', 'B'};
+
+// frames bigger than this are treated as a broken client. the server
+// buffers a whole frame per connection before running it, so this also
+// bounds what one client can make it hold
+const uint32_t maxFrameLength = 64 * 1024 * 1024;
+
+enum OpCode : uint8_t {
+    OP_CREATE_FILE = 1,   // arg1 name, arg2 content
+    OP_CREATE_DIR,        // arg1 name
+    OP_CHANGE_DIR,        // arg1 name, .. or /
+    OP_WRITE_FILE,        // arg1 name, arg2 content
+    OP_READ_FILE,         // arg1 name -> content
+    OP_DELETE,            // arg1 name
+    OP_SEARCH,            // arg1 name -> matching paths
+    OP_GET_PATH           // -> current path
+};
+
+enum Status : uint8_t {
+    STATUS_OK = 0,
+    STATUS_FILE_NOT_FOUND,
+    STATUS_DIR_NOT_FOUND,
+    STATUS_ALREADY_EXISTS,
+    STATUS_NOT_EMPTY,
+    STATUS_INVALID_NAME,
+    STATUS_BAD_REQUEST,
+    STATUS_ERROR
+};
+
+struct Request {
+    uint32_t id;
+    uint8_t op;
+    string arg1;
+    string arg2;
+};
+
+struct Response {
+    uint32_t id;
+    uint8_t status;
+    vector<string> values;   // results, or the error message when status != OK
+};
+
+// integers go on the wire little-endian whatever the host's byte order
+inline void appendU32(string& out, uint32_t value) {
+    char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+    out.append(bytes, 4);
+}
+
+inline uint32_t readU32(const char* data) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// adds one request frame to out
+inline void encodeRequest(string& out, const Request& req) {
+    uint32_t length = 4 + 1 + 4 + req.arg1.length() + 4 + req.arg2.length();
+    out.reserve(out.length() + 4 + length);
+    appendU32(out, length);
+    appendU32(out, req.id);
+    out += (char)req.op;
+    appendU32(out, req.arg1.length());
+    out += req.arg1;
+    appendU32(out, req.arg2.length());
+    out += req.arg2;
+}
+
+// adds one response frame to out
+inline void encodeResponse(string& out, const Response& resp) {
+    uint32_t length = 4 + 1 + 4;
+    for (int i = 0; i < resp.values.size(); i++) {
+        length += 4 + resp.values[i].length();
+    }
+    out.reserve(out.length() + 4 + length);
+    appendU32(out, length);
+    appendU32(out, resp.id);
+    out += (char)resp.status;
+    appendU32(out, resp.values.size());
+    for (int i = 0; i < resp.values.size(); i++) {
+        appendU32(out, resp.values[i].length());
+        out += resp.values[i];
+    }
+}
+
+// reads a length-prefixed string inside a frame, false if it runs past the end
+inline bool readField(const string& buf, size_t& pos, size_t end, string& field) {
+    if (pos + 4 > end) {
+        return false;
+    }
+    uint32_t length = readU32(buf.data() + pos);
+    pos += 4;
+    if (length > end - pos) {
+        return false;
+    }
+    field.assign(buf, pos, length);
+    pos += length;
+    return true;
+}
+
+// result of trying to pull one frame out of a buffer
+enum FrameResult { FRAME_OK, FRAME_INCOMPLETE, FRAME_BAD };
+
+// decodes the request frame starting at pos and moves pos past it
+inline FrameResult decodeRequest(const string& buf, size_t& pos, Request& req) {
+    if (buf.length() - pos < 4) {
+        return FRAME_INCOMPLETE;
+    }
+    uint32_t length = readU32(buf.data() + pos);
+    if (length > maxFrameLength || length < 4 + 1 + 4 + 4) {
+        return FRAME_BAD;
+    }
+    if (buf.length() - pos - 4 < length) {
+        return FRAME_INCOMPLETE;
+    }
+
+    size_t p = pos + 4;
+    size_t end = p + length;
+    req.id = readU32(buf.data() + p);
+    req.op = buf[p + 4];
+    p += 5;
+    if (!readField(buf, p, end, req.arg1) || !readField(buf, p, end, req.arg2)) {
+        return FRAME_BAD;
+    }
+    pos = end;
+    return FRAME_OK;
+}
+
+// decodes the response frame starting at pos and moves pos past it
+inline FrameResult decodeResponse(const string& buf, size_t& pos, Response& resp) {
+    if (buf.length() - pos < 4) {
+        return FRAME_INCOMPLETE;
+    }
+    uint32_t length = readU32(buf.data() + pos);
+    if (length > maxFrameLength || length < 4 + 1 + 4) {
+        return FRAME_BAD;
+    }
+    if (buf.length() - pos - 4 < length) {
+        return FRAME_INCOMPLETE;
+    }
+
+    size_t p = pos + 4;
+    size_t end = p + length;
+    resp.id = readU32(buf.data() + p);
+    resp.status = buf[p + 4];
+    uint32_t count = readU32(buf.data() + p + 5);
+    p += 9;
+    // every value takes at least its 4 length bytes, so a bigger count
+    // can't be right and mustn't size the vector
+    if (count > (end - p) / 4) {
+        return FRAME_BAD;
+    }
+    resp.values.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (!readField(buf, p, end, resp.values[i])) {
+            return FRAME_BAD;
+        }
+    }
+    pos = end;
+    return FRAME_OK;
+}
+
+// reference client: queue any number of requests, send them in one write,
+// then collect the responses in order
+class ProtocolClient {
+private:
+    int fd;
+    uint32_t nextId;
+    string outBuf;
+    string inBuf;
+    size_t inPos;
+
+public:
+    ProtocolClient() {
+        fd = -1;
+        nextId = 1;
+        inPos = 0;
+    }
+
+    ~ProtocolClient() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool connectTo(string path) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            return false;
+        }
+        outBuf.append(protocolMagic, 4);
+        return true;
+    }
+
+    // queues a request and returns its id, nothing is sent until flush()
+    uint32_t queue(OpCode op, string arg1 = "", string arg2 = "") {
+        Request req;
+        req.id = nextId++;
+        req.op = op;
+        req.arg1 = arg1;
+        req.arg2 = arg2;
+        encodeRequest(outBuf, req);
+        return req.id;
+    }
+
+    // sends everything queued so far
+    bool flush() {
+        size_t sent = 0;
+        while (sent < outBuf.length()) {
+            ssize_t n = send(fd, outBuf.data() + sent, outBuf.length() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            sent += n;
+        }
+        outBuf.clear();
+        return true;
+    }
+
+    // waits for the next response
+    bool receive(Response& resp) {
+        while (true) {
+            size_t pos = inPos;
+            FrameResult result = decodeResponse(inBuf, pos, resp);
+            if (result == FRAME_OK) {
+                inPos = pos;
+                return true;
+            }
+            if (result == FRAME_BAD) {
+                return false;
+            }
+
+            inBuf.erase(0, inPos);
+            inPos = 0;
+            char chunk[65536];
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                return false;
+            }
+            inBuf.append(chunk, n);
+        }
+    }
+
+    // sends one request and waits for its reply
+    bool call(Response& resp, OpCode op, string arg1 = "", string arg2 = "") {
+        queue(op, arg1, arg2);
+        return flush() && receive(resp);
+    }
+};
+
+#endif
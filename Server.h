@@ -0,0 +1,577 @@
+// Server.h - serves one shared FileSystem to many local clients
+//
+// listens on a unix domain socket; an epoll loop hands ready connections to
+// a pool of worker threads (EPOLLONESHOT, so only one worker owns a
+// connection at a time and its replies stay in order)
+//
+// text protocol: clients send Full CLI command lines ending in '\n', nano is
+// followed by its content lines and END just like batch mode. every command
+// gets one reply: "<byte count>\n" then exactly that many bytes of output.
+// each connection keeps its own current folder. commands that read or
+// write files on the real disk (import, export, metrics/trace dump) are
+// refused unless the server was started with host access.
+//
+// clients that open with the magic bytes from Protocol.h speak the binary
+// protocol instead; a whole batch of pipelined requests runs under one lock.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "FileSystem.h"
+#include "Commands.h"
+#include "Protocol.h"
+
+using namespace std;
+
+class ServerException : public runtime_error {
+public:
+    ServerException(string msg)
+        : runtime_error("Server error: " + msg + " (" + strerror(errno) + ")") {}
+};
+
+enum ConnectionProtocol { PROTOCOL_UNKNOWN, PROTOCOL_TEXT, PROTOCOL_BINARY };
+
+// one connected client
+struct Connection {
+    int fd;
+    ConnectionProtocol protocol;   // decided by the first bytes received
+    string inBuf;       // received bytes not yet turned into requests
+    string outBuf;      // replies waiting to be written
+    size_t outPos;
+    size_t lineScanned; // text: inBuf up to here has no '\n' for the pending line
+    size_t bodyScanned; // text: nano body lines up to here hold no END
+    string cwd;         // this client's current folder
+    bool closing;       // close once outBuf is flushed
+
+    Connection(int f) {
+        fd = f;
+        protocol = PROTOCOL_UNKNOWN;
+        outPos = 0;
+        lineScanned = 0;
+        bodyScanned = 0;
+        cwd = "/";
+        closing = false;
+    }
+};
+
+class FileSystemServer {
+private:
+    FileSystem& fs;
+    mutex fsLock;           // FileSystem is not thread safe, commands run one at a time
+    string socketPath;
+    int workerCount;
+    bool hostAccess;        // let clients run commands that touch the real disk
+    int listenFd;
+    bool bound;             // socketPath is our socket, remove it when done
+    int epollFd;
+    atomic<bool> running;
+    atomic<long long> commandsServed;
+
+    // connections with events waiting for a worker
+    mutex queueLock;
+    condition_variable queueReady;
+    deque<Connection*> readyQueue;
+
+    // every open connection, so run() can close what is left when it stops
+    mutex connectionsLock;
+    unordered_set<Connection*> connections;
+
+    static void setNonBlocking(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    // re-enables events for a connection after a worker is done with it
+    void rearm(Connection* conn) {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        if (conn->outPos < conn->outBuf.length()) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.ptr = conn;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+    }
+
+    void closeConnection(Connection* conn) {
+        {
+            lock_guard<mutex> guard(connectionsLock);
+            connections.erase(conn);
+        }
+        close(conn->fd);
+        delete conn;
+    }
+
+    void acceptClients() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            Connection* conn = new Connection(fd);
+            {
+                lock_guard<mutex> guard(connectionsLock);
+                connections.insert(conn);
+            }
+            epoll_event ev;
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.ptr = conn;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                closeConnection(conn);
+            }
+        }
+    }
+
+    // runs one command for a client and returns its output
+    // the client's folder is restored before and saved after
+    string execute(Connection* conn, const string& line, const string& content) {
+        ostringstream reply;
+        istringstream contentIn(content);
+        CommandResult result;
+
+        {
+            TraceScope scope("textCommand", "server");
+            unique_lock<mutex> guard(fsLock, defer_lock);
+            {
+                TraceScope wait("lockWait", "server");
+                guard.lock();
+            }
+            ostream& previous = fs.output();
+            fs.setOutput(reply);
+            try {
+                fs.setCurrentPath(conn->cwd);
+            } catch (DirectoryNotFoundException& e) {
+                // someone else removed our folder
+                fs.setCurrentPath("/");
+            }
+
+            CommandContext ctx(fs, contentIn, false, STYLE_UNIX);
+            ctx.hostAccess = hostAccess;
+            result = runCommandLine(line, ctx);
+            conn->cwd = fs.getCurrentPath();
+            fs.setOutput(previous);
+        }
+        commandsServed++;
+
+        if (result == EXIT_PROGRAM) {
+            conn->closing = true;
+        }
+        return reply.str();
+    }
+
+    // runs one binary request, the caller holds fsLock
+    void executeBinary(Request& req, Response& resp) {
+        resp.id = req.id;
+        resp.status = STATUS_OK;
+        resp.values.clear();
+
+        try {
+            if (req.op == OP_CREATE_FILE) {
+                fs.createFile(req.arg1, req.arg2);
+            } else if (req.op == OP_CREATE_DIR) {
+                fs.createDirectory(req.arg1);
+            } else if (req.op == OP_CHANGE_DIR) {
+                fs.changeDirectory(req.arg1);
+            } else if (req.op == OP_WRITE_FILE) {
+                fs.writeFile(req.arg1, req.arg2);
+            } else if (req.op == OP_READ_FILE) {
+                resp.values.push_back(fs.readFile(req.arg1));
+            } else if (req.op == OP_DELETE) {
+                fs.deleteFile(req.arg1);
+            } else if (req.op == OP_SEARCH) {
+                resp.values = fs.searchFile(req.arg1);
+            } else if (req.op == OP_GET_PATH) {
+                resp.values.push_back(fs.getCurrentPath());
+            } else {
+                resp.status = STATUS_BAD_REQUEST;
+                resp.values.push_back("Unknown op " + to_string(req.op));
+            }
+            return;
+        }
+        catch (FileNotFoundException& e) {
+            resp.status = STATUS_FILE_NOT_FOUND;
+            resp.values.push_back(e.what());
+        }
+        catch (DirectoryNotFoundException& e) {
+            resp.status = STATUS_DIR_NOT_FOUND;
+            resp.values.push_back(e.what());
+        }
+        catch (AlreadyExistsException& e) {
+            resp.status = STATUS_ALREADY_EXISTS;
+            resp.values.push_back(e.what());
+        }
+        catch (DirectoryNotEmptyException& e) {
+            resp.status = STATUS_NOT_EMPTY;
+            resp.values.push_back(e.what());
+        }
+        catch (InvalidNameException& e) {
+            resp.status = STATUS_INVALID_NAME;
+            resp.values.push_back(e.what());
+        }
+        catch (exception& e) {
+            resp.status = STATUS_ERROR;
+            resp.values.push_back(e.what());
+        }
+    }
+
+    // decodes every complete frame, runs the batch under one lock and
+    // queues all the responses together
+    void processBinaryRequests(Connection* conn) {
+        vector<Request> batch;
+        size_t pos = 0;
+        while (true) {
+            Request req;
+            FrameResult result = decodeRequest(conn->inBuf, pos, req);
+            if (result == FRAME_INCOMPLETE) {
+                break;
+            }
+            if (result == FRAME_BAD) {
+                conn->closing = true;
+                break;
+            }
+            batch.push_back(move(req));
+        }
+        conn->inBuf.erase(0, pos);
+        if (batch.size() == 0) {
+            return;
+        }
+
+        ostream discard(nullptr);   // binary clients don't get the text messages
+        Response resp;
+        {
+            TraceScope scope("binaryBatch", "server");
+            unique_lock<mutex> guard(fsLock, defer_lock);
+            {
+                TraceScope wait("lockWait", "server");
+                guard.lock();
+            }
+            ostream& previous = fs.output();
+            fs.setOutput(discard);
+            try {
+                fs.setCurrentPath(conn->cwd);
+            } catch (DirectoryNotFoundException& e) {
+                fs.setCurrentPath("/");
+            }
+
+            for (int i = 0; i < batch.size(); i++) {
+                executeBinary(batch[i], resp);
+                encodeResponse(conn->outBuf, resp);
+            }
+            conn->cwd = fs.getCurrentPath();
+            fs.setOutput(previous);
+        }
+        commandsServed += batch.size();
+    }
+
+    // looks at the first bytes to tell binary clients from text ones
+    // returns false while there are not enough bytes to decide
+    bool detectProtocol(Connection* conn) {
+        if (conn->inBuf.length() == 0) {
+            return false;
+        }
+        if (conn->inBuf[0] != protocolMagic[0]) {
+            conn->protocol = PROTOCOL_TEXT;
+            return true;
+        }
+        if (conn->inBuf.length() < 4) {
+            return false;
+        }
+        if (conn->inBuf.compare(0, 4, protocolMagic, 4) != 0) {
+            conn->closing = true;
+            return false;
+        }
+        conn->protocol = PROTOCOL_BINARY;
+        conn->inBuf.erase(0, 4);
+        return true;
+    }
+
+    // pulls every complete request out of inBuf and queues the replies,
+    // a partial request stays in inBuf until the rest arrives
+    void processRequests(Connection* conn) {
+        if (conn->protocol == PROTOCOL_UNKNOWN && !detectProtocol(conn)) {
+            return;
+        }
+        if (conn->protocol == PROTOCOL_BINARY) {
+            processBinaryRequests(conn);
+            return;
+        }
+
+        size_t pos = 0;
+        string& buf = conn->inBuf;
+
+        while (!conn->closing) {
+            // what was already searched on an earlier read is not searched again
+            size_t lineEnd = buf.find('\n', max(pos, conn->lineScanned));
+            if (lineEnd == string::npos) {
+                conn->lineScanned = buf.length();
+                break;
+            }
+            string line = buf.substr(pos, lineEnd - pos);
+            size_t next = lineEnd + 1;
+            string content = "";
+
+            // nano needs everything up to its END line first
+            size_t spacePos = line.find(' ');
+            string name = line.substr(0, spacePos);
+            if (lookupCommand(name) == CMD_NANO && spacePos != string::npos) {
+                size_t scan = max(next, conn->bodyScanned);
+                bool complete = false;
+                while (true) {
+                    size_t end = buf.find('\n', scan);
+                    if (end == string::npos) {
+                        break;
+                    }
+                    if (buf.compare(scan, end - scan, "END") == 0) {
+                        content = buf.substr(next, end + 1 - next);
+                        next = end + 1;
+                        complete = true;
+                        break;
+                    }
+                    scan = end + 1;
+                }
+                if (!complete) {
+                    conn->bodyScanned = scan;   // start of the unfinished line
+                    break;
+                }
+            }
+
+            string output = "";
+            if (line.length() > 0) {
+                output = execute(conn, line, content);
+            }
+            conn->outBuf += to_string(output.length());
+            conn->outBuf += '\n';
+            conn->outBuf += output;
+            pos = next;
+        }
+
+        // a line or nano body that never ends would hold memory forever
+        if (!conn->closing && buf.length() - pos > maxFrameLength) {
+            string output = "Error: request longer than " + to_string(maxFrameLength) + " bytes\n";
+            conn->outBuf += to_string(output.length());
+            conn->outBuf += '\n';
+            conn->outBuf += output;
+            conn->closing = true;
+            pos = buf.length();
+        }
+
+        buf.erase(0, pos);
+        conn->lineScanned = conn->lineScanned > pos ? conn->lineScanned - pos : 0;
+        conn->bodyScanned = conn->bodyScanned > pos ? conn->bodyScanned - pos : 0;
+    }
+
+    // writes as much pending output as the socket takes
+    // returns false if the connection is broken
+    bool flushOutput(Connection* conn) {
+        while (conn->outPos < conn->outBuf.length()) {
+            ssize_t n = send(conn->fd, conn->outBuf.data() + conn->outPos,
+                             conn->outBuf.length() - conn->outPos, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            conn->outPos += n;
+        }
+        conn->outBuf.clear();
+        conn->outPos = 0;
+        return true;
+    }
+
+    // handles everything a connection has ready: read, run, reply
+    void serviceConnection(Connection* conn) {
+        char buffer[65536];
+        bool open = true;
+        bool peerDone = false;   // client finished sending, still owed replies
+
+        while (true) {
+            ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                conn->inBuf.append(buffer, n);
+                if (conn->inBuf.length() > maxFrameLength) {
+                    break;   // enough to decide on, the rest waits in the socket
+                }
+                continue;
+            }
+            if (n == 0) {
+                peerDone = true;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                open = false;
+            }
+            break;
+        }
+
+        processRequests(conn);
+        if (!flushOutput(conn)) {
+            open = false;
+        }
+
+        bool drained = conn->outPos >= conn->outBuf.length();
+        if (!open || ((conn->closing || peerDone) && drained)) {
+            closeConnection(conn);
+        } else {
+            rearm(conn);
+        }
+    }
+
+    void workerLoop() {
+        while (true) {
+            Connection* conn;
+            {
+                unique_lock<mutex> guard(queueLock);
+                queueReady.wait(guard, [this] { return readyQueue.size() > 0 || !running; });
+                if (readyQueue.size() == 0) {
+                    return;
+                }
+                conn = readyQueue.front();
+                readyQueue.pop_front();
+            }
+            serviceConnection(conn);
+        }
+    }
+
+public:
+    FileSystemServer(FileSystem& f, string path, int workers = 0, bool allowHostAccess = false) : fs(f) {
+        socketPath = path;
+        hostAccess = allowHostAccess;
+        workerCount = workers > 0 ? workers : thread::hardware_concurrency();
+        if (workerCount < 1) {
+            workerCount = 1;
+        }
+        listenFd = -1;
+        bound = false;
+        epollFd = -1;
+        running = false;
+        commandsServed = 0;
+    }
+
+    ~FileSystemServer() {
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        if (bound) {
+            unlink(socketPath.c_str());
+        }
+        if (epollFd >= 0) {
+            close(epollFd);
+        }
+    }
+
+    // serves clients until stop() is called
+    void run() {
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw ServerException("socket");
+        }
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socketPath.length() >= sizeof(addr.sun_path)) {
+            throw ServerException("socket path too long");
+        }
+        strcpy(addr.sun_path, socketPath.c_str());
+
+        // a socket left by an earlier run is replaced, anything else at
+        // the path is somebody's file and stays where it is
+        struct stat info;
+        if (lstat(socketPath.c_str(), &info) == 0) {
+            if (!S_ISSOCK(info.st_mode)) {
+                errno = EEXIST;
+                throw ServerException(socketPath + " is not a socket");
+            }
+            unlink(socketPath.c_str());
+        }
+
+        if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            throw ServerException("bind " + socketPath);
+        }
+        bound = true;
+        if (listen(listenFd, SOMAXCONN) < 0) {
+            throw ServerException("listen");
+        }
+        setNonBlocking(listenFd);
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            throw ServerException("epoll_create1");
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;   // nullptr marks the listening socket
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+
+        running = true;
+        vector<thread> workers;
+        for (int i = 0; i < workerCount; i++) {
+            workers.push_back(thread(&FileSystemServer::workerLoop, this));
+        }
+
+        cerr << "Serving on " << socketPath << " with " << workerCount << " workers\n";
+
+        epoll_event events[256];
+        while (running) {
+            int count = epoll_wait(epollFd, events, 256, 200);
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.ptr == nullptr) {
+                    acceptClients();
+                } else {
+                    lock_guard<mutex> guard(queueLock);
+                    readyQueue.push_back((Connection*)events[i].data.ptr);
+                    queueReady.notify_one();
+                }
+            }
+        }
+
+        {
+            lock_guard<mutex> guard(queueLock);
+            queueReady.notify_all();
+        }
+        for (int i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+
+        // the workers are gone, close the clients still connected
+        readyQueue.clear();
+        for (Connection* conn : connections) {
+            close(conn->fd);
+            delete conn;
+        }
+        connections.clear();
+        cerr << "Server stopped after " << commandsServed << " commands\n";
+    }
+
+    // asks run() to return, safe to call from a signal handler
+    void stop() {
+        running = false;
+    }
+
+    long long getCommandsServed() {
+        return commandsServed;
+    }
+};
+
+#endif
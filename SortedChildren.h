@@ -0,0 +1,204 @@
+// SortedChildren.h - ordered index over one folder's children
+//
+// children stay in insertion order in FileNode::children. a folder that is
+// listed in sorted order gets a SortedChildren on first use, holding one
+// balanced tree (std::set) per order asked for: by name, by size or by
+// mtime, ties broken by name. after that a page of a sorted listing is a
+// lookup of where the last page ended and a walk of limit entries, not a
+// sort of the whole folder.
+//
+// FileNode keeps it current: addChild and removeChild add and remove, and
+// a child whose size or mtime changed is moved with update.
+
+#ifndef SORTEDCHILDREN_H
+#define SORTEDCHILDREN_H
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <ctime>
+#include <cstdint>
+
+using namespace std;
+
+enum ListOrder { LIST_BY_NAME, LIST_BY_SIZE, LIST_BY_MODIFIED, LIST_ORDER_COUNT };
+
+// where a sorted listing is, or where it should continue from
+struct ListPosition {
+    uint64_t key;       // 0 for LIST_BY_NAME
+    string_view name;
+};
+
+// one child in a sorted listing
+struct ListEntry {
+    string name;
+    bool isDirectory;
+    uint64_t size;
+    time_t modified;
+};
+
+// a page of a sorted listing; next continues after it, "" on the last page
+struct ListPage {
+    vector<ListEntry> entries;
+    string next;
+};
+
+template <typename Node>
+class SortedChildren {
+private:
+    struct Entry {
+        uint64_t key;
+        Node* node;
+    };
+
+    // compares entries by key, then name; also takes a ListPosition
+    // (is_transparent) so a page can start from a key and name alone
+    struct EntryLess {
+        typedef void is_transparent;
+
+        static bool less(uint64_t keyA, string_view nameA, uint64_t keyB, string_view nameB) {
+            return keyA != keyB ? keyA < keyB : nameA < nameB;
+        }
+        bool operator()(const Entry& a, const Entry& b) const {
+            return less(a.key, a.node->name, b.key, b.node->name);
+        }
+        bool operator()(const Entry& a, const ListPosition& b) const {
+            return less(a.key, a.node->name, b.key, b.name);
+        }
+        bool operator()(const ListPosition& a, const Entry& b) const {
+            return less(a.key, a.name, b.key, b.node->name);
+        }
+    };
+
+    typedef set<Entry, EntryLess> EntrySet;
+
+    // the size and mtime each child was filed under, to find it again
+    // after it has changed
+    struct Keys {
+        uint64_t size;
+        uint64_t modified;
+    };
+
+    EntrySet* orders[LIST_ORDER_COUNT];   // nullptr until first asked for
+    unordered_map<Node*, Keys> filed;
+
+    static uint64_t currentKey(Node* node, ListOrder order) {
+        if (order == LIST_BY_SIZE) {
+            return node->content.length();
+        }
+        if (order == LIST_BY_MODIFIED) {
+            return node->modifiedTime;
+        }
+        return 0;
+    }
+
+public:
+    SortedChildren() {
+        for (int o = 0; o < LIST_ORDER_COUNT; o++) {
+            orders[o] = nullptr;
+        }
+    }
+
+    ~SortedChildren() {
+        for (int o = 0; o < LIST_ORDER_COUNT; o++) {
+            delete orders[o];
+        }
+    }
+
+    bool has(ListOrder order) const {
+        return orders[order] != nullptr;
+    }
+
+    // starts keeping an order, filing every current child
+    void build(ListOrder order, const vector<Node*>& children) {
+        delete orders[order];
+        orders[order] = new EntrySet();
+        for (size_t i = 0; i < children.size(); i++) {
+            Keys keys;
+            keys.size = children[i]->content.length();
+            keys.modified = children[i]->modifiedTime;
+            filed[children[i]] = keys;
+            orders[order]->insert(Entry{currentKey(children[i], order), children[i]});
+        }
+    }
+
+    void add(Node* child) {
+        Keys keys;
+        keys.size = child->content.length();
+        keys.modified = child->modifiedTime;
+        filed[child] = keys;
+        for (int o = 0; o < LIST_ORDER_COUNT; o++) {
+            if (orders[o] != nullptr) {
+                orders[o]->insert(Entry{currentKey(child, (ListOrder)o), child});
+            }
+        }
+    }
+
+    void remove(Node* child) {
+        auto found = filed.find(child);
+        if (found == filed.end()) {
+            return;
+        }
+        uint64_t oldKeys[LIST_ORDER_COUNT] = {0, found->second.size, found->second.modified};
+        for (int o = 0; o < LIST_ORDER_COUNT; o++) {
+            if (orders[o] != nullptr) {
+                auto entry = orders[o]->find(ListPosition{oldKeys[o], child->name});
+                if (entry != orders[o]->end()) {
+                    orders[o]->erase(entry);
+                }
+            }
+        }
+        filed.erase(found);
+    }
+
+    // re-files a child after its size or mtime changed
+    // a node that isn't filed here (no longer a child) is left out
+    void update(Node* child) {
+        if (filed.find(child) == filed.end()) {
+            return;
+        }
+        remove(child);
+        add(child);
+    }
+
+    // calls onChild(node) in order (or reverse order) starting just past
+    // from, or at the first (last) child when from is null, until it
+    // returns false. returns true if children were left when it stopped
+    template <typename Callback>
+    bool page(ListOrder order, bool descending, const ListPosition* from, Callback onChild) const {
+        const EntrySet& entries = *orders[order];
+        if (!descending) {
+            auto it = from == nullptr ? entries.begin() : entries.upper_bound(*from);
+            for (; it != entries.end(); ++it) {
+                if (!onChild(it->node)) {
+                    return next(it) != entries.end();
+                }
+            }
+            return false;
+        }
+        auto it = from == nullptr ? entries.rbegin() : make_reverse_iterator(entries.lower_bound(*from));
+        for (; it != entries.rend(); ++it) {
+            if (!onChild(it->node)) {
+                return next(it) != entries.rend();
+            }
+        }
+        return false;
+    }
+
+    // approximate heap bytes, counted like AttributeIndex
+    size_t memoryUsed() const {
+        size_t treeNode = 4 * sizeof(void*) + sizeof(Entry);
+        size_t hashNode = sizeof(void*) + sizeof(pair<Node* const, Keys>) + sizeof(size_t);
+        size_t bytes = sizeof(SortedChildren) + filed.size() * hashNode + filed.bucket_count() * sizeof(void*);
+        for (int o = 0; o < LIST_ORDER_COUNT; o++) {
+            if (orders[o] != nullptr) {
+                bytes += orders[o]->size() * treeNode;
+            }
+        }
+        return bytes;
+    }
+};
+
+#endif
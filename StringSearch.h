@@ -0,0 +1,135 @@
+// StringSearch.h - vectorized substring search
+//
+// findSubstring(hay, n, needle, m) returns the offset of the first match or
+// n when there is none. the vector versions compare a block of hay positions
+// at once against the needle's first and last byte and only run memcmp on
+// positions where both agree, so the common no-match case moves through
+// 16 (SSE) or 32 (AVX2) bytes per step.
+//
+// the best version for the running CPU is picked once, at first use, with
+// __builtin_cpu_supports. other architectures get the scalar version.
+
+#ifndef STRINGSEARCH_H
+#define STRINGSEARCH_H
+
+#include <cstring>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRINGSEARCH_X86 1
+#endif
+
+using namespace std;
+
+typedef size_t (*SubstringFinder)(const char* hay, size_t n, const char* needle, size_t m);
+
+inline size_t findSubstringScalar(const char* hay, size_t n, const char* needle, size_t m) {
+    if (m == 0) {
+        return 0;
+    }
+    if (m > n) {
+        return n;
+    }
+    const char* end = hay + n - m + 1;
+    const char* p = hay;
+    while (p < end) {
+        p = (const char*)memchr(p, needle[0], end - p);
+        if (p == nullptr) {
+            return n;
+        }
+        if (memcmp(p, needle, m) == 0) {
+            return p - hay;
+        }
+        p++;
+    }
+    return n;
+}
+
+#ifdef STRINGSEARCH_X86
+
+__attribute__((target("sse4.2")))
+inline size_t findSubstringSse(const char* hay, size_t n, const char* needle, size_t m) {
+    if (m < 2 || m > n) {
+        return findSubstringScalar(hay, n, needle, m);
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    // the block at i reads hay[i .. i + m - 1 + 15]
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(hay + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i*)(hay + i + m - 1));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast));
+        unsigned mask = _mm_movemask_epi8(eq);
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = findSubstringScalar(hay + i, n - i, needle, m);
+    return rest == n - i ? n : i + rest;
+}
+
+__attribute__((target("avx2")))
+inline size_t findSubstringAvx2(const char* hay, size_t n, const char* needle, size_t m) {
+    if (m < 2 || m > n) {
+        return findSubstringScalar(hay, n, needle, m);
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(hay + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i*)(hay + i + m - 1));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast));
+        unsigned mask = _mm256_movemask_epi8(eq);
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = findSubstringSse(hay + i, n - i, needle, m);
+    return rest == n - i ? n : i + rest;
+}
+
+#endif
+
+// the fastest version this CPU supports
+inline SubstringFinder bestSubstringFinder() {
+#ifdef STRINGSEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return findSubstringAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return findSubstringSse;
+    }
+#endif
+    return findSubstringScalar;
+}
+
+inline const char* substringFinderName(SubstringFinder finder) {
+#ifdef STRINGSEARCH_X86
+    if (finder == findSubstringAvx2) {
+        return "avx2";
+    }
+    if (finder == findSubstringSse) {
+        return "sse4.2";
+    }
+#endif
+    return "scalar";
+}
+
+inline size_t findSubstring(const char* hay, size_t n, const char* needle, size_t m) {
+    static const SubstringFinder finder = bestSubstringFinder();
+    return finder(hay, n, needle, m);
+}
+
+#endif
@@ -0,0 +1,196 @@
+// Trace.h - opt-in scoped trace events, dumped in Chrome trace format
+//
+// a TraceScope records when it was created and destroyed as one complete
+// ("X") event. each thread appends to its own ring buffer, so recording is
+// a clock read and a few stores with no locks; once a ring is full the
+// oldest events are overwritten. the JSON from traceRegistry().dump() opens in
+// chrome://tracing or ui.perfetto.dev.
+//
+// when tracing is off a TraceScope costs one relaxed atomic load
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+struct TraceEvent {
+    const char* name;      // must be a string literal (or live forever)
+    const char* category;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// one thread's events, written only by that thread
+struct TraceBuffer {
+    static const size_t capacity = 1 << 16;   // per thread, a power of two
+
+    vector<TraceEvent> events;
+    atomic<uint64_t> written;   // total events ever written, the ring index is written % capacity
+    int threadId;
+
+    TraceBuffer(int id) : events(capacity) {
+        written = 0;
+        threadId = id;
+    }
+
+    void add(const char* name, const char* category, uint64_t startNs, uint64_t durationNs) {
+        uint64_t n = written.load(memory_order_relaxed);
+        TraceEvent& e = events[n & (capacity - 1)];
+        e.name = name;
+        e.category = category;
+        e.startNs = startNs;
+        e.durationNs = durationNs;
+        written.store(n + 1, memory_order_release);
+    }
+};
+
+inline uint64_t traceNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class TraceRegistry {
+private:
+    mutex lock;
+    vector<TraceBuffer*> buffers;   // buffers of exited threads are kept until clear()
+    vector<bool> live;
+    int nextThreadId;
+
+public:
+    atomic<bool> enabled;
+
+    TraceRegistry() {
+        nextThreadId = 1;
+        enabled = false;
+    }
+
+    TraceBuffer* add() {
+        lock_guard<mutex> guard(lock);
+        TraceBuffer* buffer = new TraceBuffer(nextThreadId++);
+        buffers.push_back(buffer);
+        live.push_back(true);
+        return buffer;
+    }
+
+    void retire(TraceBuffer* buffer) {
+        lock_guard<mutex> guard(lock);
+        for (int i = 0; i < buffers.size(); i++) {
+            if (buffers[i] == buffer) {
+                live[i] = false;
+                // nothing worth keeping, free it now
+                if (buffer->written.load(memory_order_acquire) == 0) {
+                    delete buffer;
+                    buffers.erase(buffers.begin() + i);
+                    live.erase(live.begin() + i);
+                }
+                break;
+            }
+        }
+    }
+
+    // drops all recorded events and the buffers of exited threads,
+    // call it with tracing off so no thread is writing
+    void clear() {
+        lock_guard<mutex> guard(lock);
+        for (int i = buffers.size() - 1; i >= 0; i--) {
+            if (live[i]) {
+                buffers[i]->written.store(0, memory_order_release);
+            } else {
+                delete buffers[i];
+                buffers.erase(buffers.begin() + i);
+                live.erase(live.begin() + i);
+            }
+        }
+    }
+
+    // writes every buffered event as a Chrome trace JSON object and returns
+    // how many were written. an event another thread is writing at that
+    // moment can show up torn, so turn tracing off first for exact results
+    size_t dump(ostream& out) {
+        lock_guard<mutex> guard(lock);
+        size_t count = 0;
+        char number[64];
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        for (int b = 0; b < buffers.size(); b++) {
+            TraceBuffer* buffer = buffers[b];
+            uint64_t written = buffer->written.load(memory_order_acquire);
+            uint64_t first = written > TraceBuffer::capacity ? written - TraceBuffer::capacity : 0;
+            for (uint64_t i = first; i < written; i++) {
+                TraceEvent& e = buffer->events[i & (TraceBuffer::capacity - 1)];
+                if (count > 0) {
+                    out << ",\n";
+                }
+                // chrome wants microseconds, keep the nanoseconds as decimals
+                snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", e.startNs / 1000.0, e.durationNs / 1000.0);
+                out << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                    << ",\"ts\":" << number << "}";
+                count++;
+            }
+        }
+        out << "\n]}\n";
+        return count;
+    }
+};
+
+inline TraceRegistry& traceRegistry() {
+    static TraceRegistry registry;
+    return registry;
+}
+
+// creates the thread's buffer the first time it traces something
+struct TraceBufferHandle {
+    TraceBuffer* buffer;
+
+    TraceBufferHandle() {
+        buffer = traceRegistry().add();
+    }
+
+    ~TraceBufferHandle() {
+        traceRegistry().retire(buffer);
+    }
+};
+
+inline TraceBuffer& threadTraceBuffer() {
+    static thread_local TraceBufferHandle handle;
+    return *handle.buffer;
+}
+
+inline bool tracingEnabled() {
+    return traceRegistry().enabled.load(memory_order_relaxed);
+}
+
+inline void setTracing(bool on) {
+    traceRegistry().enabled.store(on, memory_order_relaxed);
+}
+
+// records one event covering its own lifetime
+class TraceScope {
+private:
+    const char* name;
+    const char* category;
+    uint64_t start;
+
+public:
+    TraceScope(const char* n, const char* cat) {
+        name = n;
+        category = cat;
+        start = tracingEnabled() ? traceNow() : 0;
+    }
+
+    ~TraceScope() {
+        if (start != 0) {
+            threadTraceBuffer().add(name, category, start, traceNow() - start);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,81 @@
+// TreeWalk.h - depth-first walk of a FileNode tree without recursion
+//
+// walkTree keeps its own stack of (node, next child) frames, so the depth
+// of the tree is limited by memory, not by the call stack. the visitor is a
+// template parameter, so its calls are inlined into the loop.
+//
+// a visitor provides:
+//   bool enter(Node* node, int depth)   pre-order, return false to skip the children
+//   void leave(Node* node, int depth)   post-order, after all children are done
+// leave is called once for every node enter was called on, so a visitor
+// may free a node in leave. deriving from TreeVisitor gives no-op defaults.
+//
+// while it walks a folder it prefetches the children a few places ahead,
+// so their cache misses overlap with the work on the current child.
+
+#ifndef TREEWALK_H
+#define TREEWALK_H
+
+#include <vector>
+
+using namespace std;
+
+struct TreeVisitor {
+    template <typename Node>
+    bool enter(Node*, int) {
+        return true;
+    }
+
+    template <typename Node>
+    void leave(Node*, int) {
+    }
+};
+
+template <typename Node>
+struct WalkFrame {
+    Node* node;
+    size_t next;   // index of the next child to visit
+};
+
+// how many children ahead of the current one to prefetch
+const size_t walkPrefetchDistance = 4;
+
+template <typename Node, typename Visitor>
+void walkTree(Node* start, Visitor& visitor) {
+    vector<WalkFrame<Node>> stack;
+    stack.reserve(64);
+
+    if (!visitor.enter(start, 0)) {
+        visitor.leave(start, 0);
+        return;
+    }
+    stack.push_back(WalkFrame<Node>{start, 0});
+
+    while (stack.size() > 0) {
+        WalkFrame<Node>& frame = stack.back();
+        vector<Node*>& children = frame.node->children;
+
+        if (frame.next >= children.size()) {
+            Node* done = frame.node;
+            stack.pop_back();
+            visitor.leave(done, stack.size());
+            continue;
+        }
+
+        if (frame.next + walkPrefetchDistance < children.size()) {
+            __builtin_prefetch(children[frame.next + walkPrefetchDistance]);
+        }
+        Node* child = children[frame.next];
+        frame.next++;
+
+        int depth = stack.size();
+        if (visitor.enter(child, depth) && child->children.size() > 0) {
+            __builtin_prefetch(child->children.data());
+            stack.push_back(WalkFrame<Node>{child, 0});   // invalidates frame
+        } else {
+            visitor.leave(child, depth);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,463 @@
+// Workload.h - synthetic workload traces for FileSystem
+//
+// WorkloadGenerator produces an operation trace that looks like real use:
+// file names and accessed files follow a Zipf distribution, new folders
+// land at geometrically distributed depths, some folders get crowded, and
+// content sizes are lognormal. WorkloadReplayer drives a FileSystem with a
+// trace on one or more threads and records a latency histogram per op.
+//
+// trace format, one operation per line, tab separated:
+//   <op> <folder path> <name> <content size>
+// op is one of mkdir, touch, write, read, rm, ls, search
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include "FileSystem.h"
+#include "Histogram.h"
+
+using namespace std;
+
+enum TraceOpType { TRACE_MKDIR, TRACE_TOUCH, TRACE_WRITE, TRACE_READ, TRACE_RM, TRACE_LS, TRACE_SEARCH };
+
+const int traceOpCount = 7;
+const char* const traceOpNames[traceOpCount] = {"mkdir", "touch", "write", "read", "rm", "ls", "search"};
+
+struct TraceOp {
+    TraceOpType type;
+    string dir;
+    string name;
+    size_t size;
+};
+
+// knobs for the generator, percentages of the op mix should add up to 100
+struct WorkloadConfig {
+    long long ops;
+    int readPct;
+    int writePct;
+    int createPct;
+    int deletePct;
+    int mkdirPct;
+    int listPct;
+    int searchPct;
+    double zipf;            // skew of name and file popularity, 0 = uniform
+    int vocabulary;         // distinct base file names
+    int maxDepth;
+    double depthDecay;      // chance a new folder goes one level deeper
+    double sizeMedian;      // content bytes
+    double sizeSigma;       // lognormal spread of content size
+    unsigned seed;
+
+    WorkloadConfig() {
+        ops = 100000;
+        readPct = 50;
+        writePct = 20;
+        createPct = 15;
+        deletePct = 5;
+        mkdirPct = 3;
+        listPct = 5;
+        searchPct = 2;
+        zipf = 1.1;
+        vocabulary = 10000;
+        maxDepth = 8;
+        depthDecay = 0.6;
+        sizeMedian = 2048;
+        sizeSigma = 1.5;
+        seed = 42;
+    }
+};
+
+// picks ranks 0..n-1 with probability ~ 1/(rank+1)^s using the inverse of
+// the continuous approximation, so n can change between draws for free
+class ZipfSampler {
+private:
+    double s;
+
+public:
+    ZipfSampler(double skew) {
+        s = skew;
+    }
+
+    long long sample(long long n, mt19937_64& rng) {
+        if (n <= 1) {
+            return 0;
+        }
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double rank;
+        if (s == 0) {
+            rank = u * n;
+        } else if (fabs(s - 1.0) < 1e-9) {
+            rank = pow((double)n + 1, u) - 1;
+        } else {
+            double a = 1.0 - s;
+            rank = pow(u * (pow((double)n + 1, a) - 1) + 1, 1.0 / a) - 1;
+        }
+        long long r = (long long)rank;
+        return r >= n ? n - 1 : (r < 0 ? 0 : r);
+    }
+};
+
+class WorkloadGenerator {
+private:
+    struct GenDir {
+        string path;
+        int depth;
+    };
+
+    struct GenFile {
+        int dir;
+        string name;
+        bool alive;
+    };
+
+    WorkloadConfig config;
+    mt19937_64 rng;
+    ZipfSampler zipf;
+    vector<GenDir> dirs;
+    vector<vector<int> > dirsAtDepth;
+    vector<GenFile> files;          // in creation order, deleted ones stay as holes
+    vector<int> liveFiles;          // indexes into files, Zipf rank = position
+    unordered_map<string, int> usedNames;   // "dir\tname" -> file index
+    long long nextDirId;
+
+    string childPath(const string& dir, const string& name) {
+        return dir == "/" ? "/" + name : dir + "/" + name;
+    }
+
+    string baseName(long long rank) {
+        static const char* const extensions[] = {".txt", ".log", ".csv", ".json", ".cpp", ".h", ".md", ".dat"};
+        return "name" + to_string(rank) + extensions[rank % 8];
+    }
+
+    size_t contentSize() {
+        lognormal_distribution<double> dist(log(config.sizeMedian), config.sizeSigma);
+        return (size_t)dist(rng);
+    }
+
+    // popular files are the ones near the front of liveFiles
+    int pickFile() {
+        return (int)zipf.sample(liveFiles.size(), rng);
+    }
+
+    void addMkdir(vector<TraceOp>& trace) {
+        // depth is geometric: each level deeper is depthDecay times as likely
+        // and can only go as deep as existing folders allow
+        int depth = 1;
+        while (depth < config.maxDepth && depth < dirsAtDepth.size() && dirsAtDepth[depth].size() > 0 &&
+               uniform_real_distribution<double>(0.0, 1.0)(rng) < config.depthDecay) {
+            depth++;
+        }
+        vector<int>& parents = dirsAtDepth[depth - 1];
+        int parent = parents[uniform_int_distribution<size_t>(0, parents.size() - 1)(rng)];
+
+        string name = "dir" + to_string(nextDirId++);
+        TraceOp op;
+        op.type = TRACE_MKDIR;
+        op.dir = dirs[parent].path;
+        op.name = name;
+        op.size = 0;
+        trace.push_back(op);
+
+        GenDir dir;
+        dir.path = childPath(dirs[parent].path, name);
+        dir.depth = depth;
+        if (dirsAtDepth.size() <= depth) {
+            dirsAtDepth.resize(depth + 1);
+        }
+        dirsAtDepth[depth].push_back(dirs.size());
+        dirs.push_back(dir);
+    }
+
+    void addCreate(vector<TraceOp>& trace) {
+        // crowded folders: folder choice is Zipf too
+        int dir = (int)zipf.sample(dirs.size(), rng);
+        string name = baseName(zipf.sample(config.vocabulary, rng));
+        string key = dirs[dir].path + "\t" + name;
+        if (usedNames.count(key) > 0) {
+            name = name + "." + to_string(files.size());
+            key = dirs[dir].path + "\t" + name;
+        }
+
+        TraceOp op;
+        op.type = TRACE_TOUCH;
+        op.dir = dirs[dir].path;
+        op.name = name;
+        op.size = contentSize();
+        trace.push_back(op);
+
+        GenFile file;
+        file.dir = dir;
+        file.name = name;
+        file.alive = true;
+        usedNames[key] = files.size();
+        liveFiles.push_back(files.size());
+        files.push_back(file);
+    }
+
+    void addFileOp(TraceOpType type, vector<TraceOp>& trace) {
+        int pick = pickFile();
+        GenFile& file = files[liveFiles[pick]];
+
+        TraceOp op;
+        op.type = type;
+        op.dir = dirs[file.dir].path;
+        op.name = file.name;
+        op.size = type == TRACE_WRITE ? contentSize() : 0;
+        trace.push_back(op);
+
+        if (type == TRACE_RM) {
+            file.alive = false;
+            usedNames.erase(op.dir + "\t" + op.name);
+            liveFiles.erase(liveFiles.begin() + pick);
+        }
+    }
+
+public:
+    WorkloadGenerator(WorkloadConfig c) : zipf(c.zipf) {
+        config = c;
+        rng.seed(c.seed);
+        nextDirId = 0;
+
+        GenDir root;
+        root.path = "/";
+        root.depth = 0;
+        dirs.push_back(root);
+        dirsAtDepth.resize(1);
+        dirsAtDepth[0].push_back(0);
+    }
+
+    vector<TraceOp> generate() {
+        vector<TraceOp> trace;
+        trace.reserve(config.ops);
+        uniform_int_distribution<int> percent(0, 99);
+
+        for (long long i = 0; i < config.ops; i++) {
+            int roll = percent(rng);
+
+            // nothing to read yet, so start by creating
+            if (liveFiles.size() == 0) {
+                addCreate(trace);
+                continue;
+            }
+
+            if ((roll -= config.readPct) < 0) {
+                addFileOp(TRACE_READ, trace);
+            } else if ((roll -= config.writePct) < 0) {
+                addFileOp(TRACE_WRITE, trace);
+            } else if ((roll -= config.createPct) < 0) {
+                addCreate(trace);
+            } else if ((roll -= config.deletePct) < 0) {
+                addFileOp(TRACE_RM, trace);
+            } else if ((roll -= config.mkdirPct) < 0) {
+                addMkdir(trace);
+            } else if ((roll -= config.listPct) < 0) {
+                TraceOp op;
+                op.type = TRACE_LS;
+                op.dir = dirs[zipf.sample(dirs.size(), rng)].path;
+                op.size = 0;
+                trace.push_back(op);
+            } else {
+                TraceOp op;
+                op.type = TRACE_SEARCH;
+                op.dir = "/";
+                op.name = "name" + to_string(zipf.sample(config.vocabulary, rng));
+                op.size = 0;
+                trace.push_back(op);
+            }
+        }
+        return trace;
+    }
+};
+
+inline void writeTrace(ostream& out, const vector<TraceOp>& trace) {
+    for (size_t i = 0; i < trace.size(); i++) {
+        out << traceOpNames[trace[i].type] << '\t' << trace[i].dir << '\t'
+            << trace[i].name << '\t' << trace[i].size << '\n';
+    }
+}
+
+// reads a trace, returns false on the first malformed line
+inline bool readTrace(istream& in, vector<TraceOp>& trace, string& error) {
+    string line;
+    long long lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        if (line.length() == 0) {
+            continue;
+        }
+        size_t a = line.find('\t');
+        size_t b = a == string::npos ? a : line.find('\t', a + 1);
+        size_t c = b == string::npos ? b : line.find('\t', b + 1);
+        if (c == string::npos) {
+            error = "line " + to_string(lineNumber) + ": expected 4 tab separated fields";
+            return false;
+        }
+
+        TraceOp op;
+        string name = line.substr(0, a);
+        int type = -1;
+        for (int i = 0; i < traceOpCount; i++) {
+            if (name == traceOpNames[i]) {
+                type = i;
+            }
+        }
+        if (type < 0) {
+            error = "line " + to_string(lineNumber) + ": unknown op " + name;
+            return false;
+        }
+        op.type = (TraceOpType)type;
+        op.dir = line.substr(a + 1, b - a - 1);
+        op.name = line.substr(b + 1, c - b - 1);
+        op.size = strtoull(line.c_str() + c + 1, nullptr, 10);
+        trace.push_back(op);
+    }
+    return true;
+}
+
+// results of one replay
+struct ReplayStats {
+    Histogram latency[traceOpCount];   // nanoseconds per op type
+    long long errors[traceOpCount];
+    double seconds;
+
+    ReplayStats() {
+        for (int i = 0; i < traceOpCount; i++) {
+            errors[i] = 0;
+        }
+        seconds = 0;
+    }
+
+    void merge(ReplayStats& other) {
+        for (int i = 0; i < traceOpCount; i++) {
+            latency[i].merge(other.latency[i]);
+            errors[i] += other.errors[i];
+        }
+    }
+};
+
+// drives a FileSystem with a trace. with several threads the FileSystem is
+// shared behind one mutex and each thread owns the top-level subtrees that
+// hash to it, so a folder is always made before the ops inside it run and
+// the ops on any one file keep their order
+class WorkloadReplayer {
+private:
+    FileSystem& fs;
+    mutex fsLock;
+    string filler;          // content source, writes take a prefix of it
+
+    // times one op, including any wait for the lock when threads share fs
+    void runOp(const TraceOp& op, ReplayStats& stats, bool shared) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        unique_lock<mutex> guard(fsLock, defer_lock);
+        if (shared) {
+            guard.lock();
+        }
+        try {
+            fs.setCurrentPath(op.dir);
+            switch (op.type) {
+            case TRACE_MKDIR:
+                fs.createDirectory(op.name);
+                break;
+            case TRACE_TOUCH:
+                fs.createFile(op.name, filler.substr(0, op.size));
+                break;
+            case TRACE_WRITE:
+                fs.writeFile(op.name, filler.substr(0, op.size));
+                break;
+            case TRACE_READ:
+                fs.readFile(op.name);
+                break;
+            case TRACE_RM:
+                fs.deleteFile(op.name);
+                break;
+            case TRACE_LS:
+                fs.listDirectory();
+                break;
+            case TRACE_SEARCH:
+                fs.searchFile(op.name);
+                break;
+            }
+        } catch (exception& e) {
+            stats.errors[op.type]++;
+        }
+        if (shared) {
+            guard.unlock();
+        }
+        stats.latency[op.type].record(chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start).count());
+    }
+
+    // the top-level name an op lives under: "a" for anything in /a/b, the
+    // file or folder's own name for ops directly in /, "" for ls and search
+    // of / itself, which only read and can run anywhere
+    static string shardKey(const TraceOp& op) {
+        if (op.dir != "/") {
+            size_t end = op.dir.find('/', 1);
+            return op.dir.substr(1, end == string::npos ? string::npos : end - 1);
+        }
+        if (op.type == TRACE_LS || op.type == TRACE_SEARCH) {
+            return "";
+        }
+        return op.name;
+    }
+
+public:
+    WorkloadReplayer(FileSystem& f) : fs(f) {}
+
+    ReplayStats replay(const vector<TraceOp>& trace, int threads) {
+        size_t largest = 0;
+        for (size_t i = 0; i < trace.size(); i++) {
+            largest = max(largest, trace[i].size);
+        }
+        filler.assign(largest, 'x');
+        for (size_t i = 0; i < largest; i += 64) {
+            filler[i] = '\n';
+        }
+
+        ReplayStats total;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        if (threads <= 1) {
+            for (size_t i = 0; i < trace.size(); i++) {
+                runOp(trace[i], total, false);
+            }
+        } else {
+            vector<int> shard(trace.size());
+            hash<string> hasher;
+            for (size_t i = 0; i < trace.size(); i++) {
+                shard[i] = hasher(shardKey(trace[i])) % threads;
+            }
+            vector<ReplayStats> perThread(threads);
+            vector<thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.push_back(thread([&, t] {
+                    for (size_t i = 0; i < trace.size(); i++) {
+                        if (shard[i] != t) {
+                            continue;
+                        }
+                        runOp(trace[i], perThread[t], true);
+                    }
+                }));
+            }
+            for (int t = 0; t < threads; t++) {
+                workers[t].join();
+                total.merge(perThread[t]);
+            }
+        }
+
+        total.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return total;
+    }
+};
+
+#endif
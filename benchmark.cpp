@@ -0,0 +1,438 @@
+// benchmark.cpp - microbenchmarks for every FileSystem operation
+// builds trees of different shapes and sizes, times each operation on them
+// and reports ns/op, ops/sec and heap bytes allocated per op
+//
+// usage: benchmark [--max-nodes N] [--shape deep|wide|balanced] [--format text|csv|json]
+//   --max-nodes N  largest tree to build (default 100000, try 10000000)
+//   --shape S      only run one tree shape (default all three)
+//   --format F     text table, csv, or one json object per line
+// the nameScan rows count names scanned, so ops/sec there is names/sec,
+// and the grep row counts bytes, so ops/sec there is bytes/sec
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include "FileSystem.h"
+
+using namespace std;
+
+// every operator new goes through here so we can count allocated bytes
+// the grep rows allocate from worker threads too, hence the atomic.
+// new and both deletes are kept out of line, or gcc matches the malloc
+// and free it inlines against the other side and warns of a mismatch
+atomic<long long> allocatedBytes(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocatedBytes.fetch_add(size, memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// one row of output
+struct BenchResult {
+    string operation;
+    string shape;
+    long long nodes;
+    long long ops;
+    double nsPerOp;
+    double opsPerSec;
+    double bytesPerOp;
+};
+
+// times a batch of operations and the bytes they allocate
+class BenchTimer {
+private:
+    chrono::steady_clock::time_point start;
+    long long startBytes;
+
+public:
+    void begin() {
+        startBytes = allocatedBytes;
+        start = chrono::steady_clock::now();
+    }
+
+    BenchResult end(string operation, string shape, long long nodes, long long ops) {
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        BenchResult result;
+        result.operation = operation;
+        result.shape = shape;
+        result.nodes = nodes;
+        result.ops = ops;
+        result.nsPerOp = ns / ops;
+        result.opsPerSec = ns > 0 ? ops * 1e9 / ns : 0;
+        result.bytesPerOp = (double)(allocatedBytes - startBytes) / ops;
+        return result;
+    }
+};
+
+// fills fs with 'nodes' nodes in the given shape and leaves the current
+// folder at the deepest (deep), only (wide) or last filled (balanced) folder
+void buildTree(FileSystem& fs, string shape, long long nodes) {
+    if (shape == "wide") {
+        for (long long i = 0; i < nodes; i++) {
+            fs.createFile("f" + to_string(i));
+        }
+        return;
+    }
+
+    if (shape == "deep") {
+        // one chain of folders, each also holding one file
+        for (long long i = 0; i < nodes / 2; i++) {
+            fs.createFile("f" + to_string(i));
+            fs.createDirectory("d");
+            fs.changeDirectory("d");
+        }
+        return;
+    }
+
+    // balanced: 16 children per folder, files on the last level
+    int fanout = 16;
+    int levels = 1;
+    long long capacity = fanout;
+    while (capacity < nodes) {
+        capacity = capacity * fanout;
+        levels++;
+    }
+
+    vector<string> queue;
+    vector<int> queueLevel;
+    queue.push_back("/");
+    queueLevel.push_back(1);
+    long long created = 0;
+    for (int q = 0; q < queue.size() && created < nodes; q++) {
+        fs.setCurrentPath(queue[q]);
+        string prefix = queue[q] == "/" ? "/" : queue[q] + "/";
+        for (int i = 0; i < fanout && created < nodes; i++) {
+            if (queueLevel[q] == levels) {
+                fs.createFile("f" + to_string(i));
+            } else {
+                fs.createDirectory("d" + to_string(i));
+                queue.push_back(prefix + "d" + to_string(i));
+                queueLevel.push_back(queueLevel[q] + 1);
+            }
+            created++;
+        }
+    }
+}
+
+// how many times to repeat a cheap per-node operation
+long long opsFor(long long nodes) {
+    return nodes < 10000 ? nodes : 10000;
+}
+
+// how many times to repeat a whole-tree operation
+long long scansFor(long long nodes) {
+    long long scans = 2000000 / (nodes + 1);
+    return scans < 1 ? 1 : (scans > 100 ? 100 : scans);
+}
+
+void runShape(string shape, long long nodes, vector<BenchResult>& results) {
+    ostream discard(nullptr);
+    BenchTimer timer;
+    long long ops = opsFor(nodes);
+
+    {
+        FileSystem fs;
+        fs.setOutput(discard);
+        fs.setJournalLimit(0);   // measure the operations, not the undo journal
+        buildTree(fs, shape, nodes);
+
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            fs.createFile("new" + to_string(i));
+        }
+        results.push_back(timer.end("createFile", shape, nodes, ops));
+
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            fs.createDirectory("newdir" + to_string(i));
+        }
+        results.push_back(timer.end("createDirectory", shape, nodes, ops));
+
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            fs.changeDirectory("newdir0");
+            fs.changeDirectory("..");
+        }
+        results.push_back(timer.end("changeDirectory", shape, nodes, ops * 2));
+
+        string content(64, 'x');
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            fs.writeFile("new" + to_string(i), content);
+        }
+        results.push_back(timer.end("writeFile", shape, nodes, ops));
+
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            fs.readFile("new" + to_string(i));
+        }
+        results.push_back(timer.end("readFile", shape, nodes, ops));
+
+        // pages of 20 by size through the folder just filled; the first
+        // call builds the ordered child index, the rest only walk it
+        string after;
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            after = fs.listPage("", LIST_BY_SIZE, true, 20, after).next;
+        }
+        results.push_back(timer.end("listPage", shape, nodes, ops));
+
+        // content search over 4 KB of text in each new file
+        string page;
+        while (page.length() < 4096) {
+            page += "the quick brown fox jumps over the lazy dog 0123456789\n";
+        }
+        for (long long i = 0; i < ops; i++) {
+            fs.writeFile("new" + to_string(i), page);
+        }
+        long long grepBytes = ops * page.length();
+        timer.begin();
+        GrepStats grep = fs.grepContent("lazy cat", "/", [](const string&, size_t, string_view) {});
+        results.push_back(timer.end("grep", shape, nodes, grepBytes));
+        if (grep.bytes != grepBytes || grep.matches != 0) {
+            cerr << "grep scanned " << grep.bytes << " bytes, expected " << grepBytes << "\n";
+        }
+
+        // the same question answered by the full-text index
+        timer.begin();
+        fs.setTextIndex(true);
+        results.push_back(timer.end("textIndex/build", shape, nodes, ops));
+        long long queries = scansFor(nodes) * 10;
+        timer.begin();
+        for (long long i = 0; i < queries; i++) {
+            fs.searchText("\"lazy cat\"");
+        }
+        results.push_back(timer.end("searchText", shape, nodes, queries));
+        fs.setTextIndex(false);
+
+        // walks every parent, so on a deep chain it costs as much as a scan
+        long long pathOps = shape == "deep" ? scansFor(nodes) : ops;
+        timer.begin();
+        for (long long i = 0; i < pathOps; i++) {
+            fs.getCurrentPath();
+        }
+        results.push_back(timer.end("getCurrentPath", shape, nodes, pathOps));
+
+        timer.begin();
+        for (long long i = 0; i < ops; i++) {
+            fs.deleteFile("new" + to_string(i));
+        }
+        results.push_back(timer.end("deleteFile", shape, nodes, ops));
+
+        long long scans = scansFor(nodes);
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.searchFile("f1");
+        }
+        results.push_back(timer.end("searchFile", shape, nodes, scans));
+
+        // the same files as searchFile("f1"), through the DFA
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.searchPattern("*f1*", PATTERN_GLOB);
+        }
+        results.push_back(timer.end("searchGlob", shape, nodes, scans));
+
+        // big files only: once the first walk has left summaries on the
+        // folders, later walks skip every folder without one
+        FileQuery bigFiles = parseFindArguments("/ -type f -size +1M");
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.findFiles(bigFiles);
+        }
+        results.push_back(timer.end("findFiles", shape, nodes, scans));
+
+        // the first 20 files: a paged walk stops as soon as it has them
+        FileQuery firstPage = parseFindArguments("/ -type f -limit 20");
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.findPage(firstPage);
+        }
+        results.push_back(timer.end("findPage", shape, nodes, scans));
+
+        // "20 largest files": every file without the index, 20 steps with it
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.topFiles(BY_SIZE, 20, "/");
+        }
+        results.push_back(timer.end("topFiles", shape, nodes, scans));
+
+        timer.begin();
+        fs.setAttributeIndex(true);
+        results.push_back(timer.end("attributeIndex/build", shape, nodes, 1));
+
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.topFiles(BY_SIZE, 20, "/");
+        }
+        results.push_back(timer.end("topFiles/idx", shape, nodes, scans));
+        fs.setAttributeIndex(false);
+
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.displayStats();
+        }
+        results.push_back(timer.end("displayStats", shape, nodes, scans));
+
+        // the same scans over the packed node table
+        fs.compact();
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.searchFile("f1");
+        }
+        results.push_back(timer.end("searchFile/tbl", shape, nodes, scans));
+
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.searchPattern("*f1*", PATTERN_GLOB);
+        }
+        results.push_back(timer.end("searchGlob/tbl", shape, nodes, scans));
+
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.findFiles(bigFiles);
+        }
+        results.push_back(timer.end("findFiles/tbl", shape, nodes, scans));
+
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            fs.displayStats();
+        }
+        results.push_back(timer.end("displayStats/tbl", shape, nodes, scans));
+
+        // names scanned per second for a pattern that never matches but
+        // starts with a common letter: string::find on every node, then the
+        // packed name buffer with the scalar and the best vector search
+        const NodeTable<FileNode>& table = fs.nodeTable();
+        long long names = table.rows() * scans;
+        long long hits = 0;
+        timer.begin();
+        for (long long i = 0; i < scans; i++) {
+            for (uint32_t row = 0; row < table.rows(); row++) {
+                if (table.node[row]->name.find("fzz") != string::npos) {
+                    hits++;
+                }
+            }
+        }
+        results.push_back(timer.end("nameScan/find", shape, nodes, names));
+
+        SubstringFinder finders[] = {findSubstringScalar, bestSubstringFinder()};
+        for (int f = 0; f < 2; f++) {
+            vector<uint32_t> rows;
+            timer.begin();
+            for (long long i = 0; i < scans; i++) {
+                table.findNames("fzz", false, rows, finders[f]);
+            }
+            results.push_back(timer.end(string("nameScan/") + substringFinderName(finders[f]), shape, nodes, names));
+            hits += rows.size();
+        }
+        if (hits != 0) {
+            cerr << "nameScan matched " << hits << " names\n";
+        }
+    }
+
+    // getChild on a folder as crowded as the shape's busiest folder
+    long long fanout = shape == "wide" ? nodes : (shape == "deep" ? 2 : 16);
+    FileNode dir("dir", true);
+    vector<string> names;
+    for (long long i = 0; i < fanout; i++) {
+        names.push_back("f" + to_string(i));
+        dir.addChild(new FileNode(names[i], false, &dir));
+    }
+    long long found = 0;
+    timer.begin();
+    for (long long i = 0; i < ops; i++) {
+        if (dir.getChild(names[i % fanout]) != nullptr) {
+            found++;
+        }
+    }
+    results.push_back(timer.end("getChild", shape, nodes, ops));
+    if (found != ops) {
+        cerr << "getChild missed " << (ops - found) << " lookups\n";
+    }
+}
+
+void printResult(BenchResult& r, string format) {
+    if (format == "csv") {
+        cout << r.operation << "," << r.shape << "," << r.nodes << "," << r.ops << ","
+             << r.nsPerOp << "," << r.opsPerSec << "," << r.bytesPerOp << "\n";
+    } else if (format == "json") {
+        cout << "{\"operation\":\"" << r.operation << "\",\"shape\":\"" << r.shape
+             << "\",\"nodes\":" << r.nodes << ",\"ops\":" << r.ops
+             << ",\"ns_per_op\":" << r.nsPerOp << ",\"ops_per_sec\":" << r.opsPerSec
+             << ",\"bytes_per_op\":" << r.bytesPerOp << "}\n";
+    } else {
+        printf("%-16s %-9s %10lld %14.1f %14.0f %12.1f\n", r.operation.c_str(), r.shape.c_str(),
+               r.nodes, r.nsPerOp, r.opsPerSec, r.bytesPerOp);
+    }
+    cout.flush();
+}
+
+int main(int argc, char* argv[]) {
+    long long maxNodes = 100000;
+    string onlyShape = "";
+    string format = "text";
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--max-nodes" && i + 1 < argc) {
+            maxNodes = atoll(argv[++i]);
+        } else if (arg == "--shape" && i + 1 < argc) {
+            onlyShape = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else {
+            cerr << "usage: benchmark [--max-nodes N] [--shape deep|wide|balanced] [--format text|csv|json]\n";
+            return 1;
+        }
+    }
+
+    // 1k, 10k, 100k, ... up to maxNodes
+    vector<long long> sizes;
+    for (long long n = 1000; n < maxNodes; n = n * 10) {
+        sizes.push_back(n);
+    }
+    sizes.push_back(maxNodes);
+
+    vector<string> shapes;
+    shapes.push_back("deep");
+    shapes.push_back("wide");
+    shapes.push_back("balanced");
+
+    if (format == "csv") {
+        cout << "operation,shape,nodes,ops,ns_per_op,ops_per_sec,bytes_per_op\n";
+    } else if (format == "text") {
+        printf("%-16s %-9s %10s %14s %14s %12s\n", "operation", "shape", "nodes",
+               "ns/op", "ops/sec", "bytes/op");
+    }
+
+    for (int s = 0; s < shapes.size(); s++) {
+        if (onlyShape != "" && shapes[s] != onlyShape) {
+            continue;
+        }
+        for (int i = 0; i < sizes.size(); i++) {
+            vector<BenchResult> results;
+            runShape(shapes[s], sizes[i], results);
+            for (int r = 0; r < results.size(); r++) {
+                printResult(results[r], format);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,285 @@
+// loadgen.cpp - load generator for the FileSystem server (main --server)
+// starts many client threads that each run a mix of commands in their own
+// folder, then reports ops/sec and latency percentiles
+//
+// usage: loadgen <socket> [clients] [ops per client] [--binary] [--pipeline N]
+//   --binary      use the binary protocol from Protocol.h instead of text
+//   --pipeline N  binary only: keep N requests in flight per round trip
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "Protocol.h"
+
+using namespace std;
+
+// a blocking client for the text protocol described in Server.h
+class TextClient {
+private:
+    int fd;
+    string buffer;      // bytes read but not yet consumed
+    size_t bufPos;
+
+    bool fill() {
+        char chunk[65536];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.erase(0, bufPos);
+        bufPos = 0;
+        buffer.append(chunk, n);
+        return true;
+    }
+
+public:
+    TextClient() {
+        fd = -1;
+        bufPos = 0;
+    }
+
+    ~TextClient() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool connectTo(string path) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    bool sendRaw(const string& data) {
+        size_t sent = 0;
+        while (sent < data.length()) {
+            ssize_t n = send(fd, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    // reads one "<length>\n<output>" reply
+    bool readReply(string& output) {
+        size_t lineEnd;
+        while ((lineEnd = buffer.find('\n', bufPos)) == string::npos) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        size_t length = strtoull(buffer.c_str() + bufPos, nullptr, 10);
+        bufPos = lineEnd + 1;
+        while (buffer.length() - bufPos < length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        output = buffer.substr(bufPos, length);
+        bufPos += length;
+        return true;
+    }
+
+    // sends one command and waits for its reply
+    bool command(const string& request, string& output) {
+        return sendRaw(request) && readReply(output);
+    }
+};
+
+// builds the i-th request for a client: a rotating create/write/read/pwd/delete mix
+string makeRequest(int i) {
+    string name = "f" + to_string(i / 5);
+    switch (i % 5) {
+    case 0:
+        return "touch " + name + "\n";
+    case 1:
+        return "nano " + name + "\nsome content for " + name + "\nEND\n";
+    case 2:
+        return "cat " + name + "\n";
+    case 3:
+        return "pwd\n";
+    default:
+        return "rm " + name + "\n";
+    }
+}
+
+void runClient(string socketPath, int id, int ops, vector<long long>& latencies, bool& ok) {
+    TextClient client;
+    string output;
+    ok = false;
+    if (!client.connectTo(socketPath)) {
+        return;
+    }
+
+    string dir = "client" + to_string(id);
+    if (!client.command("mkdir " + dir + "\n", output) || !client.command("cd " + dir + "\n", output)) {
+        return;
+    }
+
+    latencies.reserve(ops);
+    for (int i = 0; i < ops; i++) {
+        string request = makeRequest(i);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!client.command(request, output)) {
+            return;
+        }
+        latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start).count());
+    }
+    client.command("exit\n", output);
+    ok = true;
+}
+
+// queues the i-th binary request, the same mix as makeRequest
+void queueRequest(ProtocolClient& client, int i) {
+    string name = "f" + to_string(i / 5);
+    switch (i % 5) {
+    case 0:
+        client.queue(OP_CREATE_FILE, name);
+        break;
+    case 1:
+        client.queue(OP_WRITE_FILE, name, "some content for " + name + "\n");
+        break;
+    case 2:
+        client.queue(OP_READ_FILE, name);
+        break;
+    case 3:
+        client.queue(OP_GET_PATH);
+        break;
+    default:
+        client.queue(OP_DELETE, name);
+        break;
+    }
+}
+
+// binary client: sends 'pipeline' requests per round trip, latency of each
+// request is measured from when its batch was sent
+void runBinaryClient(string socketPath, int id, int ops, int pipeline,
+                     vector<long long>& latencies, bool& ok) {
+    ProtocolClient client;
+    Response resp;
+    ok = false;
+    if (!client.connectTo(socketPath)) {
+        return;
+    }
+
+    string dir = "client" + to_string(id);
+    if (!client.call(resp, OP_CREATE_DIR, dir) || !client.call(resp, OP_CHANGE_DIR, dir)) {
+        return;
+    }
+
+    latencies.reserve(ops);
+    for (int i = 0; i < ops; i += pipeline) {
+        int count = min(pipeline, ops - i);
+        for (int j = 0; j < count; j++) {
+            queueRequest(client, i + j);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!client.flush()) {
+            return;
+        }
+        for (int j = 0; j < count; j++) {
+            if (!client.receive(resp)) {
+                return;
+            }
+            latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now() - start).count());
+        }
+    }
+    ok = true;
+}
+
+// latency at a percentile of an already sorted list, in microseconds
+double percentile(vector<long long>& sorted, double p) {
+    if (sorted.size() == 0) {
+        return 0;
+    }
+    size_t index = (size_t)(p / 100.0 * (sorted.size() - 1));
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: loadgen <socket> [clients] [ops per client] [--binary] [--pipeline N]\n";
+        return 1;
+    }
+    string socketPath = argv[1];
+    int clients = 8;
+    int ops = 10000;
+    bool binary = false;
+    int pipeline = 1;
+
+    int positional = 0;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--binary") {
+            binary = true;
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            pipeline = max(1, atoi(argv[++i]));
+        } else if (positional == 0) {
+            clients = atoi(argv[i]);
+            positional++;
+        } else {
+            ops = atoi(argv[i]);
+        }
+    }
+
+    vector<vector<long long> > latencies(clients);
+    vector<char> results(clients);
+    vector<thread> threads;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < clients; i++) {
+        threads.push_back(thread([&, i] {
+            bool ok;
+            if (binary) {
+                runBinaryClient(socketPath, i, ops, pipeline, latencies[i], ok);
+            } else {
+                runClient(socketPath, i, ops, latencies[i], ok);
+            }
+            results[i] = ok;
+        }));
+    }
+    for (int i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<long long> all;
+    int failed = 0;
+    for (int i = 0; i < clients; i++) {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+        if (!results[i]) {
+            failed++;
+        }
+    }
+    sort(all.begin(), all.end());
+
+    cout << "Protocol: " << (binary ? "binary" : "text");
+    if (binary) {
+        cout << ", pipeline " << pipeline;
+    }
+    cout << "\n";
+    cout << "Clients: " << clients << " (" << failed << " failed)\n";
+    cout << "Operations: " << all.size() << " in " << seconds << " s\n";
+    cout << "Throughput: " << (long long)(all.size() / seconds) << " ops/sec\n";
+    cout << "Latency (us): p50 " << percentile(all, 50)
+         << "  p90 " << percentile(all, 90)
+         << "  p99 " << percentile(all, 99)
+         << "  p99.9 " << percentile(all, 99.9)
+         << "  max " << percentile(all, 100) << "\n";
+    return failed == 0 ? 0 : 1;
+}
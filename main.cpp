@@ -2,8 +2,14 @@
 // This program simulates a file system with different modes to interact with it
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <map>
+#include <chrono>
 #include "FileSystem.h"
+#include "Commands.h"
+#include "Server.h"
+#include <csignal>
 
 using namespace std;
 
@@ -23,6 +29,7 @@ void printCommandMenu() {
     cout << "============================================\n";
     cout << "AVAILABLE COMMANDS:\n";
     cout << "  list               - List files in current directory\n";
+    cout << "  list --sort size --limit 20 - Sorted page (name|size|mtime, -r, --after)\n";
     cout << "  createfolder [name] - Create a new folder\n";
     cout << "  openfolder [name]  - Open a folder (.. for parent)\n";
     cout << "  createfile [name]  - Create a new file\n";
@@ -30,9 +37,17 @@ void printCommandMenu() {
     cout << "  view [name]        - View file content\n";
     cout << "  delete [name]      - Delete file/folder\n";
     cout << "  findfile [name]    - Search for file by name\n";
+    cout << "  glob [pattern]     - Find files by wildcard, like *.log\n";
+    cout << "  regex [pattern]    - Find files by regular expression\n";
+    cout << "  searchtext [text]  - Search inside files\n";
     cout << "  details [name]     - Show file details\n";
     cout << "  where              - Show current directory path\n";
     cout << "  report             - Show system statistics\n";
+    cout << "  memstats [path]    - Show memory used by a folder\n";
+    cout << "  import [hostdir]   - Copy a real folder from disk into this folder\n";
+    cout << "  export [hostdir]   - Write this folder out to disk (name.tar for an archive)\n";
+    cout << "  undo               - Undo last change\n";
+    cout << "  redo               - Redo last undone change\n";
     cout << "  mode               - Switch mode\n";
     cout << "  exit               - Quit program\n\n";
 }
@@ -54,15 +69,16 @@ void printCLILearningMenu() {
     cout << "  9. Show file details\n";
     cout << " 10. Show current location\n";
     cout << " 11. Show statistics\n";
-    cout << " 12. Switch mode\n";
-    cout << " 13. Exit\n\n";
+    cout << " 12. Undo last change\n";
+    cout << " 13. Redo last undone change\n";
+    cout << " 14. Switch mode\n";
+    cout << " 15. Exit\n\n";
 }
 
 // Intuitive mode - uses simple english commands
 void normalMode(FileSystem& fs) {
     string input;
-    string command;
-    string argument;
+    CommandContext ctx(fs, cin, true, STYLE_INTUITIVE);
 
     printCommandMenu();
 
@@ -74,213 +90,100 @@ void normalMode(FileSystem& fs) {
             continue;
         }
 
-        // split input into command and argument
-        int spacePos = input.find(' ');
-        if (spacePos == string::npos) {
-            command = input;
-            argument = "";
-        } else {
-            command = input.substr(0, spacePos);
-            argument = input.substr(spacePos + 1);
+        CommandResult result = runCommandLine(input, ctx);
+        if (result == SWITCH_MODE) {
+            return;
         }
-
-        // handle commands with try-catch for exceptions
-        try {
-            if (command == "list") {
-                fs.listDirectory();
-            }
-            else if (command == "createfolder") {
-                if (argument == "") {
-                    cout << "Usage: createfolder [name]\n";
-                } else {
-                    fs.createDirectory(argument);
-                }
-            }
-            else if (command == "openfolder") {
-                if (argument == "") {
-                    cout << "Usage: openfolder [name]\n";
-                } else {
-                    fs.changeDirectory(argument);
-                }
-            }
-            else if (command == "createfile") {
-                if (argument == "") {
-                    cout << "Usage: createfile [name]\n";
-                } else {
-                    fs.createFile(argument);
-                }
-            }
-            else if (command == "editfile") {
-                if (argument == "") {
-                    cout << "Usage: editfile [name]\n";
-                } else {
-                    cout << "Enter content (type 'END' on new line to finish):\n";
-                    string content = "";
-                    string line;
-                    while (getline(cin, line)) {
-                        if (line == "END") {
-                            break;
-                        }
-                        content = content + line + "\n";
-                    }
-                    fs.writeFile(argument, content);
-                }
-            }
-            else if (command == "view") {
-                if (argument == "") {
-                    cout << "Usage: view [name]\n";
-                } else {
-                    fs.readFile(argument);
-                }
-            }
-            else if (command == "delete") {
-                if (argument == "") {
-                    cout << "Usage: delete [name]\n";
-                } else {
-                    fs.deleteFile(argument);
-                }
-            }
-            else if (command == "findfile") {
-                if (argument == "") {
-                    cout << "Usage: findfile [name]\n";
-                } else {
-                    fs.searchFile(argument);
-                }
-            }
-            else if (command == "details") {
-                if (argument == "") {
-                    cout << "Usage: details [name]\n";
-                } else {
-                    fs.fileInfo(argument);
-                }
-            }
-            else if (command == "where") {
-                cout << fs.getCurrentPath() << "\n";
-            }
-            else if (command == "report") {
-                fs.displayStats();
-            }
-            else if (command == "mode") {
-                return;
-            }
-            else if (command == "exit") {
-                cout << "Goodbye!\n";
-                exit(0);
-            }
-            else {
-                cout << "Unknown command. Type 'mode' to switch, 'exit' to quit.\n";
-            }
-        }
-        catch (exception& e) {
-            cout << "Error: " << e.what() << "\n";
+        if (result == EXIT_PROGRAM) {
+            cout << "Goodbye!\n";
+            exit(0);
         }
     }
 }
 
+// one numbered option in CLI learning mode
+struct LessonOption {
+    CommandId command;
+    const char* unixName;   // echoed as "$ name arg", nullptr if not a unix command
+    const char* heading;    // nullptr for no heading
+    const char* prompt;     // asks for the argument, nullptr if none needed
+};
+
+// options 1-15 in the order printed by printCLILearningMenu
+const LessonOption lessonOptions[] = {
+    {CMD_LIST, "ls", "Unix Command: ls", nullptr},
+    {CMD_MKDIR, "mkdir", "Unix Command: mkdir", "Enter folder name: "},
+    {CMD_CD, "cd", "Unix Command: cd", "Enter folder name (use .. for parent): "},
+    {CMD_TOUCH, "touch", "Unix Command: touch", "Enter file name: "},
+    {CMD_CAT, "cat", "Unix Command: cat", "Enter file name: "},
+    {CMD_NANO, "nano", "Unix Command: nano", "Enter file name: "},
+    {CMD_RM, "rm", "Unix Command: rm", "Enter file/folder name: "},
+    {CMD_FIND, "find", "Unix Command: find", "Enter search term: "},
+    {CMD_STAT, "stat", "Unix Command: stat", "Enter file name: "},
+    {CMD_PWD, "pwd", "Unix Command: pwd", nullptr},
+    {CMD_INFO, nullptr, "Statistics", nullptr},
+    {CMD_UNDO, nullptr, "Undo", nullptr},
+    {CMD_REDO, nullptr, "Redo", nullptr},
+    {CMD_MODE, nullptr, nullptr, nullptr},
+    {CMD_EXIT, nullptr, nullptr, nullptr},
+};
+
+const int lessonOptionCount = sizeof(lessonOptions) / sizeof(lessonOptions[0]);
+
 // CLI learning mode - teaches unix commands
 void cliLearningMode(FileSystem& fs) {
     string choice;
-    string arg;
+    CommandContext ctx(fs, cin, true, STYLE_UNIX);
 
     while (true) {
         printCLILearningMenu();
         cout << "Enter option: ";
         getline(cin, choice);
 
-        try {
-            if (choice == "1") {
-                cout << "\n--- Unix Command: ls ---\n";
-                cout << "$ ls\n";
-                fs.listDirectory();
-            }
-            else if (choice == "2") {
-                cout << "\n--- Unix Command: mkdir ---\n";
-                cout << "Enter folder name: ";
-                getline(cin, arg);
-                cout << "$ mkdir " << arg << "\n";
-                fs.createDirectory(arg);
-            }
-            else if (choice == "3") {
-                cout << "\n--- Unix Command: cd ---\n";
-                cout << "Enter folder name (use .. for parent): ";
-                getline(cin, arg);
-                cout << "$ cd " << arg << "\n";
-                fs.changeDirectory(arg);
-            }
-            else if (choice == "4") {
-                cout << "\n--- Unix Command: touch ---\n";
-                cout << "Enter file name: ";
-                getline(cin, arg);
-                cout << "$ touch " << arg << "\n";
-                fs.createFile(arg);
-            }
-            else if (choice == "5") {
-                cout << "\n--- Unix Command: cat ---\n";
-                cout << "Enter file name: ";
-                getline(cin, arg);
-                cout << "$ cat " << arg << "\n";
-                fs.readFile(arg);
-            }
-            else if (choice == "6") {
-                cout << "\n--- Unix Command: nano ---\n";
-                cout << "Enter file name: ";
-                getline(cin, arg);
-                cout << "$ nano " << arg << "\n";
-                cout << "Enter content (type 'END' on new line to finish):\n";
-                string content = "";
-                string line;
-                while (getline(cin, line)) {
-                    if (line == "END") {
-                        break;
-                    }
-                    content = content + line + "\n";
-                }
-                fs.writeFile(arg, content);
-            }
-            else if (choice == "7") {
-                cout << "\n--- Unix Command: rm ---\n";
-                cout << "Enter file/folder name: ";
-                getline(cin, arg);
-                cout << "$ rm " << arg << "\n";
-                fs.deleteFile(arg);
-            }
-            else if (choice == "8") {
-                cout << "\n--- Unix Command: find ---\n";
-                cout << "Enter search term: ";
-                getline(cin, arg);
-                cout << "$ find " << arg << "\n";
-                fs.searchFile(arg);
-            }
-            else if (choice == "9") {
-                cout << "\n--- Unix Command: stat ---\n";
-                cout << "Enter file name: ";
-                getline(cin, arg);
-                cout << "$ stat " << arg << "\n";
-                fs.fileInfo(arg);
-            }
-            else if (choice == "10") {
-                cout << "\n--- Unix Command: pwd ---\n";
-                cout << "$ pwd\n";
-                cout << fs.getCurrentPath() << "\n";
-            }
-            else if (choice == "11") {
-                cout << "\n--- Statistics ---\n";
-                fs.displayStats();
-            }
-            else if (choice == "12") {
-                cout << "Switching mode...\n";
-                return;
-            }
-            else if (choice == "13") {
-                cout << "Goodbye!\n";
-                exit(0);
+        // options are the numbers 1 to lessonOptionCount
+        int number = 0;
+        if (choice.length() == 0 || choice.length() > 2) {
+            number = -1;
+        }
+        for (int i = 0; i < choice.length() && number >= 0; i++) {
+            if (choice[i] < '0' || choice[i] > '9') {
+                number = -1;
+            } else {
+                number = number * 10 + (choice[i] - '0');
             }
-            else {
-                cout << "Invalid choice. Try again.\n";
+        }
+        if (number < 1 || number > lessonOptionCount) {
+            cout << "Invalid choice. Try again.\n";
+            continue;
+        }
+
+        const LessonOption& option = lessonOptions[number - 1];
+        if (option.heading != nullptr) {
+            cout << "\n--- " << option.heading << " ---\n";
+        }
+
+        ctx.name = option.unixName != nullptr ? option.unixName : "";
+        ctx.argument = "";
+        if (option.prompt != nullptr) {
+            cout << option.prompt;
+            getline(cin, ctx.argument);
+        }
+        if (option.unixName != nullptr) {
+            cout << "$ " << option.unixName;
+            if (option.prompt != nullptr) {
+                cout << " " << ctx.argument;
             }
+            cout << "\n";
         }
-        catch (exception& e) {
-            cout << "Error: " << e.what() << "\n";
+
+        CommandResult result = runCommand(option.command, ctx);
+        if (result == SWITCH_MODE) {
+            cout << "Switching mode...\n";
+            return;
+        }
+        if (result == EXIT_PROGRAM) {
+            cout << "Goodbye!\n";
+            exit(0);
         }
     }
 }
@@ -288,8 +191,7 @@ void cliLearningMode(FileSystem& fs) {
 // Full CLI mode - uses real unix-style commands
 void fullCLIMode(FileSystem& fs) {
     string input;
-    string command;
-    string argument;
+    CommandContext ctx(fs, cin, true, STYLE_UNIX);
 
     cout << "============================================\n";
     cout << "             FULL CLI MODE\n";
@@ -297,6 +199,7 @@ void fullCLIMode(FileSystem& fs) {
     cout << "============================================\n";
     cout << "AVAILABLE COMMANDS:\n";
     cout << "  ls                 - List directory\n";
+    cout << "  ls --sort size|mtime|name [-r] [--limit n] [--after token] [path] - Sorted page\n";
     cout << "  mkdir [name]       - Create folder\n";
     cout << "  cd [name]          - Change directory (.. for parent)\n";
     cout << "  touch [name]       - Create file\n";
@@ -304,9 +207,27 @@ void fullCLIMode(FileSystem& fs) {
     cout << "  nano [name]        - Edit file\n";
     cout << "  rm [name]          - Delete file/folder\n";
     cout << "  find [name]        - Search for file\n";
+    cout << "  find [path] -type f|d -size +10M -mmin -60 -maxdepth n -name glob\n";
+    cout << "                     - Find by size, type, age, depth and name\n";
+    cout << "                       (-limit n -offset n -after token to page)\n";
+    cout << "  glob [pattern]     - Find files by wildcard (*.log, /src/**/*.h)\n";
+    cout << "  regex [pattern]    - Find files by regular expression\n";
+    cout << "  grep [text] [path] - Search file contents\n";
+    cout << "  index on|off       - Keep a full-text index of file contents\n";
+    cout << "  index attrs on|off - Keep ordered size and mtime indexes\n";
+    cout << "  top size|mtime [n] [path] - Largest or most recently changed files\n";
+    cout << "  import [hostdir] [path] - Copy a real folder from disk into the tree\n";
+    cout << "  export [hostdir|file.tar] [path] - Write a folder out to disk or a tar archive\n";
+    cout << "  search [query]     - Indexed search: words, \"a phrase\", -not, OR\n";
     cout << "  stat [name]        - Show file details\n";
     cout << "  pwd                - Show current path\n";
     cout << "  info               - Show statistics\n";
+    cout << "  du [path]          - Show memory used by a folder\n";
+    cout << "  undo               - Undo last change\n";
+    cout << "  redo               - Redo last undone change\n";
+    cout << "  compact            - Pack the tree into arrays for faster scans\n";
+    cout << "  metrics [dump file|reset|sample n] - Operation counts and latency\n";
+    cout << "  trace on|off|dump file|clear - Record a Chrome trace\n";
     cout << "  mode               - Switch mode\n";
     cout << "  exit               - Quit\n\n";
 
@@ -318,118 +239,144 @@ void fullCLIMode(FileSystem& fs) {
             continue;
         }
 
-        // split into command and argument
-        int spacePos = input.find(' ');
-        if (spacePos == string::npos) {
-            command = input;
-            argument = "";
-        } else {
-            command = input.substr(0, spacePos);
-            argument = input.substr(spacePos + 1);
+        CommandResult result = runCommandLine(input, ctx);
+        if (result == SWITCH_MODE) {
+            cout << "Switching mode...\n";
+            return;
+        }
+        if (result == EXIT_PROGRAM) {
+            cout << "Goodbye!\n";
+            exit(0);
         }
+    }
+}
 
-        try {
-            if (command == "ls") {
-                fs.listDirectory();
-            }
-            else if (command == "mkdir") {
-                if (argument == "") {
-                    cout << "mkdir: missing operand\n";
-                } else {
-                    fs.createDirectory(argument);
-                }
-            }
-            else if (command == "cd") {
-                if (argument == "") {
-                    cout << "cd: missing operand\n";
-                } else {
-                    fs.changeDirectory(argument);
-                }
-            }
-            else if (command == "touch") {
-                if (argument == "") {
-                    cout << "touch: missing operand\n";
-                } else {
-                    fs.createFile(argument);
-                }
-            }
-            else if (command == "cat") {
-                if (argument == "") {
-                    cout << "cat: missing operand\n";
-                } else {
-                    fs.readFile(argument);
-                }
-            }
-            else if (command == "nano") {
-                if (argument == "") {
-                    cout << "nano: missing operand\n";
-                } else {
-                    cout << "Enter content (type 'END' on new line to finish):\n";
-                    string content = "";
-                    string line;
-                    while (getline(cin, line)) {
-                        if (line == "END") {
-                            break;
-                        }
-                        content = content + line + "\n";
-                    }
-                    fs.writeFile(argument, content);
-                }
-            }
-            else if (command == "rm") {
-                if (argument == "") {
-                    cout << "rm: missing operand\n";
-                } else {
-                    fs.deleteFile(argument);
-                }
-            }
-            else if (command == "find") {
-                if (argument == "") {
-                    cout << "find: missing operand\n";
-                } else {
-                    fs.searchFile(argument);
-                }
-            }
-            else if (command == "stat") {
-                if (argument == "") {
-                    cout << "stat: missing operand\n";
-                } else {
-                    fs.fileInfo(argument);
-                }
-            }
-            else if (command == "pwd") {
-                cout << fs.getCurrentPath() << "\n";
-            }
-            else if (command == "info") {
-                fs.displayStats();
-            }
-            else if (command == "mode") {
-                cout << "Switching mode...\n";
-                return;
-            }
-            else if (command == "exit" || command == "quit") {
-                cout << "Goodbye!\n";
-                exit(0);
-            }
-            else if (command == "help") {
-                cout << "Commands: ls, mkdir, cd, touch, cat, nano, rm, find, stat, pwd, info\n";
-                cout << "Use 'mode' to switch modes, 'exit' to quit\n\n";
-            }
-            else {
-                cout << "Command not found: " << command << "\n";
-            }
+// timing totals for one command name in batch mode
+struct CommandTiming {
+    long long count;
+    long long totalNs;
+    long long maxNs;
+    long long dispatchNs;   // time spent parsing and looking up the command
+};
+
+// Batch mode - runs Full CLI commands from a file (or stdin) with no prompts
+// output is fully buffered and per-command timings go to stderr at the end
+int batchMode(FileSystem& fs, istream& in) {
+    // don't flush cout before every read, let the stream buffer the output
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+
+    map<string, CommandTiming> timings;
+    CommandContext ctx(fs, in, false, STYLE_UNIX);
+    string input;
+    long long total = 0;
+    chrono::steady_clock::time_point batchStart = chrono::steady_clock::now();
+
+    while (getline(in, input)) {
+        if (input.length() == 0) {
+            continue;
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        splitCommand(input, ctx);
+        CommandId id = lookupCommand(ctx.name);
+        chrono::steady_clock::time_point dispatched = chrono::steady_clock::now();
+        CommandResult result = runCommand(id, ctx);
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        long long ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+
+        CommandTiming& timing = timings[ctx.name];
+        timing.count++;
+        timing.totalNs += ns;
+        timing.dispatchNs += chrono::duration_cast<chrono::nanoseconds>(dispatched - start).count();
+        if (ns > timing.maxNs) {
+            timing.maxNs = ns;
         }
-        catch (exception& e) {
-            cout << "Error: " << e.what() << "\n";
+        total++;
+
+        if (result == EXIT_PROGRAM) {
+            break;
         }
     }
+    cout.flush();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - batchStart).count();
+    cerr << "\n--- Batch Timings ---\n";
+    cerr << "Commands: " << total << " in " << seconds << " s";
+    if (seconds > 0) {
+        cerr << " (" << (long long)(total / seconds) << " ops/sec)";
+    }
+    cerr << "\n";
+    for (map<string, CommandTiming>::iterator it = timings.begin(); it != timings.end(); ++it) {
+        CommandTiming& timing = it->second;
+        cerr << it->first << ": " << timing.count << " calls, "
+             << (timing.totalNs / timing.count) << " ns avg, "
+             << timing.maxNs << " ns max, "
+             << (timing.dispatchNs / timing.count) << " ns dispatch\n";
+    }
+    return 0;
+}
+
+// Server mode - shares one FileSystem with every client on a unix socket
+FileSystemServer* activeServer = nullptr;
+
+void stopServer(int) {
+    if (activeServer != nullptr) {
+        activeServer->stop();
+    }
+}
+
+int serverMode(FileSystem& fs, string socketPath, int workers, bool hostAccess) {
+    FileSystemServer server(fs, socketPath, workers, hostAccess);
+    activeServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+
+    try {
+        server.run();
+    } catch (exception& e) {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    activeServer = nullptr;
+    return 0;
 }
 
 // Main function - where the program starts
-int main() {
+// usage: main                             interactive menu
+//        main --batch [file]              run Full CLI commands from file (or stdin)
+//        main --server <socket> [workers] [--host-access]
+//                                         serve Full CLI commands on a unix socket,
+//                                         --host-access allows import, export and dumps
+int main(int argc, char* argv[]) {
     FileSystem fs;
     int choice;
 
+    if (argc > 2 && string(argv[1]) == "--server") {
+        int workers = 0;
+        bool hostAccess = false;
+        for (int i = 3; i < argc; i++) {
+            if (string(argv[i]) == "--host-access") {
+                hostAccess = true;
+            } else {
+                workers = atoi(argv[i]);
+            }
+        }
+        return serverMode(fs, argv[2], workers, hostAccess);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        if (argc > 2) {
+            ifstream file(argv[2]);
+            if (!file) {
+                cerr << "Cannot open batch file: " << argv[2] << "\n";
+                return 1;
+            }
+            return batchMode(fs, file);
+        }
+        return batchMode(fs, cin);
+    }
+
     cout << "============================================\n";
     cout << "        FILE MANAGEMENT SYSTEM\n";
     cout << "============================================\n";
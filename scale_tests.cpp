@@ -0,0 +1,338 @@
+// scale_tests.cpp - scale and stress tests for the FileSystem class
+// builds trees far bigger than tests.cpp does and checks that the results
+// are still right and that time and memory stay within budget
+//
+// usage: scale_tests [--quick]
+//   --quick  a tenth of the sizes, for sanitizer or debug builds
+// build with optimizations on, the budgets assume an -O2 build
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/resource.h>
+#include "FileSystem.h"
+
+using namespace std;
+
+int testsPassed = 0;
+int testsFailed = 0;
+long long scale = 1;   // sizes are divided by this with --quick
+
+// only prints if test fails
+void check(string testName, string subtest, bool passed) {
+    if (passed) {
+        testsPassed++;
+    } else {
+        cout << "[FAIL] " << testName << " - " << subtest << "\n";
+        testsFailed++;
+    }
+}
+
+// seconds since 'start'
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// peak resident memory of the whole process so far
+long long peakResidentBytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (long long)usage.ru_maxrss * 1024;
+}
+
+// prints one timing line so budget failures are easy to diagnose
+void report(string testName, string step, double seconds) {
+    printf("  %-16s %-28s %8.3f s\n", testName.c_str(), step.c_str(), seconds);
+}
+
+// the displayStats numbers, read back from its output
+void readStats(FileSystem& fs, long long& files, long long& dirs) {
+    ostringstream out;
+    ostream& previous = fs.output();
+    fs.setOutput(out);
+    fs.displayStats();
+    fs.setOutput(previous);
+    string text = out.str();
+    files = atoll(text.substr(text.find("Total Files: ") + 13).c_str());
+    dirs = atoll(text.substr(text.find("Total Directories: ") + 19).c_str());
+}
+
+// TEST: millions of nodes in a balanced tree
+void testMillionNodes() {
+    string test = "Million Nodes";
+    long long target = 2000000 / scale;
+    ostream discard(nullptr);
+
+    auto start = chrono::steady_clock::now();
+    FileSystem* fs = new FileSystem();
+    fs->setOutput(discard);
+    fs->setJournalLimit(0);
+
+    // 100 folders per level, 100 files in each leaf folder
+    long long dirs = 0;
+    long long files = 0;
+    for (int a = 0; a < 100 && files < target; a++) {
+        fs->setCurrentPath("/");
+        fs->createDirectory("a" + to_string(a));
+        fs->changeDirectory("a" + to_string(a));
+        dirs++;
+        for (int b = 0; b < 100 && files < target; b++) {
+            fs->createDirectory("b" + to_string(b));
+            fs->changeDirectory("b" + to_string(b));
+            dirs++;
+            for (int f = 0; f < 200 && files < target; f++) {
+                fs->createFile("file" + to_string(f) + ".txt");
+                files++;
+            }
+            fs->changeDirectory("..");
+        }
+    }
+    double buildTime = secondsSince(start);
+    report(test, "build " + to_string(files + dirs) + " nodes", buildTime);
+    check(test, "build should take under 10 s", buildTime < 10);
+
+    long long countedFiles = 0;
+    long long countedDirs = 0;
+    start = chrono::steady_clock::now();
+    readStats(*fs, countedFiles, countedDirs);
+    double statsTime = secondsSince(start);
+    report(test, "displayStats", statsTime);
+    check(test, "stats should count every file", countedFiles == files);
+    check(test, "stats should count every folder and the root", countedDirs == dirs + 1);
+    check(test, "stats should take under 1 s", statsTime < 1);
+
+    start = chrono::steady_clock::now();
+    vector<string> found = fs->searchFile("file7.txt");
+    double searchTime = secondsSince(start);
+    report(test, "searchFile", searchTime);
+    check(test, "search should find the file in every leaf folder", found.size() == (files + 199) / 200);
+    check(test, "search should build full paths", found.size() > 0 && found[0] == "root/a0/b0/file7.txt");
+    check(test, "search should take under 1 s", searchTime < 1);
+
+    // memory per node, counting the tree only
+    MemoryUsage usage = fs->getMemoryUsage("/");
+    double bytesPerNode = (double)usage.total() / usage.nodes;
+    printf("  %-16s %-28s %8.1f bytes\n", test.c_str(), "memory per node", bytesPerNode);
+    check(test, "memory accounting should see every node", usage.nodes == files + dirs + 1);
+    check(test, "a node should cost under 400 bytes", bytesPerNode < 400);
+
+    start = chrono::steady_clock::now();
+    delete fs;
+    double freeTime = secondsSince(start);
+    report(test, "destroy", freeTime);
+    check(test, "destroy should take under 2 s", freeTime < 2);
+}
+
+// TEST: the same tree as testMillionNodes, made by one bulkLoad call
+void testBulkLoad() {
+    string test = "Bulk Load";
+    long long target = 2000000 / scale;
+    ostream discard(nullptr);
+
+    // sorted by bulkPathLess, the way a manifest would come in
+    vector<BulkEntry> entries;
+    entries.reserve(target);
+    for (int a = 0; a < 100 && (long long)entries.size() < target; a++) {
+        for (int b = 0; b < 100 && (long long)entries.size() < target; b++) {
+            string folder = "/a" + to_string(a) + "/b" + to_string(b) + "/";
+            for (int f = 0; f < 200 && (long long)entries.size() < target; f++) {
+                entries.push_back(BulkEntry{folder + "file" + to_string(f) + ".txt", "", false});
+            }
+        }
+    }
+    sort(entries.begin(), entries.end(), [](const BulkEntry& x, const BulkEntry& y) {
+        return bulkPathLess(x.path, y.path);
+    });
+
+    auto start = chrono::steady_clock::now();
+    FileSystem* fs = new FileSystem();
+    fs->setOutput(discard);
+    size_t made = fs->bulkLoad(move(entries));
+    double loadTime = secondsSince(start);
+    report(test, "load " + to_string(made) + " nodes", loadTime);
+    check(test, "load should take under 3 s", loadTime < 3);
+
+    long long countedFiles = 0;
+    long long countedDirs = 0;
+    readStats(*fs, countedFiles, countedDirs);
+    check(test, "every file should be loaded", countedFiles == target);
+    check(test, "parent folders should be made", countedDirs + countedFiles == (long long)made + 1);
+    check(test, "loaded tree should be searchable", fs->searchFile("file7.txt").size() == (target + 199) / 200);
+
+    start = chrono::steady_clock::now();
+    delete fs;
+    double freeTime = secondsSince(start);
+    report(test, "destroy", freeTime);
+    check(test, "destroy should take under 2 s", freeTime < 2);
+}
+
+// TEST: a chain of 100k folders, deep enough to overflow any recursive walk
+void testDeepChain() {
+    string test = "Deep Chain";
+    long long depth = 100000 / scale;
+    ostream discard(nullptr);
+
+    auto start = chrono::steady_clock::now();
+    FileSystem* fs = new FileSystem();
+    fs->setOutput(discard);
+    fs->setJournalLimit(0);
+    for (long long i = 0; i < depth; i++) {
+        fs->createDirectory("d");
+        fs->changeDirectory("d");
+    }
+    fs->createFile("bottom.txt", "found me");
+    report(test, "build " + to_string(depth) + " levels", secondsSince(start));
+
+    string path = fs->getCurrentPath();
+    check(test, "path should have every level", path.length() == depth * 2);
+
+    start = chrono::steady_clock::now();
+    vector<string> found = fs->searchFile("bottom");
+    double searchTime = secondsSince(start);
+    report(test, "searchFile", searchTime);
+    check(test, "search should reach the bottom", found.size() == 1);
+    check(test, "search path should hold every level",
+          found.size() == 1 && found[0].length() == string("root/").length() + depth * 2 + string("bottom.txt").length());
+    check(test, "search should be linear in depth", searchTime < 1);
+
+    long long files = 0;
+    long long dirs = 0;
+    readStats(*fs, files, dirs);
+    check(test, "stats should reach the bottom", files == 1 && dirs == depth + 1);
+    check(test, "memory accounting should reach the bottom", fs->getMemoryUsage("/").nodes == depth + 2);
+
+    // path lookups from the root walk the whole chain
+    fs->setCurrentPath("/");
+    start = chrono::steady_clock::now();
+    fs->setCurrentPath(path);
+    check(test, "setCurrentPath should resolve the full path", fs->readFile("bottom.txt") == "found me");
+    check(test, "resolving the path should take under 1 s", secondsSince(start) < 1);
+
+    start = chrono::steady_clock::now();
+    delete fs;
+    report(test, "destroy", secondsSince(start));
+    check(test, "destroy should not overflow the stack", true);
+}
+
+// TEST: one folder holding a million files
+void testHugeDirectory() {
+    string test = "Huge Directory";
+    long long count = 1000000 / scale;
+    ostream discard(nullptr);
+
+    auto start = chrono::steady_clock::now();
+    FileSystem fs;
+    fs.setOutput(discard);
+    fs.setJournalLimit(0);
+    for (long long i = 0; i < count; i++) {
+        fs.createFile("f" + to_string(i));
+    }
+    double buildTime = secondsSince(start);
+    report(test, "create " + to_string(count) + " files", buildTime);
+    check(test, "create should take under 5 s", buildTime < 5);
+
+    // every lookup goes through childIndex, not a scan
+    start = chrono::steady_clock::now();
+    long long hits = 0;
+    for (long long i = 0; i < count; i += 7) {
+        try {
+            fs.readFile("f" + to_string(i));
+            hits++;
+        } catch (FileNotFoundException& e) {
+        }
+    }
+    double lookupTime = secondsSince(start);
+    report(test, "readFile every 7th", lookupTime);
+    check(test, "every file should be found", hits == (count + 6) / 7);
+    check(test, "lookups should take under 1 s", lookupTime < 1);
+
+    bool threw = false;
+    try {
+        fs.createFile("f0");
+    } catch (AlreadyExistsException& e) {
+        threw = true;
+    }
+    check(test, "duplicate should still be rejected", threw);
+
+    start = chrono::steady_clock::now();
+    fs.listDirectory();
+    report(test, "listDirectory", secondsSince(start));
+    check(test, "listing should take under 2 s", secondsSince(start) < 2);
+
+    // deletes from the end of the folder
+    start = chrono::steady_clock::now();
+    for (long long i = count - 1; i >= count - 1000; i--) {
+        fs.deleteFile("f" + to_string(i));
+    }
+    double deleteTime = secondsSince(start);
+    report(test, "delete last 1000", deleteTime);
+    check(test, "deletes should take under 1 s", deleteTime < 1);
+    check(test, "deleted files should be gone", fs.searchFile("f" + to_string(count - 1)).size() == 0);
+    long long files = 0;
+    long long dirs = 0;
+    readStats(fs, files, dirs);
+    check(test, "stats should see the deletes", files == count - 1000);
+}
+
+// TEST: undo journal stays inside its budget under heavy churn
+void testJournalChurn() {
+    string test = "Journal Churn";
+    long long ops = 200000 / scale;
+    ostream discard(nullptr);
+
+    FileSystem fs;
+    fs.setOutput(discard);
+    fs.setJournalLimit(8 * 1024 * 1024);
+    string content(1000, 'x');
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < ops; i++) {
+        string name = "f" + to_string(i % 1000);
+        if (i < 1000) {
+            fs.createFile(name);
+        }
+        content[i % content.length()] = 'a' + i % 26;
+        fs.writeFile(name, content);
+    }
+    double churnTime = secondsSince(start);
+    report(test, to_string(ops) + " writes", churnTime);
+    check(test, "journal should stay under its limit", fs.getJournalBytes() <= 8 * 1024 * 1024);
+    check(test, "journal should still hold history", fs.undoCount() > 0);
+    check(test, "writes should take under 2 s", churnTime < 2);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--quick") {
+        scale = 10;
+    }
+
+    cout << "Running scale tests" << (scale > 1 ? " (quick)" : "") << "...\n";
+    testMillionNodes();
+    testBulkLoad();
+    testDeepChain();
+    testHugeDirectory();
+    testJournalChurn();
+
+    long long peak = peakResidentBytes();
+    printf("  peak resident memory: %.1f MB\n", peak / 1048576.0);
+    check("Process", "peak memory should stay under 2 GB", peak < 2048LL * 1024 * 1024);
+
+    cout << "\n============================================\n";
+    cout << "      SCALE TEST SUMMARY\n";
+    cout << "============================================\n";
+    cout << "Tests Passed: " << testsPassed << "\n";
+    cout << "Tests Failed: " << testsFailed << "\n";
+    cout << "Total Tests:  " << (testsPassed + testsFailed) << "\n";
+
+    if (testsFailed == 0) {
+        cout << "\nAll tests passed!\n";
+    } else {
+        cout << "\nSome tests failed. See failures above.\n";
+    }
+
+    return testsFailed > 0 ? 1 : 0;
+}
@@ -3,7 +3,17 @@
 
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <thread>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "FileSystem.h"
+#include "Commands.h"
+#include "Protocol.h"
+#include "Workload.h"
 
 using namespace std;
 
@@ -501,6 +511,1180 @@ void testExceptionMessages() {
     }
 }
 
+// TEST: undo / redo
+void testUndoRedo() {
+    string test = "Undo/Redo";
+    FileSystem fs;
+
+    fs.createFile("notes.txt");
+    fs.writeFile("notes.txt", "hello world");
+    fs.writeFile("notes.txt", "hello big world");
+
+    // undo the last write brings back the old content
+    fs.undo();
+    check(test, "undo should restore previous content", fs.readFile("notes.txt") == "hello world");
+
+    // redo puts the new content back
+    fs.redo();
+    check(test, "redo should reapply the write", fs.readFile("notes.txt") == "hello big world");
+
+    // undo a delete brings back the file and its content
+    fs.deleteFile("notes.txt");
+    fs.undo();
+    check(test, "undo should restore deleted file", fs.readFile("notes.txt") == "hello big world");
+
+    // a new change clears the redo history
+    fs.undo();
+    fs.createDirectory("docs");
+    bool threw = false;
+    try {
+        fs.redo();
+    } catch (NothingToUndoException& e) {
+        threw = true;
+    } catch (...) {}
+    check(test, "new change should clear redo history", threw);
+
+    // undo a create inside a folder removes it
+    fs.changeDirectory("docs");
+    fs.createFile("inside.txt", "data");
+    fs.changeDirectory("/");
+    fs.undo();
+    fs.changeDirectory("docs");
+    threw = false;
+    try {
+        fs.readFile("inside.txt");
+    } catch (FileNotFoundException& e) {
+        threw = true;
+    } catch (...) {}
+    check(test, "undo should remove created file", threw);
+
+    // a big append should only keep the appended bytes in the journal
+    fs.changeDirectory("/");
+    string big(100000, 'x');
+    fs.createFile("big.txt", big);
+    size_t before = fs.getJournalBytes();
+    fs.writeFile("big.txt", big + "tail");
+    check(test, "write journal should store only the delta",
+          fs.getJournalBytes() - before < 1000);
+
+    // a deleted file comes back with its original creation time
+    fs.createFile("dated.txt", "x");
+    time_t created = 0;
+    for (auto entry : fs.entries("/")) {
+        if (entry.name() == "dated.txt") {
+            created = entry.created();
+        }
+    }
+    this_thread::sleep_for(chrono::milliseconds(1100));
+    fs.deleteFile("dated.txt");
+    fs.undo();
+    time_t restored = 0;
+    for (auto entry : fs.entries("/")) {
+        if (entry.name() == "dated.txt") {
+            restored = entry.created();
+        }
+    }
+    check(test, "undo should keep the creation time", restored == created);
+
+    // the journal stays within its memory limit
+    fs.setJournalLimit(50000);
+    check(test, "journal should respect memory limit", fs.getJournalBytes() <= 50000);
+}
+
+// TEST: command table
+void testCommandLookup() {
+    string test = "Command Lookup";
+
+    check(test, "list and ls should be the same command", lookupCommand("list") == lookupCommand("ls"));
+    check(test, "view and cat should be the same command", lookupCommand("view") == CMD_CAT);
+    check(test, "quit should map to exit", lookupCommand("quit") == CMD_EXIT);
+    check(test, "unknown name should not match", lookupCommand("lss") == CMD_UNKNOWN);
+    check(test, "empty name should not match", lookupCommand("") == CMD_UNKNOWN);
+
+    // running a line through the table reaches the file system
+    FileSystem fs;
+    istringstream in("line one\nEND\n");
+    CommandContext ctx(fs, in, false, STYLE_UNIX);
+    runCommandLine("touch a.txt", ctx);
+    runCommandLine("nano a.txt", ctx);
+    check(test, "nano should read content until END", fs.readFile("a.txt") == "line one\n");
+    check(test, "exit should end the session", runCommandLine("exit", ctx) == EXIT_PROGRAM);
+
+    // without host access nothing reaches the real disk
+    ostringstream refused;
+    fs.setOutput(refused);
+    ctx.hostAccess = false;
+    runCommandLine("export /tmp/never-written.tar", ctx);
+    runCommandLine("metrics dump /tmp/never-written.prom", ctx);
+    check(test, "host commands should be refused without host access",
+          refused.str().find("export: host file access is turned off") != string::npos &&
+          refused.str().find("metrics: host file access is turned off") != string::npos &&
+          access("/tmp/never-written.tar", F_OK) != 0 && access("/tmp/never-written.prom", F_OK) != 0);
+    fs.setOutput(cout);
+}
+
+// TEST: binary protocol frames
+void testProtocolFrames() {
+    string test = "Protocol Frames";
+
+    // two pipelined requests decode back in order
+    string buf;
+    Request a;
+    a.id = 1;
+    a.op = OP_WRITE_FILE;
+    a.arg1 = "notes.txt";
+    a.arg2 = string("bin\0ary", 7);
+    Request b;
+    b.id = 2;
+    b.op = OP_GET_PATH;
+    encodeRequest(buf, a);
+    encodeRequest(buf, b);
+
+    size_t pos = 0;
+    Request got;
+    check(test, "first frame should decode", decodeRequest(buf, pos, got) == FRAME_OK);
+    check(test, "first frame should keep its fields",
+          got.id == 1 && got.op == OP_WRITE_FILE && got.arg1 == "notes.txt" && got.arg2 == a.arg2);
+    check(test, "second frame should decode", decodeRequest(buf, pos, got) == FRAME_OK && got.id == 2);
+    check(test, "empty buffer should be incomplete", decodeRequest(buf, pos, got) == FRAME_INCOMPLETE);
+
+    // a cut off frame waits for more bytes
+    string partial = buf.substr(0, buf.length() - 3);
+    pos = 0;
+    decodeRequest(partial, pos, got);
+    check(test, "partial frame should be incomplete", decodeRequest(partial, pos, got) == FRAME_INCOMPLETE);
+
+    // responses carry a list of values
+    Response resp;
+    resp.id = 7;
+    resp.status = STATUS_OK;
+    resp.values.push_back("/a/x.txt");
+    resp.values.push_back("/b/x.txt");
+    string out;
+    encodeResponse(out, resp);
+    Response back;
+    pos = 0;
+    check(test, "response should decode", decodeResponse(out, pos, back) == FRAME_OK);
+    check(test, "response should keep its values",
+          back.id == 7 && back.values.size() == 2 && back.values[1] == "/b/x.txt");
+    check(test, "integers should be little-endian on the wire", out[4] == 7 && out[5] == 0 && out[7] == 0);
+
+    // a count that can't fit in the frame is rejected before anything is sized
+    string hostile = out.substr(0, 13);
+    hostile[0] = 9;
+    hostile[1] = hostile[2] = hostile[3] = 0;
+    hostile[9] = hostile[10] = hostile[11] = hostile[12] = (char)0xff;
+    pos = 0;
+    check(test, "huge value count should be a bad frame", decodeResponse(hostile, pos, back) == FRAME_BAD);
+
+    // an oversize frame is refused from its header alone
+    string oversize;
+    appendU32(oversize, maxFrameLength + 1);
+    pos = 0;
+    check(test, "oversize frame should be rejected at the header", decodeRequest(oversize, pos, got) == FRAME_BAD);
+}
+
+// TEST: workload generator and replayer
+void testWorkload() {
+    string test = "Workload";
+
+    WorkloadConfig config;
+    config.ops = 2000;
+    config.sizeMedian = 64;
+    vector<TraceOp> trace = WorkloadGenerator(config).generate();
+    check(test, "should generate the requested number of ops", trace.size() == 2000);
+
+    // same seed, same trace
+    vector<TraceOp> again = WorkloadGenerator(config).generate();
+    check(test, "same seed should give the same trace",
+          again.size() == trace.size() && again[1999].name == trace[1999].name);
+
+    // trace survives a write/read round trip
+    stringstream file;
+    writeTrace(file, trace);
+    vector<TraceOp> loaded;
+    string error;
+    check(test, "trace should read back", readTrace(file, loaded, error) && loaded.size() == trace.size());
+    check(test, "trace fields should round trip",
+          loaded[10].dir == trace[10].dir && loaded[10].size == trace[10].size);
+
+    // every generated op is valid against the tree it builds
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    WorkloadReplayer replayer(fs);
+    ReplayStats stats = replayer.replay(trace, 1);
+    long long errors = 0;
+    long long timed = 0;
+    for (int i = 0; i < traceOpCount; i++) {
+        errors += stats.errors[i];
+        timed += stats.latency[i].count();
+    }
+    check(test, "single threaded replay should have no errors", errors == 0);
+    check(test, "every op should be timed", timed == 2000);
+
+    // several threads: a folder's subtree stays on one thread, so nothing
+    // runs before the folder it needs
+    FileSystem shared;
+    shared.setOutput(discard);
+    WorkloadReplayer sharedReplayer(shared);
+    stats = sharedReplayer.replay(trace, 8);
+    errors = 0;
+    for (int i = 0; i < traceOpCount; i++) {
+        errors += stats.errors[i];
+    }
+    check(test, "multithreaded replay should have no errors", errors == 0);
+}
+
+// TEST: per-operation metrics
+void testMetrics() {
+    string test = "Metrics";
+    metricsRegistry().reset();
+    metricsRegistry().setSampleEvery(1);
+
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createFile("a.txt");
+    fs.writeFile("a.txt", "hello");
+    try {
+        fs.readFile("missing.txt");
+    } catch (FileNotFoundException& e) {
+    }
+
+    // internal path lookups (journal, listing) are not counted as calls
+    fs.listDirectory();
+
+    vector<OpSnapshot> ops = metricsRegistry().snapshot();
+    check(test, "calls should be counted", ops[MET_CREATE_FILE].calls == 1 && ops[MET_WRITE_FILE].calls == 1);
+    check(test, "a throwing call should count as an error",
+          ops[MET_READ_FILE].calls == 1 && ops[MET_READ_FILE].errors == 1);
+    check(test, "successful calls should not count as errors", ops[MET_CREATE_FILE].errors == 0);
+    check(test, "internal calls should not be counted", ops[MET_GET_PATH].calls == 0);
+    check(test, "every call should be timed at sample rate 1", ops[MET_CREATE_FILE].latency.count() == 1);
+
+    // calls made on other threads are merged in, even after they exit
+    thread worker([]() {
+        FileSystem other;
+        other.getCurrentPath();
+        other.getCurrentPath();
+    });
+    worker.join();
+    ops = metricsRegistry().snapshot();
+    check(test, "exited threads should still be counted", ops[MET_GET_PATH].calls == 2);
+
+    // sampling rounds down to a power of two
+    metricsRegistry().setSampleEvery(100);
+    check(test, "sample rate should round to a power of two", metricsRegistry().getSampleEvery() == 64);
+
+    stringstream prom;
+    writePrometheus(prom);
+    check(test, "prometheus output should have counters",
+          prom.str().find("filesystem_op_calls_total{op=\"createFile\"} 1") != string::npos);
+
+    metricsRegistry().reset();
+    check(test, "reset should clear counts", metricsRegistry().snapshot()[MET_CREATE_FILE].calls == 0);
+    metricsRegistry().setSampleEvery(16);
+}
+
+// TEST: memory accounting
+void testMemoryUsage() {
+    string test = "Memory Usage";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+
+    MemoryUsage empty = fs.getMemoryUsage("/");
+    check(test, "empty tree should hold just the root", empty.nodes == 1 && empty.content == 0);
+
+    fs.createDirectory("docs");
+    fs.changeDirectory("docs");
+    fs.createFile("big.txt", string(1000, 'x'));
+    fs.createFile("a-name-too-long-for-the-inline-buffer");
+    fs.changeDirectory("..");
+    fs.createFile("small.txt", "hi");
+
+    MemoryUsage docs = fs.getMemoryUsage("/docs");
+    check(test, "subtree should count its own nodes", docs.nodes == 3);
+    check(test, "content should be counted", docs.content >= 1000 && docs.content < 1100);
+    check(test, "long names should be counted", docs.names > 0);
+    check(test, "child containers should be counted", docs.childVectors > 0 && docs.childIndexes > 0);
+    check(test, "relative paths should work", fs.getMemoryUsage("docs").total() == docs.total());
+
+    // the whole tree covers the subtree, short content stays inline
+    MemoryUsage all = fs.getMemoryUsage("/");
+    check(test, "tree should have every node", all.nodes == 5);
+    check(test, "tree should cover the docs subtree", all.total() > docs.total() + 2 * sizeof(FileNode));
+    check(test, "short strings should not count as heap", all.content == docs.content);
+
+    bool threw = false;
+    try {
+        fs.getMemoryUsage("/missing");
+    } catch (DirectoryNotFoundException& e) {
+        threw = true;
+    }
+    check(test, "missing folder should throw", threw);
+}
+
+// TEST: trace events
+void testTrace() {
+    string test = "Trace";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+
+    traceRegistry().clear();
+    fs.createFile("untraced.txt");
+    stringstream before;
+    check(test, "nothing should be recorded while tracing is off", traceRegistry().dump(before) == 0);
+
+    setTracing(true);
+    fs.createFile("a.txt");
+    fs.searchFile("a.txt");
+    setTracing(false);
+
+    stringstream json;
+    size_t events = traceRegistry().dump(json);
+    string text = json.str();
+    check(test, "operations should be recorded", text.find("\"name\":\"createFile\"") != string::npos);
+    check(test, "internal phases should be recorded", text.find("\"name\":\"traversal\"") != string::npos);
+    check(test, "events should be complete events", text.find("\"ph\":\"X\"") != string::npos);
+    check(test, "one event per op and phase", events == 5);   // createFile, allocate, journal, searchFile, traversal
+    check(test, "output should be a chrome trace object",
+          text.find("{\"displayTimeUnit\"") == 0 && text.find("]}") != string::npos);
+
+    traceRegistry().clear();
+    stringstream after;
+    check(test, "clear should drop events", traceRegistry().dump(after) == 0);
+}
+
+// TEST: iterative tree walk
+struct OrderRecorder : TreeVisitor {
+    string order;
+    string skip;
+
+    bool enter(FileNode* node, int depth) {
+        order += "+" + node->name + to_string(depth);
+        return node->name != skip;
+    }
+
+    void leave(FileNode* node, int) {
+        order += "-" + node->name;
+    }
+};
+
+void testTreeWalk() {
+    string test = "Tree Walk";
+    FileNode root("r", true);
+    FileNode* a = new FileNode("a", true, &root);
+    root.addChild(a);
+    a->addChild(new FileNode("x", false, a));
+    root.addChild(new FileNode("b", false, &root));
+
+    OrderRecorder recorder;
+    walkTree(&root, recorder);
+    check(test, "should visit pre-order and post-order with depths", recorder.order == "+r0+a1+x2-x-a+b1-b-r");
+
+    OrderRecorder skipper;
+    skipper.skip = "a";
+    walkTree(&root, skipper);
+    check(test, "returning false from enter should skip the children", skipper.order == "+r0+a1-a+b1-b-r");
+}
+
+// TEST: node table
+void testNodeTable() {
+    string test = "Node Table";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("docs");
+    fs.changeDirectory("docs");
+    fs.createFile("notes.txt", "12345");
+    fs.createDirectory("old");
+    fs.changeDirectory("old");
+    fs.createFile("notes.txt", "abc");
+    fs.changeDirectory("/");
+    fs.createFile("readme.txt");
+
+    vector<string> before = fs.searchFile("notes");
+    check(test, "table should not be used before compact", !fs.isCompacted());
+    fs.compact();
+    check(test, "table should be fresh after compact", fs.isCompacted());
+    check(test, "table search should match tree search", fs.searchFile("notes") == before);
+
+    ostringstream stats;
+    fs.setOutput(stats);
+    fs.displayStats();
+    fs.setOutput(discard);
+    check(test, "table stats should count files and size",
+          stats.str().find("Total Files: 3") != string::npos && stats.str().find("Total Size: 8 bytes") != string::npos);
+
+    // rows are in depth-first order with working links
+    FileNode root("root", true);
+    FileNode* a = new FileNode("a", true, &root);
+    root.addChild(a);
+    a->addChild(new FileNode("x", false, a));
+    root.addChild(new FileNode("b", false, &root));
+    NodeTable<FileNode> table;
+    table.build(&root);
+    check(test, "rows should be in depth-first order",
+          table.rows() == 4 && string(table.name(1)) == "a" && string(table.name(2)) == "x" && string(table.name(3)) == "b");
+    check(test, "subtree of a should cover x", table.subtreeEnd[1] == 3 && table.subtreeEnd[0] == 4);
+    check(test, "child links should follow the tree",
+          table.firstChild[0] == 1 && table.nextSibling[1] == 3 && table.parent[2] == 1);
+    check(test, "paths should be rebuilt from parents", table.pathOf(2) == "root/a/x");
+    check(test, "folders should map to their rows",
+          table.rowOf(&root) == 0 && table.rowOf(a) == 1 && table.rowOf(a->children[0]) == noNode);
+
+    // any change makes the table stale
+    fs.writeFile("readme.txt", "changed");
+    check(test, "a change should make the table stale", !fs.isCompacted());
+    check(test, "stale table should not be used", fs.searchFile("notes") == before);
+}
+
+// TEST: vectorized substring search
+void testStringSearch() {
+    string test = "String Search";
+
+    // every version must agree with string::find, including matches that
+    // straddle a vector block and ones in the scalar tail
+    vector<SubstringFinder> finders;
+    finders.push_back(findSubstringScalar);
+    finders.push_back(bestSubstringFinder());
+    finders.push_back(findSubstring);
+    string hay;
+    unsigned seed = 7;
+    for (int i = 0; i < 300; i++) {
+        seed = seed * 1103515245 + 12345;
+        hay += "abc"[(seed >> 16) % 3];
+    }
+    const char* needles[] = {"a", "abcab", "ccc", "bbbbbbbbbb", "xyz", "", "cab"};
+    bool agree = true;
+    for (int f = 0; f < finders.size(); f++) {
+        for (int n = 0; n < 7; n++) {
+            for (size_t start = 0; start < hay.length(); start += 13) {
+                size_t expected = hay.find(needles[n], start);
+                size_t got = finders[f](hay.data() + start, hay.length() - start, needles[n], strlen(needles[n]));
+                if ((expected == string::npos ? hay.length() - start : expected - start) != got) {
+                    agree = false;
+                }
+            }
+        }
+    }
+    check(test, "every kernel should agree with string::find", agree);
+
+    // whole-name-buffer search in a node table
+    FileNode root("root", true);
+    const char* names[] = {"report.txt", "old_report", "data", "rep"};
+    for (int i = 0; i < 4; i++) {
+        root.addChild(new FileNode(names[i], false, &root));
+    }
+    NodeTable<FileNode> table;
+    table.build(&root);
+    vector<uint32_t> rows;
+    table.findNames("rep", false, rows);
+    check(test, "substring should find each matching name once", rows == vector<uint32_t>({1, 2, 4}));
+    rows.clear();
+    table.findNames("rep", true, rows);
+    check(test, "prefix should skip names with the text in the middle", rows == vector<uint32_t>({1, 4}));
+    rows.clear();
+    table.findNames("", true, rows);
+    check(test, "empty prefix should match every row", rows.size() == 5);
+    rows.clear();
+    table.findNames("txtold", false, rows);
+    check(test, "a match should never span two names", rows.size() == 0);
+}
+
+// TEST: content search
+void testGrep() {
+    string test = "Grep";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("src");
+    fs.changeDirectory("src");
+    fs.createFile("a.txt", "alpha\nneedle one\nbeta\n");
+    fs.createFile("b.txt", "no match here\n");
+    fs.changeDirectory("/");
+    fs.createFile("c.txt", "needle needle\nx\nlast needle");
+
+    vector<string> lines;
+    auto collect = [&](const string& file, size_t line, string_view text) {
+        lines.push_back(file + ":" + to_string(line) + ":" + string(text));
+    };
+    GrepStats stats = fs.grepContent("needle", "/", collect);
+    check(test, "should report each matching line once, in tree order",
+          lines == vector<string>({"/src/a.txt:2:needle one", "/c.txt:1:needle needle", "/c.txt:3:last needle"}));
+    check(test, "stats should count matches and files", stats.matches == 3 && stats.filesMatched == 2 && stats.files == 3);
+
+    lines.clear();
+    fs.grepContent("needle", "src", collect);
+    check(test, "path should limit the search to a subtree", lines.size() == 1);
+
+    // many files spread over several threads still come back in order
+    fs.createDirectory("many");
+    fs.changeDirectory("many");
+    string filler(100000, 'x');
+    for (int i = 0; i < 40; i++) {
+        fs.createFile("f" + to_string(100 + i), filler + "\nhit " + to_string(i) + "\n");
+    }
+    lines.clear();
+    stats = fs.grepContent("hit", "", collect, 4);
+    bool ordered = lines.size() == 40;
+    for (int i = 0; ordered && i < 40; i++) {
+        ordered = lines[i] == "/many/f" + to_string(100 + i) + ":2:hit " + to_string(i);
+    }
+    check(test, "parallel search should keep file order", ordered);
+
+    // a callback that throws stops the search and the error comes through
+    bool thrown = false;
+    try {
+        fs.grepContent("hit", "", [&](const string&, size_t, string_view) {
+            throw runtime_error("stop");
+        }, 4);
+    } catch (runtime_error& e) {
+        thrown = true;
+    }
+    check(test, "error from the callback should reach the caller", thrown);
+
+    // the node table gives the same files
+    fs.compact();
+    lines.clear();
+    fs.grepContent("needle", "/", collect);
+    check(test, "compacted tree should give the same matches", lines.size() == 3 && lines[0] == "/src/a.txt:2:needle one");
+}
+
+// TEST: full-text index
+void testTextIndex() {
+    string test = "Text Index";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createFile("a.txt", "The disk is full. Error!");
+    fs.createFile("b.txt", "full disk error in test");
+    fs.createFile("c.txt", "kernel panic");
+
+    bool threw = false;
+    try {
+        fs.searchText("disk");
+    } catch (runtime_error& e) {
+        threw = true;
+    }
+    check(test, "search should fail while the index is off", threw);
+
+    fs.setTextIndex(true);
+    check(test, "words should be ANDed, case-insensitively",
+          fs.searchText("DISK error") == vector<string>({"/a.txt", "/b.txt"}));
+    check(test, "phrase should need the words in order", fs.searchText("\"disk is full\"") == vector<string>({"/a.txt"}));
+    check(test, "minus should exclude", fs.searchText("disk -test") == vector<string>({"/a.txt"}));
+    check(test, "OR should combine groups", fs.searchText("test OR panic") == vector<string>({"/b.txt", "/c.txt"}));
+    check(test, "unknown word should match nothing", fs.searchText("disk zebra").size() == 0);
+
+    // the index follows writes, deletes, creates and undo
+    fs.writeFile("c.txt", "disk full");
+    check(test, "write should reindex", fs.searchText("\"disk full\"") == vector<string>({"/c.txt"}));
+    check(test, "write should drop old terms", fs.searchText("panic").size() == 0);
+    fs.undo();
+    check(test, "undo should reindex", fs.searchText("panic") == vector<string>({"/c.txt"}));
+    fs.deleteFile("a.txt");
+    check(test, "delete should remove the file", fs.searchText("disk") == vector<string>({"/b.txt"}));
+    fs.undo();
+    check(test, "undoing a delete should bring it back", fs.searchText("disk").size() == 2);
+    fs.createFile("d.txt", "another disk");
+    check(test, "create should index content", fs.searchText("another") == vector<string>({"/d.txt"}));
+
+    // many rewrites leave dead postings that get compacted away
+    for (int i = 0; i < 3000; i++) {
+        fs.writeFile("d.txt", "version " + to_string(i));
+    }
+    check(test, "rewritten file should match only its last content",
+          fs.searchText("2999") == vector<string>({"/d.txt"}) && fs.searchText("1500").size() == 0);
+
+    // varints round trip
+    string bytes;
+    appendVarint(bytes, 5);
+    appendVarint(bytes, 300);
+    appendVarint(bytes, 4000000000u);
+    size_t pos = 0;
+    check(test, "varints should round trip",
+          readVarint(bytes, pos) == 5 && readVarint(bytes, pos) == 300 && readVarint(bytes, pos) == 4000000000u &&
+          bytes.size() == 1 + 2 + 5);
+}
+
+// TEST: glob and regex name search
+void testNamePattern() {
+    string test = "Name Pattern";
+    check(test, "glob star should stay inside a name",
+          NamePattern("*.log", PATTERN_GLOB).matches("a.log") && !NamePattern("*.log", PATTERN_GLOB).matches("x/a.log") &&
+          !NamePattern("*.log", PATTERN_GLOB).matches("a.log.gz"));
+    check(test, "glob ? and classes should match one character",
+          NamePattern("data-??.csv", PATTERN_GLOB).matches("data-07.csv") &&
+          !NamePattern("data-??.csv", PATTERN_GLOB).matches("data-7.csv") &&
+          NamePattern("[!a]b[0-9]", PATTERN_GLOB).matches("bb3") && !NamePattern("[!a]b[0-9]", PATTERN_GLOB).matches("ab3"));
+    check(test, "glob ** should cross folders",
+          NamePattern("/src/**/*.h", PATTERN_GLOB).matches("/src/x.h") &&
+          NamePattern("/src/**/*.h", PATTERN_GLOB).matches("/src/a/b/x.h") &&
+          !NamePattern("/src/**/*.h", PATTERN_GLOB).matches("/lib/x.h"));
+    check(test, "regex should match anywhere unless anchored",
+          NamePattern("rep(or)+t\\d", PATTERN_REGEX).matches("my-report7.txt") &&
+          !NamePattern("^rep", PATTERN_REGEX).matches("my-report") &&
+          NamePattern("^(a|b)*c$", PATTERN_REGEX).matches("abbac") && !NamePattern("^(a|b)*c$", PATTERN_REGEX).matches("abbacd"));
+    check(test, "anchors should bind to their own branch",
+          NamePattern("^a|b", PATTERN_REGEX).matches("xb") && !NamePattern("^a|b", PATTERN_REGEX).matches("xa") &&
+          NamePattern("a|b$", PATTERN_REGEX).matches("a.log") && !NamePattern("a|b$", PATTERN_REGEX).matches("b.log") &&
+          NamePattern("error|warn$", PATTERN_REGEX).matches("error.log"));
+    check(test, "fixed part should be found for prefiltering",
+          NamePattern("*.log", PATTERN_GLOB).requiredLiteral() == ".log" &&
+          NamePattern("^x(ab|cd)yz?", PATTERN_REGEX).requiredLiteral() == "x");
+    check(test, "dead state should be reached once no match is possible",
+          NamePattern("/src/*.h", PATTERN_GLOB).run(NamePattern("/src/*.h", PATTERN_GLOB).start(), "/lib/", 5) ==
+          NamePattern::deadState);
+
+    bool threw = false;
+    try {
+        NamePattern("a(b", PATTERN_REGEX);
+    } catch (InvalidPatternException& e) {
+        threw = true;
+    }
+    check(test, "bad pattern should throw", threw);
+
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("logs");
+    fs.createDirectory("src");
+    fs.createFile("top.log");
+    fs.changeDirectory("logs");
+    fs.createFile("a.log");
+    fs.createFile("b.txt");
+    fs.createDirectory("old");
+    fs.changeDirectory("old");
+    fs.createFile("c.log");
+    fs.changeDirectory("/");
+    fs.changeDirectory("src");
+    fs.createFile("main.cpp");
+
+    vector<string> expected = {"root/logs/a.log", "root/logs/old/c.log", "root/top.log"};
+    check(test, "glob should search the whole tree", fs.searchPattern("*.log", PATTERN_GLOB) == expected);
+    check(test, "path glob should only look under its folder",
+          fs.searchPattern("/logs/*.log", PATTERN_GLOB) == vector<string>({"root/logs/a.log"}));
+    check(test, "regex should search names",
+          fs.searchPattern("^[a-c]\\.(log|txt)$", PATTERN_REGEX) ==
+              vector<string>({"root/logs/a.log", "root/logs/b.txt", "root/logs/old/c.log"}));
+
+    fs.compact();
+    check(test, "node table should give the same results",
+          fs.searchPattern("*.log", PATTERN_GLOB) == expected &&
+          fs.searchPattern("/logs/**/*.log", PATTERN_GLOB) == vector<string>({"root/logs/a.log", "root/logs/old/c.log"}) &&
+          fs.searchPattern("m.*n", PATTERN_REGEX) == vector<string>({"root/src/main.cpp"}));
+}
+
+// TEST: find-style predicate queries
+void testFindFiles() {
+    string test = "Find Files";
+    time_t now = time(0);
+    FileQuery parsed = parseFindArguments("/logs -type f -size +10k -mmin -60 -maxdepth 2 -name *.log", now);
+    check(test, "arguments should parse",
+          parsed.path == "/logs" && parsed.type == QUERY_FILES && parsed.minSize == 10 * 1024 + 1 &&
+          parsed.modifiedAfter == now - 3600 && parsed.maxDepth == 2 && parsed.namePattern == "*.log");
+    bool threw = false;
+    try {
+        parseFindArguments("-size");
+    } catch (InvalidQueryException& e) {
+        threw = true;
+    }
+    check(test, "option without a value should throw", threw);
+
+    FileSystem fs;
+    ostringstream output;
+    fs.setOutput(output);
+    fs.createDirectory("logs");
+    fs.createDirectory("src");
+    fs.changeDirectory("logs");
+    fs.createFile("big.log", string(20000, 'x'));
+    fs.createFile("small.log", "x");
+    fs.createDirectory("old");
+    fs.changeDirectory("old");
+    fs.createFile("older.log", string(5000, 'x'));
+    fs.setCurrentPath("/");
+    fs.changeDirectory("src");
+    for (int i = 0; i < 20; i++) {
+        fs.createFile("f" + to_string(i) + ".cpp", "int x;");
+    }
+    fs.setCurrentPath("/");
+
+    check(test, "size and type should filter",
+          fs.findFiles(parseFindArguments("/ -type f -size +4k")) == vector<string>({"/logs/big.log", "/logs/old/older.log"}));
+    check(test, "start path and maxdepth should limit",
+          fs.findFiles(parseFindArguments("/logs -maxdepth 1 -name *.log")) == vector<string>({"/logs/big.log", "/logs/small.log"}));
+    check(test, "mindepth and type d should give folders",
+          fs.findFiles(parseFindArguments("/ -type d -mindepth 2")) == vector<string>({"/logs/old"}));
+    check(test, "age should filter", fs.findFiles(parseFindArguments("/ -mmin +60")).size() == 0 &&
+                                     fs.findFiles(parseFindArguments("/ -type f -mmin -60")).size() == 23);
+    check(test, "path pattern should work", fs.findFiles(parseFindArguments("/ -name /logs/**/*.log")).size() == 3);
+
+    // summaries were built by the walks above, now whole folders get skipped
+    output.str("");
+    fs.findFiles(parseFindArguments("/ -size +10k"));
+    check(test, "summary should let the walk skip folders",
+          output.str().find("1 found") != string::npos && output.str().find(" 0 folders skipped") == string::npos);
+
+    // a change deep down must not be hidden by a stale summary
+    fs.setCurrentPath("/src");
+    fs.writeFile("f3.cpp", string(30000, 'y'));
+    check(test, "write should invalidate summaries",
+          fs.findFiles(parseFindArguments("/ -size +10k")) == vector<string>({"/logs/big.log", "/src/f3.cpp"}));
+    fs.undo();
+    check(test, "undo should invalidate summaries",
+          fs.findFiles(parseFindArguments("/ -size +10k")) == vector<string>({"/logs/big.log"}));
+
+    // the planner switches to the node table once it is current
+    fs.compact();
+    check(test, "planner should use the name index for a name with a fixed part",
+          fs.planQuery(parseFindArguments("/ -name *.log")).access == ACCESS_NAME_INDEX &&
+          fs.planQuery(parseFindArguments("/ -type f")).access == ACCESS_TABLE_SCAN);
+    check(test, "planner should keep walking the tree when summaries can prune a size range",
+          fs.planQuery(parseFindArguments("/ -size +1")).access == ACCESS_TREE_WALK);
+    check(test, "table plans should give the same results",
+          fs.findFiles(parseFindArguments("/logs -name *.log -size -10k")) ==
+              vector<string>({"/logs/small.log", "/logs/old/older.log"}) &&
+          fs.findFiles(parseFindArguments("/ -type d -mindepth 2")) == vector<string>({"/logs/old"}) &&
+          fs.findFiles(parseFindArguments("/ -name /logs/**/*.log -maxdepth 2")).size() == 2 &&
+          fs.findFiles(parseFindArguments("/src -type f")).size() == 20);
+    fs.createFile("new.log");
+    check(test, "a change should send the planner back to the tree",
+          fs.planQuery(parseFindArguments("/ -name *.log")).access == ACCESS_TREE_WALK);
+}
+
+// TEST: ordered size and mtime indexes
+void testAttributeIndex() {
+    string test = "Attribute Index";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("a");
+    fs.createDirectory("b");
+    fs.setCurrentPath("/a");
+    for (int i = 1; i <= 30; i++) {
+        fs.createFile("f" + to_string(i), string(i * 100, 'x'));
+    }
+    fs.setCurrentPath("/b");
+    fs.createFile("huge", string(10000, 'y'));
+    fs.createFile("empty");
+
+    // the same answers with and without the index
+    vector<string> largest = fs.topFiles(BY_SIZE, 3, "/");
+    vector<string> newest = fs.topFiles(BY_MODIFIED, 5, "/");
+    check(test, "scan should find the largest files", largest == vector<string>({"/b/huge", "/a/f30", "/a/f29"}));
+    fs.setAttributeIndex(true);
+    check(test, "index should file every file, empty ones too", fs.hasAttributeIndex());
+    check(test, "top size should read the end of the index",
+          fs.topFiles(BY_SIZE, 3, "/") == vector<string>({"/b/huge", "/a/f30", "/a/f29"}));
+    check(test, "top should stay under the folder",
+          fs.topFiles(BY_SIZE, 2, "/a") == vector<string>({"/a/f30", "/a/f29"}));
+    check(test, "top mtime should agree with a scan", fs.topFiles(BY_MODIFIED, 5, "/") == newest);
+    check(test, "a small folder should give the same top files",
+          fs.topFiles(BY_SIZE, 5, "/b") == vector<string>({"/b/huge", "/b/empty"}));
+
+    // writes, deletes and undo move files in the index
+    fs.setCurrentPath("/a");
+    fs.writeFile("f1", string(20000, 'z'));
+    check(test, "write should move a file", fs.topFiles(BY_SIZE, 1, "/") == vector<string>({"/a/f1"}));
+    fs.undo();
+    check(test, "undo should move it back", fs.topFiles(BY_SIZE, 1, "/") == vector<string>({"/b/huge"}));
+    fs.setCurrentPath("/b");
+    fs.deleteFile("huge");
+    check(test, "delete should drop a file", fs.topFiles(BY_SIZE, 1, "/") == vector<string>({"/a/f30"}));
+
+    // range queries go through the index
+    FileQuery big = parseFindArguments("/a -size +2500");
+    check(test, "planner should use the size index", fs.planQuery(big).access == ACCESS_SIZE_INDEX);
+    check(test, "size range should come out smallest first",
+          fs.findFiles(big) == vector<string>({"/a/f26", "/a/f27", "/a/f28", "/a/f29", "/a/f30"}));
+    FileQuery recent = parseFindArguments("/ -type f -mmin -60");
+    check(test, "planner should use the mtime index",
+          fs.planQuery(recent).access == ACCESS_MODIFIED_INDEX && fs.findFiles(recent).size() == 31);
+    check(test, "other predicates should still apply",
+          fs.findFiles(parseFindArguments("/ -size +2500 -size -2800 -name f2?")) == vector<string>({"/a/f26", "/a/f27"}));
+
+    fs.setAttributeIndex(false);
+    check(test, "without the index the planner should scan",
+          fs.planQuery(big).access == ACCESS_TREE_WALK && fs.findFiles(big).size() == 5);
+}
+
+// TEST: paged search with resumable cursors
+void testPagedSearch() {
+    string test = "Paged Search";
+    SearchCursor cursor;
+    cursor.indexes = {4, 0, 15};
+    cursor.names = {"a", "b c", "x:y.log"};
+    SearchCursor parsed = SearchCursor::parse(cursor.token());
+    check(test, "cursor token should be one word and round trip",
+          cursor.token().find(' ') == string::npos && parsed.indexes == cursor.indexes && parsed.names == cursor.names);
+
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    for (int d = 0; d < 3; d++) {
+        fs.setCurrentPath("/");
+        fs.createDirectory("d" + to_string(d));
+        fs.setCurrentPath("/d" + to_string(d));
+        for (int f = 0; f < 4; f++) {
+            fs.createFile("f" + to_string(f));
+        }
+    }
+    FileQuery all = parseFindArguments("/ -type f");
+    vector<string> everything = fs.findFiles(all);
+
+    // walking page by page gives the same list as one full walk
+    FileQuery paged = all;
+    paged.limit = 5;
+    vector<string> joined;
+    int pages = 0;
+    while (true) {
+        SearchPage page = fs.findPage(paged);
+        joined.insert(joined.end(), page.paths.begin(), page.paths.end());
+        pages++;
+        if (page.next == "" || pages > 10) {
+            break;
+        }
+        paged.after = page.next;
+    }
+    check(test, "pages should join up to the full result", joined == everything && pages == 3);
+
+    // a last page that is exactly full says it is the last
+    paged.limit = 6;
+    paged.after = "";
+    SearchPage half = fs.findPage(paged);
+    paged.after = half.next;
+    SearchPage rest = fs.findPage(paged);
+    check(test, "exactly full last page should have no next token",
+          half.next != "" && rest.paths.size() == 6 && rest.next == "");
+
+    FileQuery window = parseFindArguments("/ -type f -offset 3 -limit 2");
+    check(test, "offset and limit should cut a window",
+          fs.findFiles(window) == vector<string>({"/d0/f3", "/d1/f0"}));
+
+    // the cursor survives changes: a deleted match resumes at its slot
+    paged = all;
+    paged.limit = 2;
+    SearchPage first = fs.findPage(paged);
+    fs.setCurrentPath("/d0");
+    fs.deleteFile("f1");
+    paged.after = first.next;
+    check(test, "deleted cursor node should resume at its slot", fs.findPage(paged).paths ==
+          vector<string>({"/d0/f2", "/d0/f3"}));
+
+    size_t seen = 0;
+    string token = fs.findEach(all, "", [&](const string&) {
+        seen++;
+        return seen < 7;
+    });
+    check(test, "streaming should stop when asked", seen == 7 && token != "");
+    size_t total = fs.findFiles(all).size();
+    seen = 0;
+    token = fs.findEach(all, "", [&](const string&) {
+        seen++;
+        return seen < total;
+    });
+    check(test, "stopping on the last match should give no token", seen == total && token == "");
+
+    bool threw = false;
+    try {
+        parseFindArguments("/ -after nonsense");
+    } catch (InvalidQueryException& e) {
+        threw = true;
+    }
+    check(test, "bad token should be rejected", threw);
+}
+
+void testSortedListing() {
+    string test = "Sorted Listing";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    string names[5] = {"d", "b", "e", "a", "c"};
+    int sizes[5] = {30, 10, 10, 50, 20};
+    for (int i = 0; i < 5; i++) {
+        fs.createFile(names[i]);
+        fs.writeFile(names[i], string(sizes[i], 'x'));
+    }
+
+    auto namesOf = [](const ListPage& page) {
+        string joined;
+        for (size_t i = 0; i < page.entries.size(); i++) {
+            joined += page.entries[i].name;
+        }
+        return joined;
+    };
+    check(test, "by name should sort names", namesOf(fs.listPage("", LIST_BY_NAME, false, 0, "")) == "abcde");
+    check(test, "by size should break ties by name", namesOf(fs.listPage("", LIST_BY_SIZE, false, 0, "")) == "becda");
+    check(test, "reversed should run largest first", namesOf(fs.listPage("", LIST_BY_SIZE, true, 0, "")) == "adceb");
+
+    // pages join up, in both directions
+    string joined;
+    string after;
+    int pages = 0;
+    do {
+        ListPage page = fs.listPage("/", LIST_BY_SIZE, true, 2, after);
+        joined += namesOf(page);
+        after = page.next;
+        pages++;
+    } while (after != "" && pages < 10);
+    check(test, "reversed pages should join up", joined == "adceb" && pages == 3);
+
+    // the index follows changes made after it was built
+    ListPage first = fs.listPage("", LIST_BY_SIZE, false, 2, "");
+    fs.writeFile("a", "");
+    fs.createFile("f");
+    fs.deleteFile("c");
+    check(test, "index should follow writes, creates and deletes",
+          namesOf(fs.listPage("", LIST_BY_SIZE, false, 0, "")) == "afbed");
+    check(test, "a token should still resume after changes", namesOf(fs.listPage("", LIST_BY_SIZE, false, 0, first.next)) == "d");
+    fs.undo();
+    check(test, "undo should put a child back in order", namesOf(fs.listPage("", LIST_BY_NAME, false, 0, "")) == "abcdef");
+
+    bool threw = false;
+    try {
+        fs.listPage("", LIST_BY_NAME, false, 0, "nonsense");
+    } catch (InvalidQueryException& e) {
+        threw = true;
+    }
+    check(test, "bad token should be rejected", threw);
+}
+
+void testDirectoryEntries() {
+    string test = "Directory Entries";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    check(test, "new folder should have no entries", fs.entries().empty() && fs.entries().begin() == fs.entries().end());
+    fs.createFile("a.txt");
+    fs.writeFile("a.txt", "hello");
+    fs.createDirectory("sub");
+    fs.createFile("b.txt");
+
+    string names;
+    size_t bytes = 0;
+    for (auto entry : fs.entries()) {
+        names += string(entry.name()) + ",";
+        bytes += entry.size();
+    }
+    check(test, "range-for should visit children in creation order", names == "a.txt,sub,b.txt," && bytes == 5);
+
+    DirEntries<FileNode> list = fs.entries("/");
+    check(test, "std algorithms should work on the range",
+          list.size() == 3 && count_if(list.begin(), list.end(), [](DirEntryView<FileNode> e) {
+              return e.isDirectory();
+          }) == 1);
+    auto found = find_if(list.begin(), list.end(), [](DirEntryView<FileNode> e) {
+        return e.name() == "a.txt";
+    });
+    check(test, "views should point into the tree, not copies",
+          found != list.end() && (*found).content() == "hello" &&
+          (*found).content().data() == (*fs.entries().begin()).content().data());
+    check(test, "empty subfolder should have no entries", fs.entries("sub").empty());
+}
+
+void testBulkLoad() {
+    string test = "Bulk Load";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("docs");
+    fs.setCurrentPath("/docs");
+    fs.createFile("old.txt");
+    fs.setCurrentPath("/");
+
+    // unsorted on purpose, with a folder made implicitly and one merged into
+    vector<BulkEntry> entries = {
+        {"/src/main.cpp", "int main() {}", false},
+        {"docs/new.txt", "new", false},
+        {"/src", "", true},
+        {"/src/lib/util.h", "", false},
+        {"/a.txt", "hello", false},
+        {"/src/lib", "", true},
+    };
+    size_t made = fs.bulkLoad(entries);
+    check(test, "should count the nodes it made", made == 6);
+    check(test, "files should be findable with content",
+          fs.findFiles(parseFindArguments("/ -type f")) ==
+              vector<string>({"/docs/old.txt", "/docs/new.txt", "/a.txt", "/src/lib/util.h", "/src/main.cpp"}));
+    fs.setCurrentPath("/src");
+    ostringstream shown;
+    fs.setOutput(shown);
+    fs.readFile("main.cpp");
+    fs.setOutput(discard);
+    check(test, "content should be loaded", shown.str().find("int main() {}") != string::npos);
+
+    // loaded nodes behave like any other
+    fs.deleteFile("main.cpp");
+    fs.createFile("main.cpp");
+    check(test, "loaded files should be deletable and re-creatable", fs.entries().size() == 2);
+
+    // every check runs before anything is loaded
+    auto rejects = [&](vector<BulkEntry> bad) {
+        try {
+            fs.bulkLoad(bad);
+        } catch (runtime_error& e) {
+            return true;
+        }
+        return false;
+    };
+    size_t before = fs.findFiles(parseFindArguments("/")).size();
+    check(test, "existing file should be rejected", rejects({{"/z.txt", "", false}, {"/a.txt", "", false}}));
+    check(test, "path below a file should be rejected", rejects({{"/a.txt/x", "", false}}));
+    check(test, "duplicate file should be rejected", rejects({{"/y", "", false}, {"/y", "", false}}));
+    check(test, "empty name should be rejected", rejects({{"/b//c", "", false}}));
+    check(test, "failed loads should change nothing", fs.findFiles(parseFindArguments("/")).size() == before);
+
+    // a deep chain loads without recursion
+    vector<BulkEntry> chain;
+    string path;
+    for (int i = 0; i < 10000; i++) {
+        path += "/d";
+        chain.push_back({path, "", true});
+    }
+    chain.push_back({path + "/leaf", "x", false});
+    check(test, "deep chain should load", fs.bulkLoad(chain) == 10001 && fs.searchFile("leaf").size() == 1);
+}
+
+void testHostImport() {
+    string test = "Host Import";
+    char scratch[] = "/tmp/fs_import_XXXXXX";
+    string host = mkdtemp(scratch);
+    mkdir((host + "/src").c_str(), 0755);
+    mkdir((host + "/src/empty").c_str(), 0755);
+    ofstream(host + "/readme.txt") << "hello";
+    ofstream(host + "/src/main.cpp") << "int main() {}";
+    string big(2 * 1024 * 1024, 'b');   // past the mmap threshold
+    ofstream(host + "/src/big.bin") << big;
+    symlink("readme.txt", (host + "/link").c_str());
+
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("copy");
+    HostTreeStats stats = fs.importHost(host, "/copy", 4);
+    check(test, "should count files, folders and skipped entries",
+          stats.files == 3 && stats.dirs == 2 && stats.skipped == 1 && stats.bytes == 5 + 13 + big.length());
+    check(test, "tree should match the host",
+          fs.findFiles(parseFindArguments("/copy -type f -name *.cpp")) == vector<string>({"/copy/src/main.cpp"}) &&
+              fs.findFiles(parseFindArguments("/copy -type d")).size() == 3);
+    check(test, "large file should be read whole", fs.findFiles(parseFindArguments("/ -size +2000k")).size() == 1);
+
+    bool threw = false;
+    try {
+        fs.importHost(host, "/copy");
+    } catch (AlreadyExistsException& e) {
+        threw = true;
+    }
+    check(test, "importing over existing files should be rejected", threw);
+    threw = false;
+    try {
+        fs.importHost(host + "/missing");
+    } catch (HostIOException& e) {
+        threw = true;
+    }
+    check(test, "missing host folder should be rejected", threw);
+
+    unlink((host + "/link").c_str());
+    unlink((host + "/src/big.bin").c_str());
+    unlink((host + "/src/main.cpp").c_str());
+    unlink((host + "/readme.txt").c_str());
+    rmdir((host + "/src/empty").c_str());
+    rmdir((host + "/src").c_str());
+    rmdir(host.c_str());
+}
+
+void testHostExport() {
+    string test = "Host Export";
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.createDirectory("out");
+    fs.setCurrentPath("/out");
+    fs.createFile("a.txt");
+    fs.writeFile("a.txt", "alpha");
+    fs.createDirectory("empty");
+    // a path too long for a plain ustar name, split into prefix and name
+    string longName(60, 'x');
+    fs.createDirectory(longName);
+    fs.setCurrentPath("/out/" + longName);
+    fs.createDirectory(longName);
+    fs.setCurrentPath("/out/" + longName + "/" + longName);
+    fs.createFile(longName);
+    fs.writeFile(longName, string(1000, 'z'));
+    // and a name no ustar split can hold
+    string hugeName(120, 'y');
+    fs.setCurrentPath("/out");
+    fs.createFile(hugeName);
+
+    char scratch[] = "/tmp/fs_export_XXXXXX";
+    string host = mkdtemp(scratch);
+    ostringstream summary;
+    fs.setOutput(summary);
+    HostTreeStats stats = fs.exportHost(host + "/tree", "/out", 4);
+    fs.setOutput(discard);
+    check(test, "should count what it wrote", stats.files == 3 && stats.dirs == 3 && stats.bytes == 1005);
+    check(test, "summary should name the target",
+          summary.str().find("Exported 3 files, 3 folders, 0.0 MB to " + host + "/tree in ") == 0);
+    ifstream written(host + "/tree/a.txt");
+    string text;
+    getline(written, text);
+    check(test, "file content should be written", text == "alpha");
+
+    // reading it back gives the same tree
+    FileSystem copy;
+    copy.setOutput(discard);
+    copy.importHost(host + "/tree", "/", 2);
+    FileQuery everything = parseFindArguments("/ -type f");
+    vector<string> original = fs.findFiles(parseFindArguments("/out -type f"));
+    vector<string> roundTrip = copy.findFiles(everything);
+    sort(original.begin(), original.end());
+    sort(roundTrip.begin(), roundTrip.end());
+    for (size_t i = 0; i < original.size(); i++) {
+        original[i] = original[i].substr(4);   // drop "/out"
+    }
+    check(test, "export then import should round trip", original == roundTrip);
+
+    // the archive: 512-byte blocks, a ustar header per entry, a pax path
+    // record for the long one, two empty blocks at the end
+    fs.exportTar(host + "/tree.tar", "/out");
+    ifstream in(host + "/tree.tar", ios::binary);
+    string tar((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    vector<string> names;
+    string paxPath;
+    size_t at = 0;
+    while (at + 512 <= tar.length() && tar[at] != 0) {
+        string name = string(tar.c_str() + at);
+        name = name.substr(0, 100);
+        string prefix = string(tar.c_str() + at + 345).substr(0, 155);
+        size_t size = strtoull(tar.substr(at + 124, 12).c_str(), nullptr, 8);
+        char type = tar[at + 156];
+        bool magic = tar.compare(at + 257, 5, "ustar") == 0;
+        if (!magic) {
+            break;
+        }
+        if (type == 'x') {
+            string records = tar.substr(at + 512, size);
+            size_t found = records.find(" path=");
+            paxPath = records.substr(found + 6, records.find('\n', found) - found - 6);
+        } else {
+            names.push_back(paxPath != "" ? paxPath : (prefix != "" ? prefix + "/" + name : name));
+            paxPath = "";
+        }
+        at += 512 + (size + 511) / 512 * 512;
+    }
+    string longPath = longName + "/" + longName + "/" + longName;
+    check(test, "archive should hold every entry in tree order",
+          names == vector<string>({"a.txt", "empty/", longName + "/", longName + "/" + longName + "/", longPath, hugeName}));
+    check(test, "archive should end with two empty blocks",
+          tar.length() % 512 == 0 && at + 1024 == tar.length() && tar.find_first_not_of('\0', at) == string::npos);
+
+    filesystem::remove_all(host);
+}
+
 int main() {
     testConstructor();
     testCreateFile();
@@ -510,6 +1694,15 @@ int main() {
     testReadFile();
     testDeleteFile();
     testSearchFile();
+    testNamePattern();
+    testFindFiles();
+    testAttributeIndex();
+    testPagedSearch();
+    testSortedListing();
+    testDirectoryEntries();
+    testBulkLoad();
+    testHostImport();
+    testHostExport();
     testFileInfo();
     testGetCurrentPath();
     testDisplayStats();
@@ -517,6 +1710,18 @@ int main() {
     testNestedDirectories();
     testEdgeCases();
     testExceptionMessages();
+    testUndoRedo();
+    testCommandLookup();
+    testProtocolFrames();
+    testWorkload();
+    testMetrics();
+    testMemoryUsage();
+    testTrace();
+    testTreeWalk();
+    testNodeTable();
+    testStringSearch();
+    testGrep();
+    testTextIndex();
 
     cout << "\n============================================\n";
     cout << "      TEST SUMMARY\n";
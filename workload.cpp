@@ -0,0 +1,157 @@
+// workload.cpp - generate synthetic traces and replay them against FileSystem
+//
+// usage: workload generate [options] > trace.tsv
+//          --ops N  --seed N  --zipf S  --vocabulary N  --max-depth N
+//          --depth-decay P  --size-median BYTES  --size-sigma S
+//          --mix read,write,create,delete,mkdir,ls,search   (percentages)
+//        workload replay <trace file> [--threads N]
+//        workload run [generate options] [--threads N]   (generate + replay in memory)
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include "FileSystem.h"
+#include "Workload.h"
+
+using namespace std;
+
+void printUsage() {
+    cerr << "usage: workload generate [options] > trace.tsv\n";
+    cerr << "       workload replay <trace file> [--threads N]\n";
+    cerr << "       workload run [options] [--threads N]\n";
+    cerr << "options: --ops N --seed N --zipf S --vocabulary N --max-depth N --depth-decay P\n";
+    cerr << "         --size-median BYTES --size-sigma S --mix read,write,create,delete,mkdir,ls,search\n";
+}
+
+// parses generator options and --threads, returns false on a bad option
+bool parseOptions(int argc, char* argv[], int first, WorkloadConfig& config, int& threads) {
+    for (int i = first; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        string value = argv[++i];
+        if (arg == "--ops") {
+            config.ops = atoll(value.c_str());
+        } else if (arg == "--seed") {
+            config.seed = atoi(value.c_str());
+        } else if (arg == "--zipf") {
+            config.zipf = atof(value.c_str());
+        } else if (arg == "--vocabulary") {
+            config.vocabulary = max(1, atoi(value.c_str()));
+        } else if (arg == "--max-depth") {
+            config.maxDepth = max(1, atoi(value.c_str()));
+        } else if (arg == "--depth-decay") {
+            config.depthDecay = atof(value.c_str());
+        } else if (arg == "--size-median") {
+            config.sizeMedian = atof(value.c_str());
+        } else if (arg == "--size-sigma") {
+            config.sizeSigma = atof(value.c_str());
+        } else if (arg == "--threads") {
+            threads = max(1, atoi(value.c_str()));
+        } else if (arg == "--mix") {
+            int* fields[] = {&config.readPct, &config.writePct, &config.createPct, &config.deletePct,
+                             &config.mkdirPct, &config.listPct, &config.searchPct};
+            int total = 0;
+            size_t start = 0;
+            for (int f = 0; f < 7; f++) {
+                size_t comma = value.find(',', start);
+                *fields[f] = atoi(value.substr(start, comma - start).c_str());
+                total += *fields[f];
+                if (comma == string::npos) {
+                    for (int rest = f + 1; rest < 7; rest++) {
+                        *fields[rest] = 0;
+                    }
+                    break;
+                }
+                start = comma + 1;
+            }
+            if (total != 100) {
+                cerr << "--mix percentages add up to " << total << ", not 100\n";
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void printReport(ReplayStats& stats, long long ops, int threads) {
+    printf("Replayed %lld ops on %d thread(s) in %.3f s: %.0f ops/sec\n\n",
+           ops, threads, stats.seconds, stats.seconds > 0 ? ops / stats.seconds : 0.0);
+    printf("%-8s %10s %8s %10s %10s %10s %10s %12s\n",
+           "op", "count", "errors", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+    for (int i = 0; i < traceOpCount; i++) {
+        Histogram& h = stats.latency[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        printf("%-8s %10llu %8lld %10.2f %10.2f %10.2f %10.2f %12.2f\n", traceOpNames[i],
+               (unsigned long long)h.count(), stats.errors[i], h.mean() / 1000.0,
+               h.percentile(50) / 1000.0, h.percentile(90) / 1000.0,
+               h.percentile(99) / 1000.0, h.max() / 1000.0);
+    }
+}
+
+int replayTrace(vector<TraceOp>& trace, int threads) {
+    FileSystem fs;
+    ostream discard(nullptr);
+    fs.setOutput(discard);
+    fs.setJournalLimit(0);
+
+    WorkloadReplayer replayer(fs);
+    ReplayStats stats = replayer.replay(trace, threads);
+    printReport(stats, trace.size(), threads);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    string mode = argv[1];
+    WorkloadConfig config;
+    int threads = 1;
+
+    if (mode == "generate" || mode == "run") {
+        if (!parseOptions(argc, argv, 2, config, threads)) {
+            printUsage();
+            return 1;
+        }
+        WorkloadGenerator generator(config);
+        vector<TraceOp> trace = generator.generate();
+        if (mode == "run") {
+            return replayTrace(trace, threads);
+        }
+        ios::sync_with_stdio(false);
+        writeTrace(cout, trace);
+        return 0;
+    }
+
+    if (mode == "replay" && argc > 2) {
+        if (!parseOptions(argc, argv, 3, config, threads)) {
+            printUsage();
+            return 1;
+        }
+        ifstream file(argv[2]);
+        if (!file) {
+            cerr << "Cannot open trace: " << argv[2] << "\n";
+            return 1;
+        }
+        vector<TraceOp> trace;
+        string error;
+        if (!readTrace(file, trace, error)) {
+            cerr << "Bad trace: " << error << "\n";
+            return 1;
+        }
+        return replayTrace(trace, threads);
+    }
+
+    printUsage();
+    return 1;
+}